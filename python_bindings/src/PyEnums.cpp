@@ -136,6 +136,9 @@ void define_enums(py::module &m) {
         .value("LegacyBufferWrappers", Target::Feature::LegacyBufferWrappers)
         .value("TSAN", Target::Feature::TSAN)
         .value("ASAN", Target::Feature::ASAN)
+        .value("ArenaAlloc", Target::Feature::ArenaAlloc)
+        .value("FastCompile", Target::Feature::FastCompile)
+        .value("PackAllocs", Target::Feature::PackAllocs)
         .value("FeatureEnd", Target::Feature::FeatureEnd);
 
     py::enum_<halide_type_code_t>(m, "TypeCode")
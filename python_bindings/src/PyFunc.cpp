@@ -232,6 +232,7 @@ void define_func(py::module &m) {
         .def("trace_realizations", &Func::trace_realizations)
         .def("print_loop_nest", &Func::print_loop_nest)
         .def("add_trace_tag", &Func::add_trace_tag, py::arg("trace_tag"))
+        .def("trace_sample", &Func::trace_sample, py::arg("n"))
 
         // TODO: also provide to-array versions to avoid requiring filesystem usage
         .def("debug_to_file", &Func::debug_to_file)
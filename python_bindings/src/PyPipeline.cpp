@@ -83,6 +83,10 @@ void define_pipeline(py::module &m) {
             (void) p.compile_jit();
         }, py::arg("target") = get_jit_target_from_environment())
 
+        .def("fingerprint", &Pipeline::fingerprint, py::arg("target") = get_target_from_environment())
+
+        .def("set_jit_tier_threshold", &Pipeline::set_jit_tier_threshold, py::arg("calls"))
+
 
         .def("realize", [](Pipeline &p, Buffer<> buffer, const Target &target, const ParamMap &param_map) -> void {
             p.realize(Realization(buffer), target);
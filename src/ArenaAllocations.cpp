@@ -0,0 +1,186 @@
+#include <map>
+#include <set>
+
+#include "ArenaAllocations.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "PackAllocations.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Find the allocations that happen outside of all loops.
+class FindArenaCandidates : public IRVisitor {
+    using IRVisitor::visit;
+
+    int loop_depth = 0;
+
+    void visit(const For *op) override {
+        loop_depth++;
+        IRVisitor::visit(op);
+        loop_depth--;
+    }
+
+    void visit(const Allocate *op) override {
+        if (loop_depth == 0) {
+            Expr bytes = heap_allocation_bytes(op);
+            if (bytes.defined()) {
+                order.push_back(op->name);
+                sizes[op->name] = bytes;
+                conditions[op->name] = op->condition;
+            }
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    vector<string> order;
+    map<string, Expr> sizes, conditions;
+};
+
+class ContainsAllocation : public IRVisitor {
+    using IRVisitor::visit;
+
+    const map<string, Expr> &sizes;
+
+    void visit(const Allocate *op) override {
+        if (sizes.count(op->name)) {
+            result = true;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result = false;
+
+    ContainsAllocation(const map<string, Expr> &s) : sizes(s) {}
+};
+
+// Point each carved allocation into the arena. Freeing one of them is a
+// no-op; the memory goes back when the arena is released.
+class CarveFromArena : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const string &arena;
+    const map<string, Expr> &offsets;
+
+    Stmt visit(const Allocate *op) override {
+        auto it = offsets.find(op->name);
+        if (it == offsets.end()) {
+            return IRMutator2::visit(op);
+        }
+        Expr ptr = Call::make(Handle(), "halide_arena_carve",
+                              {Variable::make(Handle(), arena), it->second}, Call::Extern);
+        return Allocate::make(op->name, op->type, op->memory_type, op->extents, op->condition,
+                              mutate(op->body), ptr, "halide_arena_uncarve");
+    }
+
+public:
+    CarveFromArena(const string &a, const map<string, Expr> &o) : arena(a), offsets(o) {}
+};
+
+class InjectArena {
+    FindArenaCandidates candidates;
+    PipelineLets pipeline_lets;
+
+    // The names bound by the lets between the top of the pipeline and
+    // the current statement.
+    set<string> in_scope;
+
+    bool contains_candidate(const Stmt &s) {
+        ContainsAllocation c(candidates.sizes);
+        s.accept(&c);
+        return c.result;
+    }
+
+    // Wrap s, which contains all of the candidates, in the arena.
+    Stmt make_arena(const Stmt &s) {
+        const string arena = unique_name("arena");
+        map<string, Expr> offsets;
+        vector<std::pair<string, Expr>> lets;
+        Expr offset = make_zero(UInt(64));
+        for (const string &name : candidates.order) {
+            Expr bytes = hoist_expr(candidates.sizes[name], in_scope, pipeline_lets);
+            if (!bytes.defined()) {
+                debug(3) << "Not carving " << name << " out of the arena, its size isn't known yet\n";
+                continue;
+            }
+            // Don't reserve space for stages that will be skipped, if
+            // we can tell up front.
+            const Expr &condition = candidates.conditions[name];
+            Expr hoisted_condition = is_one(condition) ? Expr() : hoist_expr(condition, in_scope, pipeline_lets);
+            if (hoisted_condition.defined()) {
+                bytes = select(hoisted_condition, bytes, make_zero(UInt(64)));
+            }
+            string offset_name = name + ".arena_offset";
+            lets.push_back({offset_name, offset});
+            offsets[name] = Variable::make(UInt(64), offset_name);
+            offset = Variable::make(UInt(64), offset_name) + bytes;
+        }
+        if (offsets.empty()) {
+            return s;
+        }
+
+        Stmt body = CarveFromArena(arena, offsets).mutate(s);
+        Expr acquire = Call::make(Handle(), "halide_arena_acquire", {offset}, Call::Extern);
+        body = Allocate::make(arena, UInt(8), MemoryType::Heap, {}, const_true(), body,
+                              acquire, "halide_arena_release");
+        for (size_t i = lets.size(); i > 0; i--) {
+            body = LetStmt::make(lets[i - 1].first, lets[i - 1].second, body);
+        }
+        return body;
+    }
+
+public:
+    // Walk down through the statements that dominate all the
+    // candidates, and put the arena as deep as possible, so that as
+    // many allocation sizes as possible are in scope.
+    Stmt inject(const Stmt &s) {
+        if (const LetStmt *op = s.as<LetStmt>()) {
+            in_scope.insert(op->name);
+            return LetStmt::make(op->name, op->value, inject(op->body));
+        } else if (const ProducerConsumer *op = s.as<ProducerConsumer>()) {
+            return ProducerConsumer::make(op->name, op->is_producer, inject(op->body));
+        } else if (const Block *op = s.as<Block>()) {
+            if (!contains_candidate(op->first)) {
+                return Block::make(op->first, inject(op->rest));
+            }
+        } else if (const Allocate *op = s.as<Allocate>()) {
+            if (!candidates.sizes.count(op->name)) {
+                return Allocate::make(op->name, op->type, op->memory_type, op->extents,
+                                      op->condition, inject(op->body),
+                                      op->new_expr, op->free_function);
+            }
+        }
+        return make_arena(s);
+    }
+
+    InjectArena(const Stmt &s) {
+        s.accept(&candidates);
+        pipeline_lets = find_pipeline_lets(s);
+    }
+
+    bool any_candidates() const {
+        return !candidates.order.empty();
+    }
+};
+
+}  // namespace
+
+Stmt carve_arena_allocations(const Stmt &s) {
+    InjectArena injector(s);
+    if (!injector.any_candidates()) {
+        return s;
+    }
+    return injector.inject(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,26 @@
+#ifndef HALIDE_ARENA_ALLOCATIONS_H
+#define HALIDE_ARENA_ALLOCATIONS_H
+
+/** \file
+ * Defines the lowering pass that carves the heap allocations made once
+ * per pipeline invocation out of a single arena.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Rewrite the heap allocations that are made outside of all loops (and
+ * so exactly once per call) to point into a single block, acquired with
+ * halide_arena_acquire before the first of them and released after the
+ * last. The block is an upper bound on their combined size, computed
+ * from the allocation bounds. Allocations whose sizes depend on values
+ * computed after the point the arena is acquired are left alone. Used
+ * with Target::ArenaAlloc. */
+Stmt carve_arena_allocations(const Stmt &s);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
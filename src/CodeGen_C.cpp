@@ -2467,7 +2467,9 @@ void CodeGen_C::visit(const Allocate *op) {
         alloc.type = op->type;
         allocations.push(op->name, alloc);
         heap_allocations.push(op->name);
-        stream << op_type << "*" << op_name << " = (" << print_expr(op->new_expr) << ");\n";
+        string new_e = print_expr(op->new_expr);
+        do_indent();
+        stream << op_type << "*" << op_name << " = (" << op_type << "*)(" << new_e << ");\n";
     } else {
         constant_size = op->constant_allocation_size();
         if (constant_size > 0) {
@@ -162,6 +162,7 @@ bool function_takes_user_context(const std::string &name) {
         "halide_profiler_memory_free",
         "halide_profiler_pipeline_start",
         "halide_profiler_pipeline_end",
+        "halide_profiler_record_latency",
         "halide_profiler_stack_peak_update",
         "halide_spawn_thread",
         "halide_device_release",
@@ -171,6 +172,7 @@ bool function_takes_user_context(const std::string &name) {
         "halide_memoization_cache_lookup",
         "halide_memoization_cache_store",
         "halide_memoization_cache_release",
+        "halide_arena_acquire",
         "halide_cuda_run",
         "halide_opencl_run",
         "halide_opengl_run",
@@ -458,6 +460,9 @@ std::unique_ptr<llvm::TargetMachine> make_target_machine(const llvm::Module &mod
     std::string mattrs = "";
     get_target_options(module, options, mcpu, mattrs);
 
+    bool fast_compile = false;
+    get_md_bool(module.getModuleFlag("halide_fast_compile"), fast_compile);
+
     return std::unique_ptr<llvm::TargetMachine>(llvm_target->createTargetMachine(module.getTargetTriple(),
                                                 mcpu, mattrs,
                                                 options,
@@ -467,7 +472,7 @@ std::unique_ptr<llvm::TargetMachine> make_target_machine(const llvm::Module &mod
 #else
                                                 llvm::CodeModel::Small,
 #endif
-                                                llvm::CodeGenOpt::Aggressive));
+                                                fast_compile ? llvm::CodeGenOpt::None : llvm::CodeGenOpt::Aggressive));
 }
 
 void set_function_attributes_for_target(llvm::Function *fn, Target t) {
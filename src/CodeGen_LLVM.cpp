@@ -522,6 +522,7 @@ std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
     module->addModuleFlag(llvm::Module::Warning, "halide_mcpu", MDString::get(*context, mcpu()));
     module->addModuleFlag(llvm::Module::Warning, "halide_mattrs", MDString::get(*context, mattrs()));
     module->addModuleFlag(llvm::Module::Warning, "halide_per_instruction_fast_math_flags", input.any_strict_float());
+    module->addModuleFlag(llvm::Module::Warning, "halide_fast_compile", target.has_feature(Target::FastCompile) ? 1 : 0);
 
     internal_assert(module && context && builder)
         << "The CodeGen_LLVM subclass should have made an initial module before calling CodeGen_LLVM::compile\n";
@@ -1057,14 +1058,21 @@ void CodeGen_LLVM::optimize_module() {
     function_pass_manager.add(createTargetTransformInfoWrapperPass(TM ? TM->getTargetIRAnalysis() : TargetIRAnalysis()));
 
     PassManagerBuilder b;
-    b.OptLevel = 3;
+    if (get_target().has_feature(Target::FastCompile)) {
+        // Only inline what must be inlined, and leave the rest of
+        // the work to the instruction selector.
+        b.OptLevel = 0;
+        b.Inliner = createAlwaysInlinerLegacyPass();
+    } else {
+        b.OptLevel = 3;
 #if LLVM_VERSION >= 50
-    b.Inliner = createFunctionInliningPass(b.OptLevel, 0, false);
+        b.Inliner = createFunctionInliningPass(b.OptLevel, 0, false);
 #else
-    b.Inliner = createFunctionInliningPass(b.OptLevel, 0);
+        b.Inliner = createFunctionInliningPass(b.OptLevel, 0);
 #endif
-    b.LoopVectorize = true;
-    b.SLPVectorize = true;
+        b.LoopVectorize = true;
+        b.SLPVectorize = true;
+    }
 
 #if LLVM_VERSION >= 50
     if (TM) {
@@ -1,6 +1,8 @@
 #include "Derivative.h"
 
+#include "Associativity.h"
 #include "BoundaryConditions.h"
+#include "CSE.h"
 #include "DerivativeUtils.h"
 #include "Error.h"
 #include "FindCalls.h"
@@ -13,6 +15,7 @@
 #include "Substitute.h"
 
 #include <cmath>
+#include <functional>
 #include <iostream>
 
 namespace Halide {
@@ -33,12 +36,17 @@ public:
 
     void propagate_adjoints(const Func &output,
                             const Func &adjoint,
-                            const std::vector<std::pair<Expr, Expr>> &output_bounds);
+                            const std::vector<std::pair<Expr, Expr>> &output_bounds,
+                            const std::set<std::string> &wrt);
 
     std::map<FuncKey, Func> get_adjoint_funcs() const {
         return adjoint_funcs;
     }
 
+    std::map<std::string, Box> get_func_bounds() const {
+        return func_bounds;
+    }
+
 protected:
     void visit(const Cast *op);
     void visit(const Variable *op);
@@ -64,6 +72,9 @@ private:
     std::vector<std::string> let_variables;
     // Bounds of functions
     std::map<std::string, Box> func_bounds;
+    // Functions and buffers on a path from the output to the inputs we
+    // take the gradients with respect to
+    std::set<std::string> needed_funcs;
     // Current function that scatters its adjoints to its dependencies
     Func current_func;
     // Current update of the function
@@ -84,7 +95,8 @@ private:
 void ReverseAccumulationVisitor::propagate_adjoints(
     const Func &output,
     const Func &adjoint,
-    const std::vector<std::pair<Expr, Expr>> &output_bounds) {
+    const std::vector<std::pair<Expr, Expr>> &output_bounds,
+    const std::set<std::string> &wrt) {
     // Topologically sort the functions
     std::map<std::string, Function> env = find_transitive_calls(output.function());
     std::vector<std::string> order =
@@ -101,6 +113,30 @@ void ReverseAccumulationVisitor::propagate_adjoints(
     }
     internal_assert(funcs.size() > 0);
 
+    // Find the functions and buffers whose adjoints eventually reach
+    // the inputs in wrt, the rest are dead gradients. Since funcs are
+    // sorted from producers to consumers, the callees are visited first.
+    needed_funcs.clear();
+    for (const auto &func : funcs) {
+        bool needed = wrt.empty() || wrt.count(func.name()) > 0;
+        std::map<std::string, BufferInfo> buffers = find_buffer_calls(func);
+        for (const auto &it : buffers) {
+            if (wrt.empty() || wrt.count(it.first) > 0) {
+                needed_funcs.insert(it.first);
+                needed = true;
+            }
+        }
+        std::map<std::string, Function> calls = find_direct_calls(func.function());
+        for (const auto &it : calls) {
+            if (needed_funcs.count(it.first) > 0) {
+                needed = true;
+            }
+        }
+        if (needed || func.name() == output.name()) {
+            needed_funcs.insert(func.name());
+        }
+    }
+
     // If the derivatives depend on an in-place overwrite,
     // and the self reference adjoint is not 0 or 1,
     // throws an error to the users.
@@ -138,6 +174,9 @@ void ReverseAccumulationVisitor::propagate_adjoints(
     std::set<FuncKey> non_overwriting_scans;
     for (int func_id = 0; func_id < (int) funcs.size(); func_id++) {
         const Func &func = funcs[func_id];
+        if (needed_funcs.count(func.name()) == 0) {
+            continue;
+        }
         current_func = func;
         // Precompute the left hand side intervals for each update
         // We use this to determine if there's overlaps between the updates
@@ -388,6 +427,9 @@ void ReverseAccumulationVisitor::propagate_adjoints(
     // Create a stub for each function and each update to accumulate adjoints.
     for (int func_id = 0; func_id < (int) funcs.size(); func_id++) {
         const Func &func = funcs[func_id];
+        if (needed_funcs.count(func.name()) == 0) {
+            continue;
+        }
         for (int update_id = -1;
              update_id < func.num_update_definitions(); update_id++) {
             Func adjoint_func(
@@ -428,6 +470,9 @@ void ReverseAccumulationVisitor::propagate_adjoints(
         called_buffers.insert(buffers.begin(), buffers.end());
     }
     for (const auto &it : called_buffers) {
+        if (needed_funcs.count(it.first) == 0) {
+            continue;
+        }
         Func adjoint_func(it.first + "_d__");
         std::vector<Var> args;
         for (int i = 0; i < it.second.dimension; i++) {
@@ -444,6 +489,9 @@ void ReverseAccumulationVisitor::propagate_adjoints(
     // Traverse functions from producers to consumers for reverse accumulation
     for (int func_id = funcs.size() - 1; func_id >= 0; func_id--) {
         const Func &func = funcs[func_id];
+        if (needed_funcs.count(func.name()) == 0) {
+            continue;
+        }
         current_func = func;
 
         FuncKey func_key{ func.name(), func.num_update_definitions() - 1 };
@@ -934,6 +982,15 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
                 return;
             }
         }
+        // Dead gradient: the target never reaches the inputs we want
+        if (needed_funcs.count(op->name) == 0) {
+            return;
+        }
+        // Don't create updates that accumulate nothing
+        // (e.g. through integer casts or floor)
+        if (is_zero(simplify(adjoint))) {
+            return;
+        }
 
         // We create different functions for the initial condition and each update
         // When update i uses value from update i-1, we accumulate the
@@ -1077,12 +1134,19 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
                 continue;
             }
 
+            Interval var_bounds = Interval::everything();
+            for (int i = 0; i < (int) current_args.size(); i++) {
+                if (current_args[i].name() == variables[0]) {
+                    var_bounds = current_bounds[i];
+                }
+            }
             bool solved;
-            Expr result_rhs;
-            std::tie(solved, result_rhs) =
+            Expr result_rhs, condition;
+            std::tie(solved, result_rhs, condition) =
                 solve_inverse(new_args[arg_id] == lhs[arg_id],
                               new_args[arg_id].name(),
-                              variables[0]);
+                              variables[0],
+                              var_bounds);
             if (!solved) {
                 continue;
             }
@@ -1090,6 +1154,11 @@ void ReverseAccumulationVisitor::visit(const Call *op) {
             // Replace pure variable with the reverse.
             // Make sure to also substitute predicates
             adjoint = substitute_rdom_predicate(variables[0], result_rhs, adjoint);
+            // Mask out the new_args that have no inverse,
+            // e.g. the odd ones for a stride 2 access
+            if (!is_one(condition)) {
+                adjoint = select(condition, adjoint, make_const(adjoint.type(), 0.0));
+            }
 
             // Since we successfully invert, the left hand side becomes
             // new_args
@@ -1736,23 +1805,337 @@ Expr forward_accumulation(const Expr &expr,
     return forward_accumulation(expr, tangents, scope);
 }
 
+/** Rewrite the general scattering updates of the adjoint Funcs, which are
+ *  serial reductions over the whole RDom, into parallel reductions without
+ *  atomics: the outermost reduction variable is split into chunks, each
+ *  chunk accumulates into its own partial buffer (computed in parallel),
+ *  and the partial buffers are summed up afterwards.
+ */
+void parallelize_scatters(const std::map<FuncKey, Func> &adjoint_funcs,
+                          const ScatterOptions &options) {
+    user_assert(options.num_partials >= 1)
+        << "ScatterOptions::num_partials must be at least 1\n";
+    const int num_partials = options.num_partials;
+    const int min_extent = options.min_extent;
+    std::set<std::string> visited;
+    for (const auto &it : adjoint_funcs) {
+        Func func = it.second;
+        if (!visited.insert(func.name()).second || func.values().size() != 1) {
+            continue;
+        }
+        for (int update_id = 0; update_id < func.num_update_definitions(); update_id++) {
+            std::vector<ReductionVariable> rvars =
+                func.update(update_id).get_schedule().rvars();
+            if (rvars.empty()) {
+                continue;
+            }
+            // Only updates with reduction variables at the left hand side
+            // scatter
+            const std::vector<Expr> &update_args = func.update_args(update_id);
+            bool is_scattering = false;
+            for (const auto &arg : update_args) {
+                if (!gather_rvariables(arg).empty()) {
+                    is_scattering = true;
+                    break;
+                }
+            }
+            if (!is_scattering) {
+                continue;
+            }
+            // The partial buffers can be summed in any order only if the
+            // update is a commutative and associative reduction
+            AssociativeOp op = prove_associativity(
+                func.name(), update_args, func.update_values(update_id).as_vector());
+            if (!op.associative() || !op.commutative()) {
+                continue;
+            }
+            ReductionVariable outer = rvars.back();
+            Expr extent = simplify(outer.extent);
+            const int64_t *extent_int = as_const_int(extent);
+            if (extent_int != nullptr && *extent_int < min_extent) {
+                continue;
+            }
+            debug(1) << "Parallelizing the scattering update " << update_id
+                     << " of " << func.name() << "\n";
+            RVar ro, ri;
+            Var u;
+            Expr factor = (extent + num_partials - 1) / num_partials;
+            Func partials = func.update(update_id)
+                                .split(RVar(outer.var), ro, ri, factor)
+                                .rfactor(ro, u);
+            partials.compute_root();
+            partials.update().parallel(u);
+        }
+    }
+}
+
+/** Factor out the repeated subexpressions in the adjoint definitions.
+ *  For reductions f(args) = f(args) + e, only e is touched so that the
+ *  reduction pattern stays recognizable.
+ */
+void eliminate_common_adjoint_subexpressions(const std::map<FuncKey, Func> &adjoint_funcs) {
+    auto cse = [](Function func, Definition &def) {
+        for (auto &val : def.values()) {
+            const Add *add = val.as<Add>();
+            const Call *self_call = add != nullptr ? add->a.as<Call>() : nullptr;
+            if (self_call != nullptr && self_call->call_type == Call::Halide &&
+                self_call->name == func.name()) {
+                val = Add::make(add->a, common_subexpression_elimination(add->b));
+            } else {
+                val = common_subexpression_elimination(val);
+            }
+        }
+    };
+    std::set<std::string> visited;
+    for (const auto &it : adjoint_funcs) {
+        Function func = it.second.function();
+        if (!visited.insert(func.name()).second || func.has_extern_definition()) {
+            continue;
+        }
+        cse(func, func.definition());
+        for (int update_id = 0; update_id < (int) func.updates().size(); update_id++) {
+            cse(func, func.update(update_id));
+        }
+    }
+}
+
+/** Count the distinct IR nodes in an expression DAG. Used as a rough
+ *  estimate of the cost of recomputing a Func.
+ */
+class NodeCounter : public IRGraphVisitor {
+public:
+    using IRGraphVisitor::include;
+    using IRGraphVisitor::visit;
+
+    int count(const Expr &expr) {
+        include(expr);
+        return num_nodes;
+    }
+
+protected:
+    void include(const Expr &e) {
+        if (counted.insert(e.get()).second) {
+            num_nodes++;
+        }
+        IRGraphVisitor::include(e);
+    }
+
+private:
+    std::set<const IRNode *> counted;
+    int num_nodes = 0;
+};
+
+/** Estimate the number of bytes needed to store a Func over its bounds.
+ *  Returns -1 if the bounds are not constant.
+ */
+int64_t estimate_footprint(const Func &func,
+                           const Box &bounds,
+                           const std::map<std::string, int> &parameters) {
+    int64_t bytes = 0;
+    for (const auto &val : func.values().as_vector()) {
+        bytes += val.type().bytes();
+    }
+    for (int i = 0; i < (int) bounds.size(); i++) {
+        Expr extent = bounds[i].max - bounds[i].min + 1;
+        for (const auto &param : parameters) {
+            extent = substitute(param.first, Expr(param.second), extent);
+        }
+        extent = simplify(extent);
+        const int64_t *extent_int = as_const_int(extent);
+        if (extent_int == nullptr) {
+            return -1;
+        }
+        bytes *= std::max(*extent_int, int64_t(0));
+    }
+    return bytes;
+}
+
+/** Decide which forward Funcs are stored and which are recomputed by the
+ *  adjoint Funcs, and redirect the adjoint Funcs to clones of the
+ *  recomputed ones. Returns the map from forward Func name to clone.
+ */
+std::map<std::string, Func> checkpoint_forward_funcs(
+    const Func &output,
+    const std::map<FuncKey, Func> &adjoint_funcs,
+    const std::map<std::string, Box> &func_bounds,
+    const CheckpointOptions &options) {
+    std::map<std::string, Func> recomputed;
+    if (options.memory_budget < 0 && options.recomputed.empty()) {
+        // Store everything
+        return recomputed;
+    }
+
+    std::map<std::string, Function> env = find_transitive_calls(output.function());
+    // Gather every Func of the backward pass, including the ones synthesized
+    // while scheduling the adjoints (e.g. rfactor intermediates)
+    std::map<std::string, Function> backward_env;
+    for (const auto &it : adjoint_funcs) {
+        std::map<std::string, Function> local_env =
+            find_transitive_calls(it.second.function());
+        for (const auto &fit : local_env) {
+            if (env.find(fit.first) == env.end()) {
+                backward_env.insert(fit);
+            }
+        }
+    }
+    // Gather the backward Funcs reading each forward Func
+    std::map<std::string, std::vector<Func>> readers;
+    for (const auto &it : backward_env) {
+        Func adjoint_func(it.second);
+        std::map<std::string, Function> calls =
+            find_direct_calls(adjoint_func.function());
+        for (const auto &call : calls) {
+            auto fit = env.find(call.first);
+            if (fit == env.end() || call.first == output.name()) {
+                continue;
+            }
+            // Only forward Funcs without update definitions can be
+            // recomputed inline
+            if (!fit->second.can_be_inlined()) {
+                user_assert(options.recomputed.count(call.first) == 0)
+                    << "Can't recompute " << call.first
+                    << " in the backward pass since it can't be inlined.\n";
+                continue;
+            }
+            readers[call.first].push_back(adjoint_func);
+        }
+    }
+
+    struct Candidate {
+        std::string name;
+        int64_t bytes;
+        double cost_per_byte;
+    };
+    std::vector<Candidate> candidates;
+    std::set<std::string> to_recompute;
+    std::set<std::string> counted;
+    int64_t stored_bytes = 0;
+    // Account for a forward Func read by the backward pass. Recomputing a
+    // Func makes the backward pass read its producers instead, so they are
+    // accounted for in turn.
+    std::function<void(const std::string &)> recompute;
+    std::function<void(const std::string &)> count = [&](const std::string &name) {
+        if (!counted.insert(name).second) {
+            return;
+        }
+        if (options.recomputed.count(name)) {
+            recompute(name);
+            return;
+        }
+        Func func(env[name]);
+        auto bit = func_bounds.find(name);
+        internal_assert(bit != func_bounds.end());
+        int64_t bytes = estimate_footprint(func, bit->second, options.parameters);
+        if (options.stored.count(name) || bytes <= 0) {
+            // Explicitly stored, or we can't tell how large it is
+            if (bytes > 0) {
+                stored_bytes += bytes;
+            }
+            return;
+        }
+        int cost = 0;
+        for (const auto &val : func.values().as_vector()) {
+            NodeCounter counter;
+            cost += counter.count(val);
+        }
+        stored_bytes += bytes;
+        candidates.push_back(Candidate{ name, bytes, double(cost) / double(bytes) });
+    };
+    recompute = [&](const std::string &name) {
+        to_recompute.insert(name);
+        for (const auto &call : find_direct_calls(env[name])) {
+            auto fit = env.find(call.first);
+            if (fit != env.end() && call.first != output.name() &&
+                fit->second.can_be_inlined() && func_bounds.count(call.first)) {
+                count(call.first);
+            }
+        }
+    };
+    for (const auto &it : readers) {
+        count(it.first);
+    }
+
+    if (options.memory_budget >= 0) {
+        // Recompute the cheapest Funcs first until we fit in the budget
+        while (stored_bytes > options.memory_budget) {
+            int best = -1;
+            for (int i = 0; i < (int) candidates.size(); i++) {
+                if (to_recompute.count(candidates[i].name) == 0 &&
+                    (best < 0 || candidates[i].cost_per_byte < candidates[best].cost_per_byte)) {
+                    best = i;
+                }
+            }
+            if (best < 0) {
+                break;
+            }
+            Candidate c = candidates[best];
+            stored_bytes -= c.bytes;
+            recompute(c.name);
+        }
+        if (stored_bytes > options.memory_budget) {
+            user_warning << "Stored forward Funcs take " << stored_bytes
+                         << " bytes, which exceeds the checkpointing memory budget of "
+                         << options.memory_budget << " bytes.\n";
+        }
+    }
+
+    // Clone the consumers first, so that the clone of a recomputed Func can
+    // be redirected into the clones of the recomputed Funcs calling it. The
+    // clones are inlined, otherwise recomputing would just store a copy.
+    std::vector<std::string> order = topological_order({ output.function() }, env);
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+        const std::string &name = *it;
+        if (to_recompute.count(name) == 0) {
+            continue;
+        }
+        debug(1) << "Recomputing " << name << " in the backward pass\n";
+        std::vector<Func> clone_readers = readers[name];
+        for (const auto &consumer : recomputed) {
+            Func consumer_func(env[consumer.first]);
+            if (find_direct_calls(consumer_func.function()).count(name)) {
+                clone_readers.push_back(consumer.second);
+            }
+        }
+        internal_assert(!clone_readers.empty());
+        Func func(env[name]);
+        Func clone = func.clone_in(clone_readers);
+        clone.compute_inline();
+        recomputed[name] = clone;
+    }
+    return recomputed;
+}
+
 }  // namespace Internal
 
 Derivative propagate_adjoints(const Func &output,
                               const Func &adjoint,
-                              const std::vector<std::pair<Expr, Expr>> &output_bounds) {
+                              const std::vector<std::pair<Expr, Expr>> &output_bounds,
+                              const CheckpointOptions &checkpoint,
+                              const std::set<std::string> &wrt,
+                              const ScatterOptions &scatter) {
     user_assert(output.dimensions() == adjoint.dimensions())
         << "output dimensions and adjoint dimensions must match\n";
     user_assert((int) output_bounds.size() == adjoint.dimensions())
         << "output_bounds and adjoint dimensions must match\n";
 
     Internal::ReverseAccumulationVisitor visitor;
-    visitor.propagate_adjoints(output, adjoint, output_bounds);
-    return Derivative{ visitor.get_adjoint_funcs() };
+    visitor.propagate_adjoints(output, adjoint, output_bounds, wrt);
+    std::map<FuncKey, Func> adjoint_funcs = visitor.get_adjoint_funcs();
+    if (scatter.parallelize) {
+        Internal::parallelize_scatters(adjoint_funcs, scatter);
+    }
+    Internal::eliminate_common_adjoint_subexpressions(adjoint_funcs);
+    std::map<std::string, Func> recomputed =
+        Internal::checkpoint_forward_funcs(
+            output, adjoint_funcs, visitor.get_func_bounds(), checkpoint);
+    return Derivative{ adjoint_funcs, recomputed };
 }
 
 Derivative propagate_adjoints(const Func &output,
-                              const Buffer<float> &adjoint) {
+                              const Buffer<float> &adjoint,
+                              const CheckpointOptions &checkpoint,
+                              const std::set<std::string> &wrt,
+                              const ScatterOptions &scatter) {
     user_assert(output.dimensions() == adjoint.dimensions());
     std::vector<std::pair<Expr, Expr>> bounds;
     for (int dim = 0; dim < adjoint.dimensions(); dim++) {
@@ -1761,10 +2144,13 @@ Derivative propagate_adjoints(const Func &output,
     }
     Func adjoint_func("adjoint_func");
     adjoint_func(_) = adjoint(_);
-    return propagate_adjoints(output, adjoint_func, bounds);
+    return propagate_adjoints(output, adjoint_func, bounds, checkpoint, wrt, scatter);
 }
 
-Derivative propagate_adjoints(const Func &output) {
+Derivative propagate_adjoints(const Func &output,
+                              const CheckpointOptions &checkpoint,
+                              const std::set<std::string> &wrt,
+                              const ScatterOptions &scatter) {
     Func adjoint("adjoint");
     adjoint(output.args()) = Internal::make_const(output.value().type(), 1.0);
     std::vector<std::pair<Expr, Expr>> output_bounds;
@@ -1772,7 +2158,7 @@ Derivative propagate_adjoints(const Func &output) {
     for (int i = 0; i < output.dimensions(); i++) {
         output_bounds.push_back({ 0, 0 });
     }
-    return propagate_adjoints(output, adjoint, output_bounds);
+    return propagate_adjoints(output, adjoint, output_bounds, checkpoint, wrt, scatter);
 }
 
 Func propagate_tangents(const Func &output,
@@ -10,6 +10,7 @@
 #include "Module.h"
 
 #include <array>
+#include <map>
 #include <set>
 #include <vector>
 
@@ -18,12 +19,50 @@ namespace Halide {
 // function name & update_id, for initialization update_id == -1
 using FuncKey = std::pair<std::string, int>;
 
+/**
+ *  Gradient checkpointing options. Forward Funcs read by the adjoint
+ *  Funcs are either stored (realized once and reread by the backward pass)
+ *  or recomputed inline inside the adjoint Funcs that read them.
+ *  Forward Funcs listed in neither set are decided by a cost heuristic:
+ *  everything is stored, then the Funcs that are cheapest to recompute
+ *  per byte are switched to recomputation until the stored footprint
+ *  fits in memory_budget.
+ */
+struct CheckpointOptions {
+    // Forward Funcs that are always stored
+    std::set<std::string> stored;
+    // Forward Funcs that are always recomputed
+    std::set<std::string> recomputed;
+    // Upper bound of the stored footprint in bytes, negative means unlimited
+    int64_t memory_budget = -1;
+    // Estimations of the variable parameters for computing the footprints
+    std::map<std::string, int> parameters;
+};
+
+/**
+ *  Options for parallelizing the general scattering updates of the adjoint
+ *  Funcs, which are otherwise serial reductions over the whole RDom. When
+ *  enabled, the outermost reduction variable of each commutative and
+ *  associative scattering update is split into num_partials chunks, which
+ *  accumulate into their own partial buffers in parallel (via rfactor).
+ *  This rewrites the adjoint Funcs and schedules the partials at root.
+ */
+struct ScatterOptions {
+    bool parallelize = false;
+    // Number of partial buffers for each scattering update
+    int num_partials = 8;
+    // Reductions known to be shorter than this are left serial
+    int min_extent = 64;
+};
+
 /**
  *  Helper structure storing the adjoints Func.
  *  Use d(func) or d(buffer) to obtain the derivative Func.
  */
 struct Derivative {
     std::map<FuncKey, Func> adjoints;
+    // Forward Func name -> the clone recomputed inside the adjoint Funcs
+    std::map<std::string, Func> recomputed;
 
     Func operator()(const Func &func, int update_id = -1, bool bounded = true) const {
         std::string name = func.name();
@@ -67,21 +106,32 @@ struct Derivative {
  *  Given a Func and a corresponding adjoint, (back)propagate the
  *  adjoint to all dependent Funcs, buffers, and parameters.
  *  The bounds of output and adjoint needs to be specified with pair {min, max}
+ *  If wrt (names of Funcs or buffers) is not empty, only the
+ *  adjoints on a path from the output to them are generated.
  */
 Derivative propagate_adjoints(const Func &output,
                               const Func &adjoint,
-                              const std::vector<std::pair<Expr, Expr>> &output_bounds);
+                              const std::vector<std::pair<Expr, Expr>> &output_bounds,
+                              const CheckpointOptions &checkpoint = CheckpointOptions(),
+                              const std::set<std::string> &wrt = std::set<std::string>(),
+                              const ScatterOptions &scatter = ScatterOptions());
 /**
  *  Given a Func and a corresponding adjoint buffer, (back)propagate the
  *  adjoint to all dependent Funcs, buffers, and parameters.
  */
 Derivative propagate_adjoints(const Func &output,
-                              const Buffer<float> &adjoint);
+                              const Buffer<float> &adjoint,
+                              const CheckpointOptions &checkpoint = CheckpointOptions(),
+                              const std::set<std::string> &wrt = std::set<std::string>(),
+                              const ScatterOptions &scatter = ScatterOptions());
 /**
  *  Given a scalar Func with size 1, (back)propagate the gradient
  *  to all dependent Funcs, buffers, and parameters.
  */
-Derivative propagate_adjoints(const Func &output);
+Derivative propagate_adjoints(const Func &output,
+                              const CheckpointOptions &checkpoint = CheckpointOptions(),
+                              const std::set<std::string> &wrt = std::set<std::string>(),
+                              const ScatterOptions &scatter = ScatterOptions());
 /**
  *  Given a Func and the tangents of inputs, (forward-)propagate the derivatives
  *  to the output.
@@ -416,34 +416,114 @@ ReductionDomain extract_rdom(const Expr &expr) {
     return extractor.gather(expr);
 }
 
-std::pair<bool, Expr> solve_inverse(Expr expr,
-                                    const std::string &new_var,
-                                    const std::string &var) {
-    expr = substitute_in_all_lets(simplify(expr));
-    Interval interval = solve_for_outer_interval(expr, var);
-    if (!interval.is_bounded()) {
-        return std::make_pair(false, Expr());
+class LikelyRemover : public IRMutator {
+public:
+    using IRMutator::visit;
+
+    Expr remove(const Expr &expr) {
+        return mutate(expr);
     }
-    Expr rmin = simplify(interval.min);
-    Expr rmax = simplify(interval.max);
-    Expr rextent = simplify(rmax - rmin + 1);
 
-    const int64_t *extent_int = as_const_int(rextent);
-    if (extent_int == nullptr) {
-        return std::make_pair(false, Expr());
+    void visit(const Call *op) {
+        if (op->is_intrinsic(Call::likely)) {
+            expr = mutate(op->args[0]);
+        } else {
+            IRMutator::visit(op);
+        }
     }
+};
 
-    // For some reason interval.is_single_point() doesn't work
-    if (extent_int != nullptr && *extent_int == 1) {
-        return std::make_pair(true, rmin);
+/** If expr == a * var + b, where a is a constant integer and b does
+ *  not depend on var, return (a, b).
+ */
+std::pair<const int64_t *, Expr> as_affine(const Expr &expr,
+                                           const std::string &var) {
+    Expr b = simplify(substitute(var, Expr(0), expr));
+    Expr a = simplify(substitute(var, Expr(1), expr) - b);
+    const int64_t *a_int = as_const_int(a);
+    if (a_int == nullptr || *a_int == 0 ||
+        !can_prove(expr == a * Variable::make(expr.type(), var) + b)) {
+        return std::make_pair(nullptr, Expr());
+    }
+    return std::make_pair(a_int, b);
+}
+
+std::tuple<bool, Expr, Expr> solve_inverse(Expr expr,
+                                           const std::string &new_var,
+                                           const std::string &var,
+                                           const Interval &var_bounds) {
+    const EQ *eq = expr.as<EQ>();
+    internal_assert(eq != nullptr);
+    Expr func_expr = LikelyRemover().remove(substitute_in_all_lets(eq->b));
+    Expr new_var_expr = Variable::make(func_expr.type(), new_var);
+    expr = substitute_in_all_lets(simplify(expr));
+    Interval interval = solve_for_outer_interval(expr, var);
+    if (interval.is_bounded()) {
+        Expr rmin = simplify(interval.min);
+        Expr rmax = simplify(interval.max);
+        Expr rextent = simplify(rmax - rmin + 1);
+
+        const int64_t *extent_int = as_const_int(rextent);
+        if (extent_int != nullptr) {
+            // For some reason interval.is_single_point() doesn't work
+            if (*extent_int == 1) {
+                return std::make_tuple(true, rmin, const_true());
+            }
+
+            // Create a RDom to loop over the interval
+            RDom r(0, int(*extent_int));
+            Expr cond = substitute(var, rmin + r.x, expr.as<EQ>()->b);
+            cond = substitute(new_var, Var(var), cond) == Var(var);
+            r.where(cond);
+            return std::make_tuple(true, rmin + r.x, const_true());
+        }
     }
 
-    // Create a RDom to loop over the interval
-    RDom r(0, int(*extent_int));
-    Expr cond = substitute(var, rmin + r.x, expr.as<EQ>()->b);
-    cond = substitute(new_var, Var(var), cond) == Var(var);
-    r.where(cond);
-    return std::make_pair(true, rmin + r.x);
+    // Strided access
+    // new_var == s * var + k  =>  var == (new_var - k) / s
+    // only where (new_var - k) % s == 0
+    const int64_t *stride;
+    Expr offset;
+    std::tie(stride, offset) = as_affine(func_expr, var);
+    if (stride != nullptr) {
+        Expr s = make_const(func_expr.type(), *stride);
+        Expr diff = new_var_expr - offset;
+        return std::make_tuple(true, simplify(diff / s), simplify(diff % s == 0));
+    }
+
+    // Clamped access (e.g. from BoundaryConditions::repeat_edge)
+    // new_var == clamp(var + k, lo, hi)
+    // The interior inverts to var == new_var - k, while the edges gather
+    // all the var that got clamped to them:
+    // new_var == lo  =>  var in [var_bounds.min, lo - k]
+    // new_var == hi  =>  var in [hi - k, var_bounds.max]
+    const Max *max_op = func_expr.as<Max>();
+    const Min *min_op = max_op != nullptr ? max_op->a.as<Min>() : nullptr;
+    if (min_op != nullptr && var_bounds.is_bounded()) {
+        Expr lo = max_op->b;
+        Expr hi = min_op->b;
+        std::tie(stride, offset) = as_affine(min_op->a, var);
+        if (stride == nullptr || *stride != 1 ||
+            has_variable(lo, var) || has_variable(hi, var) ||
+            !can_prove(lo < hi)) {
+            return std::make_tuple(false, Expr(), Expr());
+        }
+        Expr lo_margin = simplify(lo - offset - var_bounds.min);
+        Expr hi_margin = simplify(var_bounds.max - (hi - offset));
+        Expr extent = simplify(max(max(lo_margin, hi_margin), 0) + 1);
+        RDom r(0, extent);
+        Expr at_lo = new_var_expr == lo;
+        Expr at_hi = new_var_expr == hi;
+        r.where(r.x == 0 ||
+                (at_lo && r.x <= lo_margin) ||
+                (at_hi && r.x <= hi_margin));
+        Expr interior = new_var_expr - offset;
+        Expr rhs = select(at_lo, interior - r.x,
+                          select(at_hi, interior + r.x, interior));
+        return std::make_tuple(true, rhs, lo <= new_var_expr && new_var_expr <= hi);
+    }
+
+    return std::make_tuple(false, Expr(), Expr());
 }
 
 struct BufferDimensionsFinder : public IRGraphVisitor {
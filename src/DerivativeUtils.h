@@ -8,6 +8,8 @@
 #include "Scope.h"
 #include "Var.h"
 
+#include <tuple>
+
 namespace Halide {
 namespace Internal {
 
@@ -80,10 +82,16 @@ ReductionDomain extract_rdom(const Expr &expr);
 /**
  * expr is new_var == f(var), solve for var == g(new_var)
  * if multiple new_var correponds to same var, introduce a RDom
- */
-std::pair<bool, Expr> solve_inverse(Expr expr,
-                                    const std::string &new_var,
-                                    const std::string &var);
+ * Besides the cases solve_for_outer_interval handles, this also inverts
+ * strided affine arguments (f(var) = s * var + k) and clamped ones
+ * (f(var) = clamp(var + k, lo, hi)); the latter needs the bounds of var.
+ * Returns (solved, g(new_var), condition), where the inverse is only valid
+ * for the new_var satisfying condition.
+ */
+std::tuple<bool, Expr, Expr> solve_inverse(Expr expr,
+                                           const std::string &new_var,
+                                           const std::string &var,
+                                           const Interval &var_bounds = Interval::everything());
 /**
  * Find all calls to image buffers in the function
  */
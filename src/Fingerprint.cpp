@@ -0,0 +1,449 @@
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#include "Fingerprint.h"
+#include "FindCalls.h"
+#include "Function.h"
+#include "IRPrinter.h"
+#include "LLVM_Headers.h"
+#include "LLVM_Runtime_Linker.h"
+#include "Module.h"
+#include "Target.h"
+
+// Identifies the build of the compiler: set by the build from the
+// commit of the source.
+#ifndef HALIDE_BUILD_ID
+#define HALIDE_BUILD_ID "unknown"
+#endif
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Prints IR for a fingerprint. Unlike the IRPrinter, float constants
+// are printed exactly, and the Parameters and Buffers referred to are
+// collected, so that their metadata can be printed too.
+class FingerprintPrinter : public IRPrinter {
+public:
+    map<string, Parameter> params;
+    map<string, Buffer<>> buffers;
+    // Name Funcs by the names they were given rather than their unique
+    // names, which differ between copies of them.
+    bool origin_names = false;
+
+    FingerprintPrinter(std::ostream &s) : IRPrinter(s) {}
+
+    void print_exprs(const vector<Expr> &exprs) {
+        stream << "(";
+        for (const Expr &e : exprs) {
+            print_expr(e);
+            stream << ", ";
+        }
+        stream << ")";
+    }
+
+    // Print an Expr, which may be undefined.
+    void print_expr(const Expr &e) {
+        if (e.defined()) {
+            print(e);
+        } else {
+            stream << "undef";
+        }
+    }
+
+    void add_param(const Parameter &p) {
+        if (p.defined()) {
+            params[p.name()] = p;
+        }
+    }
+
+    void add_buffer(const Buffer<> &b) {
+        if (b.defined()) {
+            buffers[b.name()] = b;
+        }
+    }
+
+    string func_name(const Function &f) const {
+        return origin_names ? f.origin_name() : f.name();
+    }
+
+protected:
+    using IRPrinter::visit;
+
+    void visit(const FloatImm *op) {
+        stream << "(float" << op->type.bits() << ")" << reinterpret_bits<uint64_t>(op->value);
+    }
+
+    void visit(const Variable *op) {
+        IRPrinter::visit(op);
+        add_param(op->param);
+        add_buffer(op->image);
+    }
+
+    void visit(const Call *op) {
+        if (origin_names && op->call_type == Call::Halide && op->func.defined()) {
+            stream << func_name(Function(op->func)) << "[" << op->value_index << "](";
+            print_list(op->args);
+            stream << ")";
+        } else {
+            IRPrinter::visit(op);
+        }
+        add_param(op->param);
+        add_buffer(op->image);
+    }
+
+    void visit(const Load *op) {
+        IRPrinter::visit(op);
+        add_param(op->param);
+        add_buffer(op->image);
+    }
+};
+
+// The number of trailing zero bits of the address of a buffer, up to
+// 12. Codegen uses the alignment of buffers when jitting.
+int alignment_bits(const Buffer<> &b) {
+    uintptr_t ptr = (uintptr_t)b.data();
+    int bits = 0;
+    while (bits < 12 && !(ptr & ((uintptr_t)1 << bits))) {
+        bits++;
+    }
+    return bits;
+}
+
+// Print the metadata of the collected Parameters and Buffers. Printing
+// the constraints of a Parameter may turn up more of them.
+void print_params_and_buffers(FingerprintPrinter &p, std::ostream &s, bool jit) {
+    std::set<string> done;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        map<string, Parameter> params = p.params;
+        for (const auto &it : params) {
+            if (!done.insert(it.first).second) continue;
+            changed = true;
+            const Parameter &param = it.second;
+            s << "param " << param.name() << " " << param.type() << " " << param.dimensions();
+            if (param.is_buffer()) {
+                s << " host_alignment " << param.host_alignment();
+                for (int i = 0; i < param.dimensions(); i++) {
+                    s << " [";
+                    p.print_exprs({param.min_constraint(i), param.extent_constraint(i), param.stride_constraint(i),
+                                  param.min_constraint_estimate(i), param.extent_constraint_estimate(i)});
+                    s << "]";
+                }
+            } else {
+                s << " ";
+                p.print_exprs({param.min_value(), param.max_value(), param.estimate()});
+            }
+            s << "\n";
+        }
+    }
+
+    for (const auto &it : p.buffers) {
+        const Buffer<> &b = it.second;
+        s << "buffer " << b.name() << " " << b.type() << " " << b.dimensions();
+        if (jit) {
+            // Jitted pipelines get their buffers as arguments, so the
+            // contents don't matter.
+            s << " align " << alignment_bits(b) << "\n";
+        } else {
+            for (int i = 0; i < b.dimensions(); i++) {
+                s << " [" << b.dim(i).min() << ", " << b.dim(i).extent() << ", " << b.dim(i).stride() << "]";
+            }
+            s << "\n";
+            if (b.data()) {
+                s.write((const char *)b.data(), b.size_in_bytes());
+            }
+        }
+    }
+}
+
+string loop_level_string(const LoopLevel &level) {
+    // Only locked loop levels can be inspected. Lock a copy, so that
+    // the schedule can still be changed.
+    LoopLevel copy;
+    copy.set(level);
+    copy.lock();
+    return copy.to_string();
+}
+
+void print_bounds(FingerprintPrinter &p, std::ostream &s, const char *kind, const vector<Bound> &bounds) {
+    for (const Bound &b : bounds) {
+        s << kind << " " << b.var << " ";
+        p.print_exprs({b.min, b.extent, b.modulus, b.remainder});
+        s << "\n";
+    }
+}
+
+void print_stage_schedule(FingerprintPrinter &p, std::ostream &s, const StageSchedule &sched) {
+    for (const ReductionVariable &rv : sched.rvars()) {
+        s << "rvar " << rv.var << " ";
+        p.print_exprs({rv.min, rv.extent});
+        s << "\n";
+    }
+    for (const Split &split : sched.splits()) {
+        s << "split " << (int)split.split_type << " " << split.old_var << " " << split.outer << " " << split.inner
+          << " " << split.exact << " " << (int)split.tail << " ";
+        p.print_expr(split.factor);
+        s << "\n";
+    }
+    for (const Dim &d : sched.dims()) {
+        s << "dim " << d.var << " " << d.for_type << " " << d.device_api << " " << (int)d.dim_type << "\n";
+    }
+    for (const PrefetchDirective &pf : sched.prefetches()) {
+        s << "prefetch " << pf.name << " " << pf.var << " " << (int)pf.strategy << " ";
+        p.print_expr(pf.offset);
+        p.add_param(pf.param);
+        s << "\n";
+    }
+    s << "fuse_level " << loop_level_string(sched.fuse_level().level);
+    for (const auto &it : sched.fuse_level().align) {
+        s << " " << it.first << " " << (int)it.second;
+    }
+    s << "\n";
+    for (const FusedPair &fp : sched.fused_pairs()) {
+        s << "fused_pair " << fp.func_1 << " " << fp.stage_1 << " "
+          << fp.func_2 << " " << fp.stage_2 << " " << fp.var_name << "\n";
+    }
+    s << "touched " << sched.touched()
+      << " allow_race_conditions " << sched.allow_race_conditions() << "\n";
+}
+
+void print_definition(FingerprintPrinter &p, std::ostream &s, const Definition &def, bool schedule = true) {
+    if (!def.defined()) {
+        s << "undefined\n";
+        return;
+    }
+    s << (def.is_init() ? "init " : "update ");
+    p.print_exprs(def.args());
+    s << " = ";
+    p.print_exprs(def.values());
+    s << " if ";
+    p.print_expr(def.predicate());
+    s << "\n";
+    if (schedule) {
+        print_stage_schedule(p, s, def.schedule());
+    }
+    for (const Specialization &spec : def.specializations()) {
+        s << "specialization ";
+        p.print_expr(spec.condition);
+        s << " " << spec.failure_message << " {\n";
+        print_definition(p, s, spec.definition, schedule);
+        s << "}\n";
+    }
+}
+
+// Print what a Function computes: its signature, definitions and
+// extern stage, and the schedules of its stages if asked.
+void print_function_definition(FingerprintPrinter &p, std::ostream &s, const Function &f, bool schedule) {
+    s << "func " << p.func_name(f) << " (";
+    for (const string &arg : f.args()) {
+        s << arg << ", ";
+    }
+    s << ") -> (";
+    for (const Type &t : f.output_types()) {
+        s << t << ", ";
+    }
+    s << ")\n";
+
+    print_definition(p, s, f.definition(), schedule);
+    for (const Definition &update : f.updates()) {
+        print_definition(p, s, update, schedule);
+    }
+
+    if (f.has_extern_definition()) {
+        s << "extern " << f.extern_function_name()
+          << " " << f.extern_definition_name_mangling()
+          << " " << f.extern_definition_uses_old_buffer_t()
+          << " " << f.extern_function_device_api() << " (";
+        for (const ExternFuncArgument &arg : f.extern_arguments()) {
+            if (arg.is_func()) {
+                s << "func " << p.func_name(Function(arg.func));
+            } else if (arg.is_buffer()) {
+                s << "buffer " << arg.buffer.name();
+                p.add_buffer(arg.buffer);
+            } else if (arg.is_expr()) {
+                p.print_expr(arg.expr);
+            } else if (arg.is_image_param()) {
+                s << "param " << arg.image_param.name();
+                p.add_param(arg.image_param);
+            }
+            s << ", ";
+        }
+        s << ") ";
+        p.print_expr(f.extern_definition_proxy_expr());
+        s << "\n";
+    }
+}
+
+void print_function(FingerprintPrinter &p, std::ostream &s, const Function &f) {
+    print_function_definition(p, s, f, true);
+
+    for (const Parameter &buf : f.output_buffers()) {
+        p.add_param(buf);
+    }
+
+    s << "trace " << f.is_tracing_loads() << " " << f.is_tracing_stores()
+      << " " << f.is_tracing_realizations() << " " << f.get_trace_sample();
+    for (const string &tag : f.get_trace_tags()) {
+        s << " \"" << tag << "\"";
+    }
+    s << "\n";
+    print_bounds(p, s, "trace_region", f.get_trace_region());
+    s << "debug_file \"" << f.debug_file() << "\"\n";
+
+    const FuncSchedule &sched = f.schedule();
+    s << "store_at " << loop_level_string(sched.store_level())
+      << " compute_at " << loop_level_string(sched.compute_level())
+      << " memoized " << sched.memoized()
+      << " memory_type " << sched.memory_type() << "\n";
+    for (const StorageDim &d : sched.storage_dims()) {
+        s << "storage_dim " << d.var << " " << d.fold_forward << " ";
+        p.print_exprs({d.alignment, d.fold_factor});
+        s << "\n";
+    }
+    print_bounds(p, s, "bound", sched.bounds());
+    print_bounds(p, s, "estimate", sched.estimates());
+    for (const auto &it : sched.wrappers()) {
+        s << "wrapper " << it.first << " " << Function(it.second).name() << "\n";
+    }
+}
+
+string hash_to_hex(const string &data) {
+    llvm::SHA1 hash;
+    hash.update(data);
+    return llvm::toHex(hash.final());
+}
+
+// Identify the build of Halide that compiles for a target by a hash of
+// the runtime it links into modules for that target. Computed once per
+// target.
+string runtime_build_id(const Target &target) {
+    static std::mutex mutex;
+    static map<string, string> ids;
+    std::lock_guard<std::mutex> lock(mutex);
+    string &id = ids[target.to_string()];
+    if (id.empty()) {
+        llvm::LLVMContext context;
+        std::unique_ptr<llvm::Module> runtime = get_initial_module_for_target(target, &context);
+        llvm::SmallVector<char, 256> buffer;
+        llvm::raw_svector_ostream out(buffer);
+#if LLVM_VERSION >= 70
+        WriteBitcodeToFile(*runtime, out);
+#else
+        WriteBitcodeToFile(runtime.get(), out);
+#endif
+        id = hash_to_hex(string(buffer.data(), buffer.size()));
+    }
+    return id;
+}
+
+}  // namespace
+
+string fingerprint(const vector<Function> &outputs, const Target &target,
+                   const vector<string> &extra) {
+    std::ostringstream s;
+    s << "halide " << HALIDE_BUILD_ID << "\n"
+      << "llvm " << LLVM_VERSION << "\n"
+      << "runtime " << runtime_build_id(target) << "\n"
+      << "target " << target << "\n";
+    for (const string &e : extra) {
+        s << "extra " << e << "\n";
+    }
+    s << "outputs";
+    for (const Function &f : outputs) {
+        s << " " << f.name();
+    }
+    s << "\n";
+
+    // Find all the Functions the outputs depend on, including the
+    // wrappers made by Func::in, which are only called once lowering
+    // has substituted them in.
+    map<string, Function> env;
+    for (const Function &f : outputs) {
+        populate_environment(f, env);
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        map<string, Function> funcs = env;
+        for (const auto &it : funcs) {
+            for (const auto &w : it.second.schedule().wrappers()) {
+                Function wrapper(w.second);
+                if (!env.count(wrapper.name())) {
+                    populate_environment(wrapper, env);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    FingerprintPrinter p(s);
+    for (const auto &it : env) {
+        print_function(p, s, it.second);
+    }
+    print_params_and_buffers(p, s, target.has_feature(Target::JIT));
+
+    return hash_to_hex(s.str());
+}
+
+string definition_fingerprint(const Function &f) {
+    std::ostringstream s;
+    FingerprintPrinter p(s);
+    p.origin_names = true;
+
+    map<string, Function> env;
+    populate_environment(f, env);
+    // Copies of a Function share its origin name and definition, so
+    // print each once.
+    map<string, Function> by_origin_name;
+    for (const auto &it : env) {
+        by_origin_name.emplace(it.second.origin_name(), it.second);
+    }
+    for (const auto &it : by_origin_name) {
+        print_function_definition(p, s, it.second, false);
+    }
+    return hash_to_hex(s.str());
+}
+
+string fingerprint(const Module &m) {
+    std::ostringstream s;
+    s << "halide " << HALIDE_BUILD_ID << "\n"
+      << "llvm " << LLVM_VERSION << "\n"
+      << "runtime " << runtime_build_id(m.target()) << "\n"
+      << "target " << m.target() << "\n";
+    for (const ExternalCode &c : m.external_code()) {
+        s << "external " << c.name() << "\n";
+        s.write((const char *)c.contents().data(), c.contents().size());
+    }
+
+    FingerprintPrinter p(s);
+    for (const Buffer<> &b : m.buffers()) {
+        p.add_buffer(b);
+    }
+    for (const LoweredFunc &f : m.functions()) {
+        s << f.linkage << " " << f.name_mangling << " func " << f.name << " (";
+        for (const LoweredArgument &arg : f.args) {
+            s << arg.name << " " << (int)arg.kind << " " << arg.type << " " << (int)arg.dimensions
+              << " " << arg.alignment.modulus << " " << arg.alignment.remainder << " ";
+            p.print_exprs({arg.def, arg.min, arg.max});
+            s << ", ";
+        }
+        s << ") {\n";
+        p.print(f.body);
+        s << "}\n";
+    }
+    print_params_and_buffers(p, s, m.target().has_feature(Target::JIT));
+
+    return hash_to_hex(s.str());
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,51 @@
+#ifndef HALIDE_FINGERPRINT_H
+#define HALIDE_FINGERPRINT_H
+
+/** \file
+ * Defines structural hashes of pipelines and lowered modules, for
+ * keying caches of compiled code.
+ */
+
+#include <string>
+#include <vector>
+
+namespace Halide {
+
+class Module;
+struct Target;
+
+namespace Internal {
+
+class Function;
+
+/** Compute a fingerprint of the pipeline that computes the given
+ * outputs for the given target. It covers the definitions and
+ * schedules of the outputs and all the Functions they depend on,
+ * their extern stages, and the metadata of the Parameters and
+ * Buffers they refer to. Pipelines built by different code paths get
+ * the same fingerprint, in any process, as long as their Funcs and
+ * Vars have the same names. The extra strings are hashed too, for
+ * state that lives outside the Functions. The builds of Halide, of
+ * LLVM and of the runtime for the target are included, so that the
+ * fingerprint can key caches shared by different builds of Halide.
+ * Returns a hex string. */
+std::string fingerprint(const std::vector<Function> &outputs, const Target &target,
+                        const std::vector<std::string> &extra = std::vector<std::string>());
+
+/** Compute a fingerprint of what a Function computes: the definitions
+ * of it and of all the Functions it depends on, but not their
+ * schedules. Functions are identified by their origin names, so copies
+ * of a Function get the same fingerprint. It doesn't cover the values
+ * of the Parameters or the contents of the Buffers they refer to.
+ * Returns a hex string. */
+std::string definition_fingerprint(const Function &f);
+
+/** Compute a fingerprint of a lowered module, including the builds of
+ * Halide, of LLVM and of the runtime for its target. Returns a hex
+ * string. */
+std::string fingerprint(const Module &m);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -2478,6 +2478,28 @@ Func &Func::add_trace_tag(const std::string &trace_tag) {
     return *this;
 }
 
+Func &Func::trace_region(Var var, Expr min, Expr extent) {
+    user_assert(min.defined() && extent.defined()) << "The region traced for a Func can't be undefined\n";
+    user_assert(Int(32).can_represent(min.type()) && Int(32).can_represent(extent.type()))
+        << "Can't represent the region traced in int32\n";
+    invalidate_cache();
+    bool found = func.is_pure_arg(var.name());
+    user_assert(found)
+        << "Can't restrict tracing of " << name()
+        << " to a range of " << var.name()
+        << " because " << var.name()
+        << " is not one of the pure variables of " << name() << ".\n";
+    func.trace_region(var.name(), cast<int32_t>(min), cast<int32_t>(extent));
+    return *this;
+}
+
+Func &Func::trace_sample(int n) {
+    user_assert(n >= 1) << "Func " << name() << " can't be traced at a sample rate of one in " << n << "\n";
+    invalidate_cache();
+    func.trace_sample(n);
+    return *this;
+}
+
 void Func::debug_to_file(const string &filename) {
     invalidate_cache();
     func.debug_file() = filename;
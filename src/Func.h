@@ -2260,6 +2260,19 @@ public:
      */
     Func &add_trace_tag(const std::string &trace_tag);
 
+    /** Only trace the loads from and stores to this Func at which the
+     * coordinate for the given pure Var is within [min, min + extent).
+     * May be called for several Vars to trace a box. Useful for looking
+     * at the access patterns of a pipeline run on full-size inputs. */
+    Func &trace_region(Var var, Expr min, Expr extent);
+
+    /** Only trace the loads from and stores to this Func at a
+     * pseudorandom one in every n sites. Which sites are chosen
+     * depends only on the coordinates, so it's the same for loads and
+     * stores, and from run to run. In vectorized loops, a vector is
+     * traced if any of its lanes is chosen. */
+    Func &trace_sample(int n);
+
     /** Get a handle on the internal halide function that this Func
      * represents. Useful if you want to do introspection on Halide
      * functions */
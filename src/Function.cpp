@@ -89,6 +89,10 @@ struct FunctionContents {
 
     bool trace_loads = false, trace_stores = false, trace_realizations = false;
     std::vector<string> trace_tags;
+    // Restrict load and store tracing to a box, and/or to a sample of
+    // one in every trace_sample sites.
+    std::vector<Bound> trace_region;
+    int trace_sample = 1;
 
     bool frozen = false;
 
@@ -117,6 +121,11 @@ struct FunctionContents {
             }
         }
 
+        for (const Bound &b : trace_region) {
+            b.min.accept(visitor);
+            b.extent.accept(visitor);
+        }
+
         for (Parameter i : output_buffers) {
             for (size_t j = 0; j < args.size(); j++) {
                 if (i.min_constraint(j).defined()) {
@@ -151,6 +160,11 @@ struct FunctionContents {
             }
             extern_proxy_expr = mutator->mutate(extern_proxy_expr);
         }
+
+        for (Bound &b : trace_region) {
+            b.min = mutator->mutate(b.min);
+            b.extent = mutator->mutate(b.extent);
+        }
     }
 };
 
@@ -342,6 +356,8 @@ void Function::deep_copy(FunctionPtr copy, DeepCopyMap &copied_map) const {
     copy->trace_stores = contents->trace_stores;
     copy->trace_realizations = contents->trace_realizations;
     copy->trace_tags = contents->trace_tags;
+    copy->trace_region = contents->trace_region;
+    copy->trace_sample = contents->trace_sample;
     copy->frozen = contents->frozen;
     copy->output_buffers = contents->output_buffers;
     copy->func_schedule = contents->func_schedule.deep_copy(copied_map);
@@ -890,6 +906,13 @@ void Function::trace_realizations() {
 void Function::add_trace_tag(const std::string &trace_tag) {
     contents->trace_tags.push_back(trace_tag);
 }
+void Function::trace_region(const std::string &var, Expr min, Expr extent) {
+    Bound b = {var, min, extent, Expr(), Expr()};
+    contents->trace_region.push_back(b);
+}
+void Function::trace_sample(int one_in_n) {
+    contents->trace_sample = one_in_n;
+}
 
 bool Function::is_tracing_loads() const {
     return contents->trace_loads;
@@ -903,6 +926,12 @@ bool Function::is_tracing_realizations() const {
 const std::vector<std::string> &Function::get_trace_tags() const {
     return contents->trace_tags;
 }
+const std::vector<Bound> &Function::get_trace_region() const {
+    return contents->trace_region;
+}
+int Function::get_trace_sample() const {
+    return contents->trace_sample;
+}
 
 void Function::freeze() {
     contents->frozen = true;
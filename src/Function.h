@@ -279,10 +279,14 @@ public:
     void trace_stores();
     void trace_realizations();
     void add_trace_tag(const std::string &trace_tag);
+    void trace_region(const std::string &var, Expr min, Expr extent);
+    void trace_sample(int one_in_n);
     bool is_tracing_loads() const;
     bool is_tracing_stores() const;
     bool is_tracing_realizations() const;
     const std::vector<std::string> &get_trace_tags() const;
+    const std::vector<Bound> &get_trace_region() const;
+    int get_trace_sample() const;
     // @}
 
     /** Replace this Function's LoopLevels with locked copies that
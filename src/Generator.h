@@ -1566,6 +1566,7 @@ public:
     HALIDE_FORWARD_METHOD_CONST(ImageParam, channels)
     HALIDE_FORWARD_METHOD_CONST(ImageParam, trace_loads)
     HALIDE_FORWARD_METHOD_CONST(ImageParam, add_trace_tag)
+    HALIDE_FORWARD_METHOD_CONST(ImageParam, trace_sample)
     // }@
 };
 
@@ -1932,6 +1933,8 @@ public:
     HALIDE_FORWARD_METHOD(Func, store_at)
     HALIDE_FORWARD_METHOD(Func, store_root)
     HALIDE_FORWARD_METHOD(Func, tile)
+    HALIDE_FORWARD_METHOD(Func, trace_region)
+    HALIDE_FORWARD_METHOD(Func, trace_sample)
     HALIDE_FORWARD_METHOD(Func, trace_stores)
     HALIDE_FORWARD_METHOD(Func, unroll)
     HALIDE_FORWARD_METHOD(Func, update)
@@ -93,4 +93,11 @@ ImageParam &ImageParam::add_trace_tag(const std::string &trace_tag) {
     return *this;
 }
 
+ImageParam &ImageParam::trace_sample(int n) {
+    user_assert(n >= 1) << "ImageParam " << name() << " can't be traced at a sample rate of one in " << n << "\n";
+    internal_assert(func.defined());
+    func.trace_sample(n);
+    return *this;
+}
+
 }  // namespace Halide
@@ -134,6 +134,10 @@ public:
 
     /** Add a trace tag to this ImageParam's Func. */
     ImageParam &add_trace_tag(const std::string &trace_tag);
+
+    /** Only trace a pseudorandom one in every n of the loads from this
+     * ImageParam. See Func::trace_sample. */
+    ImageParam &trace_sample(int n);
 };
 
 }  // namespace Halide
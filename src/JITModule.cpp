@@ -14,6 +14,7 @@
 #include "Debug.h"
 #include "LLVM_Output.h"
 #include "CodeGen_LLVM.h"
+#include "Fingerprint.h"
 #include "Pipeline.h"
 
 
@@ -118,6 +119,110 @@ void load_metal() {
 
 using namespace llvm;
 
+namespace {
+
+// An on-disk cache of the object code of jitted pipelines, enabled by
+// setting HL_JIT_CACHE_DIR to a directory. An entry is a pair of files
+// named by the fingerprint of the pipeline or of the lowered Module:
+// the object file, and a bitcode file
+// that declares the functions it exports, which stands in for the
+// llvm module when the object is loaded. The key covers the builds of
+// Halide and LLVM and the runtime Halide links in, so entries written
+// by other builds of Halide aren't used.
+class JITObjectCache : public llvm::ObjectCache {
+    string path;
+    std::unique_ptr<llvm::MemoryBuffer> object;
+    std::unique_ptr<llvm::Module> declarations;
+    bool object_saved;
+
+    // Write a file so that readers in other processes see either
+    // the whole thing or nothing.
+    void write_file(const string &name, llvm::StringRef data) {
+        int fd;
+        llvm::SmallString<128> tmp_name;
+        if (llvm::sys::fs::createUniqueFile(name + ".%%%%%%.tmp", fd, tmp_name)) {
+            debug(1) << "Could not write to the JIT cache: " << name << "\n";
+            return;
+        }
+        {
+            llvm::raw_fd_ostream out(fd, true);
+            out << data;
+        }
+        if (llvm::sys::fs::rename(tmp_name, name)) {
+            llvm::sys::fs::remove(tmp_name);
+        }
+    }
+
+public:
+    JITObjectCache(const string &path) : path(path), object_saved(false) {}
+
+    // Look for an entry. On a hit, returns the module of declarations
+    // to give to the execution engine in place of the real one.
+    std::unique_ptr<llvm::Module> lookup(llvm::LLVMContext &context) {
+        auto object_or_error = llvm::MemoryBuffer::getFile(path + ".o");
+        auto bitcode_or_error = llvm::MemoryBuffer::getFile(path + ".bc");
+        if (!object_or_error || !bitcode_or_error) {
+            debug(2) << "JIT cache miss: " << path << "\n";
+            return nullptr;
+        }
+        auto module = llvm::parseBitcodeFile(bitcode_or_error.get()->getMemBufferRef(), context);
+        if (!module) {
+            llvm::consumeError(module.takeError());
+            return nullptr;
+        }
+        debug(1) << "JIT cache hit: " << path << "\n";
+        object = std::move(object_or_error.get());
+        return std::move(module.get());
+    }
+
+    bool hit() const {
+        return object != nullptr;
+    }
+
+    // Remember the declarations of the named functions of a module
+    // we're about to compile, to save alongside its object.
+    void set_declarations(const llvm::Module &m, const std::vector<string> &names) {
+        declarations.reset(new llvm::Module(m.getModuleIdentifier(), m.getContext()));
+        clone_target_options(m, *declarations);
+        declarations->setDataLayout(m.getDataLayout());
+        for (const string &name : names) {
+            llvm::Function *f = m.getFunction(name);
+            if (f) {
+                llvm::Function::Create(f->getFunctionType(), llvm::GlobalValue::ExternalLinkage,
+                                       name, declarations.get());
+            }
+        }
+    }
+
+    void save_declarations() {
+        if (object_saved && declarations) {
+            llvm::SmallVector<char, 256> buffer;
+            llvm::raw_svector_ostream out(buffer);
+#if LLVM_VERSION >= 70
+            WriteBitcodeToFile(*declarations, out);
+#else
+            WriteBitcodeToFile(declarations.get(), out);
+#endif
+            write_file(path + ".bc", llvm::StringRef(buffer.data(), buffer.size()));
+        }
+        declarations.reset();
+    }
+
+    void notifyObjectCompiled(const llvm::Module *, llvm::MemoryBufferRef obj) override {
+        write_file(path + ".o", obj.getBuffer());
+        object_saved = true;
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *) override {
+        if (!object) {
+            return nullptr;
+        }
+        return llvm::MemoryBuffer::getMemBufferCopy(object->getBuffer(), object->getBufferIdentifier());
+    }
+};
+
+}  // namespace
+
 class JITModuleContents {
 public:
     mutable RefCount ref_count;
@@ -136,6 +241,8 @@ public:
     std::map<std::string, JITModule::Symbol> exports;
     llvm::LLVMContext context;
     ExecutionEngine *execution_engine;
+    // Set when the module is compiled through the object cache
+    std::unique_ptr<JITObjectCache> object_cache;
     std::vector<JITModule> dependencies;
     JITModule::Symbol entrypoint;
     JITModule::Symbol argv_entrypoint;
@@ -240,15 +347,45 @@ JITModule::JITModule() {
 }
 
 JITModule::JITModule(const Module &m, const LoweredFunc &fn,
-                     const std::vector<JITModule> &dependencies) {
+                     const std::vector<JITModule> &dependencies,
+                     const std::string &cache_key) {
     jit_module = new JITModuleContents();
-    std::unique_ptr<llvm::Module> llvm_module(compile_module_to_llvm_module(m, jit_module->context));
+    std::unique_ptr<llvm::Module> llvm_module;
+    string cache_dir = get_env_variable("HL_JIT_CACHE_DIR");
+    if (!cache_dir.empty()) {
+        string key = cache_key.empty() ? fingerprint(m) : cache_key;
+        jit_module->object_cache.reset(new JITObjectCache(cache_dir + "/" + key));
+        llvm_module = jit_module->object_cache->lookup(jit_module->context);
+    }
+    if (!llvm_module) {
+        llvm_module = compile_module_to_llvm_module(m, jit_module->context);
+    }
     std::vector<JITModule> deps_with_runtime = dependencies;
     std::vector<JITModule> shared_runtime = JITSharedRuntime::get(llvm_module.get(), m.target());
     deps_with_runtime.insert(deps_with_runtime.end(), shared_runtime.begin(), shared_runtime.end());
     compile_module(std::move(llvm_module), fn.name, m.target(), deps_with_runtime);
 }
 
+JITModule JITModule::from_object_cache(const std::string &cache_key, const std::string &function_name,
+                                       const Target &target, const std::vector<JITModule> &dependencies) {
+    JITModule result;
+    string cache_dir = get_env_variable("HL_JIT_CACHE_DIR");
+    if (cache_dir.empty()) {
+        return result;
+    }
+    std::unique_ptr<JITObjectCache> object_cache(new JITObjectCache(cache_dir + "/" + cache_key));
+    std::unique_ptr<llvm::Module> llvm_module = object_cache->lookup(result.jit_module->context);
+    if (!llvm_module) {
+        return result;
+    }
+    result.jit_module->object_cache = std::move(object_cache);
+    std::vector<JITModule> deps_with_runtime = dependencies;
+    std::vector<JITModule> shared_runtime = JITSharedRuntime::get(llvm_module.get(), target);
+    deps_with_runtime.insert(deps_with_runtime.end(), shared_runtime.begin(), shared_runtime.end());
+    result.compile_module(std::move(llvm_module), function_name, target, deps_with_runtime);
+    return result;
+}
+
 void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &function_name, const Target &target,
                                const std::vector<JITModule> &dependencies,
                                const std::vector<std::string> &requested_exports) {
@@ -269,6 +406,16 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     DataLayout initial_module_data_layout = m->getDataLayout();
     string module_name = m->getModuleIdentifier();
 
+    JITObjectCache *object_cache = jit_module->object_cache.get();
+    if (object_cache && !object_cache->hit()) {
+        std::vector<string> names = requested_exports;
+        if (!function_name.empty()) {
+            names.push_back(function_name);
+            names.push_back(function_name + "_argv");
+        }
+        object_cache->set_declarations(*m, names);
+    }
+
     llvm::EngineBuilder engine_builder((std::move(m)));
     engine_builder.setTargetOptions(options);
     engine_builder.setErrorStr(&error_string);
@@ -276,7 +423,7 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     HalideJITMemoryManager *memory_manager = new HalideJITMemoryManager(dependencies);
     engine_builder.setMCJITMemoryManager(std::unique_ptr<RTDyldMemoryManager>(memory_manager));
 
-    engine_builder.setOptLevel(CodeGenOpt::Aggressive);
+    engine_builder.setOptLevel(target.has_feature(Target::FastCompile) ? CodeGenOpt::None : CodeGenOpt::Aggressive);
     if (!mcpu.empty()) {
         engine_builder.setMCPU(mcpu);
     }
@@ -310,6 +457,14 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
         ee->RegisterJITEventListener(listeners[i]);
     }
 
+    if (object_cache) {
+        ee->setObjectCache(object_cache);
+        // A cached object is only loaded when the whole module is
+        // compiled, as the functions in the stand-in module are just
+        // declarations.
+        ee->finalizeObject();
+    }
+
     // Retrieve function pointers from the compiled module (which also
     // triggers compilation)
     debug(1) << "JIT compiling " << module_name << "\n";
@@ -333,6 +488,10 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     ee->finalizeObject();
     memory_manager->work_around_llvm_bugs();
 
+    if (object_cache) {
+        object_cache->save_declarations();
+    }
+
     // Do any target-specific post-compilation module meddling
     for (size_t i = 0; i < listeners.size(); i++) {
         ee->UnregisterJITEventListener(listeners[i]);
@@ -640,6 +799,9 @@ JITModule &make_module(llvm::Module *for_module, Target target,
         // Ensure that JIT feature is set on target as it must be in
         // order for the right runtime components to be added.
         target.set_feature(Target::JIT);
+        // The runtime is shared by every pipeline compiled later, so
+        // it's always optimized.
+        target.set_feature(Target::FastCompile, false);
 
         Target one_gpu(target);
         one_gpu.set_feature(Target::OpenCL, false);
@@ -874,5 +1036,16 @@ void JITSharedRuntime::memoization_cache_set_size(int64_t size) {
     }
 }
 
+void *JITSharedRuntime::get_runtime_function(const std::string &name) {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    const JITModule &runtime = shared_runtimes(MainShared);
+    std::map<std::string, JITModule::Symbol>::const_iterator f = runtime.exports().find(name);
+    if (f == runtime.exports().end()) {
+        return nullptr;
+    }
+    return f->second.address;
+}
+
 }  // namespace Internal
 }  // namespace Halide
@@ -41,8 +41,22 @@ struct JITModule {
     };
 
     JITModule();
+    /** Compile a lowered function of a Module. If the object cache is
+     * enabled (see Pipeline::compile_jit), the object code is looked
+     * up and stored under the cache key, or under the fingerprint of
+     * the Module if the key is empty. */
     JITModule(const Module &m, const LoweredFunc &fn,
-                     const std::vector<JITModule> &dependencies = std::vector<JITModule>());
+              const std::vector<JITModule> &dependencies = std::vector<JITModule>(),
+              const std::string &cache_key = "");
+
+    /** Load the function with the given name from the object code
+     * stored under the cache key, without lowering or compiling
+     * anything. Returns a JITModule that has not been compiled if the
+     * object cache is disabled or has no such entry. */
+    static JITModule from_object_cache(const std::string &cache_key, const std::string &function_name,
+                                       const Target &target,
+                                       const std::vector<JITModule> &dependencies = std::vector<JITModule>());
+
     /** The exports map of a JITModule contains all symbols which are
      * available to other JITModules which depend on this one. For
      * runtime modules, this is all of the symbols exported from the
@@ -153,6 +167,13 @@ public:
      */
     static void memoization_cache_set_size(int64_t size);
 
+    /** Get the address of a function exported by the shared runtime,
+     * e.g. halide_memoization_cache_get_stats, so that JIT users can
+     * call the runtime entry points that have no wrapper here. Returns
+     * nullptr if nothing has been JIT compiled yet, or if the runtime
+     * has no such function. */
+    static void *get_runtime_function(const std::string &name);
+
     static void release_all();
 };
 
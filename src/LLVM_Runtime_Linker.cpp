@@ -73,6 +73,7 @@ DECLARE_CPP_INITMOD(android_host_cpu_count)
 DECLARE_CPP_INITMOD(android_io)
 DECLARE_CPP_INITMOD(android_opengl_context)
 DECLARE_CPP_INITMOD(android_tempfile)
+DECLARE_CPP_INITMOD(arena)
 DECLARE_CPP_INITMOD(buffer_t)
 DECLARE_CPP_INITMOD(cache)
 DECLARE_CPP_INITMOD(can_use_target)
@@ -87,6 +88,8 @@ DECLARE_NO_INITMOD(d3d12compute)
 DECLARE_CPP_INITMOD(destructors)
 DECLARE_CPP_INITMOD(device_interface)
 DECLARE_CPP_INITMOD(errors)
+DECLARE_CPP_INITMOD(fake_numa)
+DECLARE_CPP_INITMOD(fake_perf_counters)
 DECLARE_CPP_INITMOD(fake_thread_pool)
 DECLARE_CPP_INITMOD(float16_t)
 DECLARE_CPP_INITMOD(gpu_device_selection)
@@ -94,7 +97,9 @@ DECLARE_CPP_INITMOD(hexagon_host)
 DECLARE_CPP_INITMOD(ios_io)
 DECLARE_CPP_INITMOD(linux_clock)
 DECLARE_CPP_INITMOD(linux_host_cpu_count)
+DECLARE_CPP_INITMOD(linux_numa)
 DECLARE_CPP_INITMOD(linux_opengl_context)
+DECLARE_CPP_INITMOD(linux_perf_counters)
 DECLARE_CPP_INITMOD(linux_yield)
 DECLARE_CPP_INITMOD(matlab)
 DECLARE_CPP_INITMOD(metadata)
@@ -112,6 +117,7 @@ DECLARE_CPP_INITMOD(osx_get_symbol)
 DECLARE_CPP_INITMOD(osx_host_cpu_count)
 DECLARE_CPP_INITMOD(osx_opengl_context)
 DECLARE_CPP_INITMOD(osx_yield)
+DECLARE_CPP_INITMOD(pool_allocator)
 DECLARE_CPP_INITMOD(posix_allocator)
 DECLARE_CPP_INITMOD(posix_clock)
 DECLARE_CPP_INITMOD(posix_error_handler)
@@ -638,17 +644,25 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
             // OS-dependent modules
             if (t.os == Target::Linux) {
                 modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                modules.push_back(get_initmod_pool_allocator(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_print(c, bits_64, debug));
                 if (t.arch == Target::X86) {
                     modules.push_back(get_initmod_linux_clock(c, bits_64, debug));
+                    modules.push_back(get_initmod_linux_perf_counters(c, bits_64, debug));
                 } else {
                     modules.push_back(get_initmod_posix_clock(c, bits_64, debug));
+                    modules.push_back(get_initmod_fake_perf_counters(c, bits_64, debug));
                 }
                 modules.push_back(get_initmod_posix_io(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_tempfile(c, bits_64, debug));
                 modules.push_back(get_initmod_linux_host_cpu_count(c, bits_64, debug));
                 modules.push_back(get_initmod_linux_yield(c, bits_64, debug));
+                if (t.arch == Target::X86 || t.arch == Target::ARM) {
+                    modules.push_back(get_initmod_linux_numa(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_fake_numa(c, bits_64, debug));
+                }
                 if (tsan) {
                     modules.push_back(get_initmod_posix_threads_tsan(c, bits_64, debug));
                 } else {
@@ -657,6 +671,7 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 modules.push_back(get_initmod_posix_get_symbol(c, bits_64, debug));
             } else if (t.os == Target::OSX) {
                 modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                modules.push_back(get_initmod_pool_allocator(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_print(c, bits_64, debug));
                 modules.push_back(get_initmod_osx_clock(c, bits_64, debug));
@@ -664,6 +679,8 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 modules.push_back(get_initmod_posix_tempfile(c, bits_64, debug));
                 modules.push_back(get_initmod_osx_host_cpu_count(c, bits_64, debug));
                 modules.push_back(get_initmod_osx_yield(c, bits_64, debug));
+                modules.push_back(get_initmod_fake_numa(c, bits_64, debug));
+                modules.push_back(get_initmod_fake_perf_counters(c, bits_64, debug));
                 if (tsan) {
                     modules.push_back(get_initmod_posix_threads_tsan(c, bits_64, debug));
                 } else {
@@ -672,6 +689,7 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 modules.push_back(get_initmod_osx_get_symbol(c, bits_64, debug));
             } else if (t.os == Target::Android) {
                 modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                modules.push_back(get_initmod_pool_allocator(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_print(c, bits_64, debug));
                 if (t.arch == Target::ARM) {
@@ -683,6 +701,12 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 modules.push_back(get_initmod_android_tempfile(c, bits_64, debug));
                 modules.push_back(get_initmod_android_host_cpu_count(c, bits_64, debug));
                 modules.push_back(get_initmod_linux_yield(c, bits_64, debug)); // TODO: verify
+                if (t.arch == Target::X86 || t.arch == Target::ARM) {
+                    modules.push_back(get_initmod_linux_numa(c, bits_64, debug));
+                } else {
+                    modules.push_back(get_initmod_fake_numa(c, bits_64, debug));
+                }
+                modules.push_back(get_initmod_fake_perf_counters(c, bits_64, debug));
                 if (tsan) {
                     modules.push_back(get_initmod_posix_threads_tsan(c, bits_64, debug));
                 } else {
@@ -691,12 +715,15 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 modules.push_back(get_initmod_posix_get_symbol(c, bits_64, debug));
             } else if (t.os == Target::Windows) {
                 modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                modules.push_back(get_initmod_pool_allocator(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_print(c, bits_64, debug));
                 modules.push_back(get_initmod_windows_clock(c, bits_64, debug));
                 modules.push_back(get_initmod_windows_io(c, bits_64, debug));
                 modules.push_back(get_initmod_windows_tempfile(c, bits_64, debug));
                 modules.push_back(get_initmod_windows_yield(c, bits_64, debug));
+                modules.push_back(get_initmod_fake_numa(c, bits_64, debug));
+                modules.push_back(get_initmod_fake_perf_counters(c, bits_64, debug));
                 if (tsan) {
                     modules.push_back(get_initmod_windows_threads_tsan(c, bits_64, debug));
                 } else {
@@ -708,6 +735,7 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 }
             } else if (t.os == Target::IOS) {
                 modules.push_back(get_initmod_posix_allocator(c, bits_64, debug));
+                modules.push_back(get_initmod_pool_allocator(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_error_handler(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_print(c, bits_64, debug));
                 modules.push_back(get_initmod_posix_clock(c, bits_64, debug));
@@ -715,6 +743,8 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                 modules.push_back(get_initmod_posix_tempfile(c, bits_64, debug));
                 modules.push_back(get_initmod_osx_host_cpu_count(c, bits_64, debug));
                 modules.push_back(get_initmod_osx_yield(c, bits_64, debug));
+                modules.push_back(get_initmod_fake_numa(c, bits_64, debug));
+                modules.push_back(get_initmod_fake_perf_counters(c, bits_64, debug));
                 if (tsan) {
                     modules.push_back(get_initmod_posix_threads_tsan(c, bits_64, debug));
                 } else {
@@ -723,6 +753,8 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
             } else if (t.os == Target::QuRT) {
                 modules.push_back(get_initmod_qurt_allocator(c, bits_64, debug));
                 modules.push_back(get_initmod_qurt_yield(c, bits_64, debug));
+                modules.push_back(get_initmod_fake_numa(c, bits_64, debug));
+                modules.push_back(get_initmod_fake_perf_counters(c, bits_64, debug));
                 if (tsan) {
                     modules.push_back(get_initmod_qurt_threads_tsan(c, bits_64, debug));
                 } else {
@@ -739,6 +771,8 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
                     modules.push_back(get_initmod_qurt_allocator(c, bits_64, debug));
                 }
                 modules.push_back(get_initmod_fake_thread_pool(c, bits_64, debug));
+                modules.push_back(get_initmod_fake_numa(c, bits_64, debug));
+                modules.push_back(get_initmod_fake_perf_counters(c, bits_64, debug));
             }
         }
 
@@ -763,6 +797,7 @@ std::unique_ptr<llvm::Module> get_initial_module_for_target(Target t, llvm::LLVM
         if (module_type != ModuleJITInlined && module_type != ModuleAOTNoRuntime) {
             // These modules are always used and shared
             modules.push_back(get_initmod_gpu_device_selection(c, bits_64, debug));
+            modules.push_back(get_initmod_arena(c, bits_64, debug));
             if (t.arch != Target::Hexagon) {
                 // These modules don't behave correctly on a real
                 // Hexagon device (they do work in the simulator
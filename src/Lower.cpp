@@ -8,6 +8,7 @@
 #include "AddImageChecks.h"
 #include "AddParameterChecks.h"
 #include "AllocationBoundsInference.h"
+#include "ArenaAllocations.h"
 #include "BoundSmallAllocations.h"
 #include "Bounds.h"
 #include "BoundsInference.h"
@@ -35,6 +36,7 @@
 #include "LoopCarry.h"
 #include "LowerWarpShuffles.h"
 #include "Memoization.h"
+#include "PackAllocations.h"
 #include "PartitionLoops.h"
 #include "Prefetch.h"
 #include "Profiling.h"
@@ -305,6 +307,18 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     s = bound_small_allocations(s);
     debug(2) << "Lowering after bounding small allocations:\n" << s << "\n\n";
 
+    if (t.has_feature(Target::PackAllocs)) {
+        debug(1) << "Packing allocations with disjoint lifetimes...\n";
+        s = pack_allocations(s);
+        debug(2) << "Lowering after packing allocations:\n" << s << "\n\n";
+    }
+
+    if (t.has_feature(Target::ArenaAlloc)) {
+        debug(1) << "Carving allocations out of a per-call arena...\n";
+        s = carve_arena_allocations(s);
+        debug(2) << "Lowering after carving allocations out of an arena:\n" << s << "\n\n";
+    }
+
     if (t.has_feature(Target::CUDA)) {
         debug(1) << "Injecting warp shuffles...\n";
         s = lower_warp_shuffles(s);
@@ -1,5 +1,6 @@
 #include "Memoization.h"
 #include "Error.h"
+#include "Fingerprint.h"
 #include "IRMutator.h"
 #include "IROperator.h"
 #include "Param.h"
@@ -149,6 +150,10 @@ class KeyInfo {
     const std::string &top_level_name;
     const std::string &function_name;
     int memoize_instance;
+    // The first 64 bits of a hash of what the function computes, so
+    // that results computed by an earlier definition of a Func with the
+    // same name (e.g. read back from the disk tier) aren't used.
+    uint32_t definition_hash[2];
 
     size_t parameters_alignment() {
         int32_t max_alignment = 0;
@@ -188,8 +193,13 @@ public:
           memoize_instance(memoize_instance)
     {
         dependencies.visit_function(function);
+        std::string hash = definition_fingerprint(function);
+        for (int i = 0; i < 2; i++) {
+            definition_hash[i] = (uint32_t)std::stoul(hash.substr(8 * i, 8), nullptr, 16);
+        }
         size_t size_so_far = 4;
         size_so_far += (function_name.size() + 3) & (~3);
+        size_so_far += sizeof(definition_hash);
 
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
@@ -213,10 +223,11 @@ public:
         std::vector<Stmt> writes;
         Expr index = Expr(0);
 
-        // Make a jumble of bytes including the function name and the
-        // values of the scalar parameters. Omits the pipeline name
-        // and the unique counter so that we can reuse memoized Funcs
-        // across forward and backwards pipelines.
+        // Make a jumble of bytes including the function name, a hash of
+        // its definition, and the values of the scalar parameters. The
+        // name comes first, for the cache's per-Func statistics. Omits
+        // the pipeline name and the unique counter so that we can reuse
+        // memoized Funcs across forward and backwards pipelines.
 
         (void)top_level_name;
         (void)memoize_instance;
@@ -231,6 +242,8 @@ public:
                 key.back() += function_name[i];
             }
         }
+        key.push_back(definition_hash[0]);
+        key.push_back(definition_hash[1]);
 
         size_t alignment = 0;
         for (int k : key) {
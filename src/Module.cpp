@@ -1,7 +1,9 @@
 #include "Module.h"
 
 #include <array>
+#include <exception>
 #include <fstream>
+#include <functional>
 #include <future>
 
 #include "CodeGen_C.h"
@@ -10,12 +12,14 @@
 #include "Debug.h"
 #include "HexagonOffload.h"
 #include "IROperator.h"
+#include "IRVisitor.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Output.h"
 #include "LLVM_Runtime_Linker.h"
 #include "Outputs.h"
 #include "PythonExtensionGen.h"
 #include "StmtToHtml.h"
+#include "ThreadPool.h"
 #include "WrapExternStages.h"
 
 using Halide::Internal::debug;
@@ -109,6 +113,205 @@ Outputs add_suffixes(const Outputs &in, const std::string &suffix) {
     return out;
 }
 
+// Run some compilation jobs, several at a time. Each job must make its
+// own LLVMContext. If any of them fail, the first error is rethrown
+// once they have all finished.
+void run_compile_jobs(const std::vector<std::function<void()>> &jobs) {
+    size_t num_threads = std::min(jobs.size(), ThreadPool<void>::num_processors_online());
+    if (num_threads <= 1) {
+        for (const auto &job : jobs) {
+            job();
+        }
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(jobs.size());
+    {
+        ThreadPool<void> pool(num_threads);
+        std::vector<std::future<void>> results;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            results.push_back(pool.async([&jobs, &errors, i]() {
+#ifdef WITH_EXCEPTIONS
+                try {
+                    jobs[i]();
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+#else
+                jobs[i]();
+#endif
+            }));
+        }
+        for (auto &r : results) {
+            r.wait();
+        }
+    }
+    for (const auto &e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+// Find the names a lowered function refers to.
+class FindNames : public IRGraphVisitor {
+public:
+    std::set<std::string> names;
+
+    using IRGraphVisitor::visit;
+
+    void visit(const Variable *op) {
+        names.insert(op->name);
+    }
+
+    void visit(const Call *op) {
+        IRGraphVisitor::visit(op);
+        names.insert(op->name);
+    }
+
+    void visit(const Load *op) {
+        IRGraphVisitor::visit(op);
+        names.insert(op->name);
+    }
+
+    void visit(const Store *op) {
+        IRGraphVisitor::visit(op);
+        names.insert(op->name);
+    }
+};
+
+// A set of functions of a module, and the buffers they refer to, that
+// can be compiled separately from the rest of the module.
+struct FunctionGroup {
+    std::vector<size_t> functions, buffers;
+};
+
+// Partition the functions of a module into groups that don't refer to
+// each other, or to the same embedded buffers (which are private to
+// the object they are compiled into).
+std::vector<FunctionGroup> independent_function_groups(const Module &m) {
+    const std::vector<LoweredFunc> &functions = m.functions();
+    const std::vector<Buffer<>> &buffers = m.buffers();
+
+    // A union-find over the functions.
+    std::vector<size_t> parent(functions.size());
+    for (size_t i = 0; i < parent.size(); i++) {
+        parent[i] = i;
+    }
+    std::function<size_t(size_t)> find = [&](size_t i) {
+        return parent[i] == i ? i : (parent[i] = find(parent[i]));
+    };
+
+    std::map<std::string, size_t> function_index;
+    for (size_t i = 0; i < functions.size(); i++) {
+        function_index[functions[i].name] = i;
+    }
+
+    // The first function that refers to each buffer.
+    std::vector<size_t> buffer_user(buffers.size(), functions.size());
+    for (size_t i = 0; i < functions.size(); i++) {
+        FindNames finder;
+        functions[i].body.accept(&finder);
+        for (const std::string &name : finder.names) {
+            auto it = function_index.find(name);
+            if (it != function_index.end()) {
+                parent[find(it->second)] = find(i);
+            }
+        }
+        for (size_t j = 0; j < buffers.size(); j++) {
+            const std::string &buffer_name = buffers[j].name();
+            bool uses_buffer = false;
+            for (const std::string &name : finder.names) {
+                if (name == buffer_name || starts_with(name, buffer_name + ".")) {
+                    uses_buffer = true;
+                    break;
+                }
+            }
+            if (!uses_buffer) {
+                continue;
+            }
+            if (buffer_user[j] == functions.size()) {
+                buffer_user[j] = i;
+            } else {
+                parent[find(buffer_user[j])] = find(i);
+            }
+        }
+    }
+
+    std::vector<FunctionGroup> groups;
+    std::map<size_t, size_t> group_of_root;
+    for (size_t i = 0; i < functions.size(); i++) {
+        size_t root = find(i);
+        auto it = group_of_root.find(root);
+        if (it == group_of_root.end()) {
+            it = group_of_root.emplace(root, groups.size()).first;
+            groups.emplace_back();
+        }
+        groups[it->second].functions.push_back(i);
+    }
+    for (size_t j = 0; j < buffers.size(); j++) {
+        // Buffers nothing refers to go in the first group.
+        size_t g = buffer_user[j] == functions.size() ? 0 : group_of_root[find(buffer_user[j])];
+        if (!groups.empty()) {
+            groups[g].buffers.push_back(j);
+        }
+    }
+    return groups;
+}
+
+// Compile a module to a static library by compiling its independent
+// groups of functions, and the runtime, to separate objects in
+// parallel. Returns false without doing anything if the module can't
+// be split up.
+bool compile_static_library_in_parallel(const Module &m, const std::string &static_library_name) {
+    // External code may define symbols any of the functions use.
+    if (!m.external_code().empty() ||
+        ThreadPool<void>::num_processors_online() <= 1) {
+        return false;
+    }
+    std::vector<FunctionGroup> groups = independent_function_groups(m);
+    if (groups.size() < 2) {
+        return false;
+    }
+
+    TemporaryObjectFileDir temp_dir;
+    std::vector<std::function<void()>> jobs;
+    for (size_t i = 0; i < groups.size(); i++) {
+        Module sub_module(m.name(), m.target().with_feature(Target::NoRuntime));
+        sub_module.set_any_strict_float(m.any_strict_float());
+        for (const auto &it : m.get_metadata_name_map()) {
+            sub_module.remap_metadata_name(it.first, it.second);
+        }
+        for (size_t j : groups[i].buffers) {
+            sub_module.append(m.buffers()[j]);
+        }
+        for (size_t j : groups[i].functions) {
+            sub_module.append(m.functions()[j]);
+        }
+        Outputs sub_out = Outputs().object(
+            temp_dir.add_temp_object_file(static_library_name, "_" + std::to_string(i), m.target()));
+        debug(1) << "Module.compile(): function group " << sub_out.object_name << "\n";
+        jobs.push_back([sub_module, sub_out]() {
+            sub_module.compile(sub_out);
+        });
+    }
+    if (!m.target().has_feature(Target::NoRuntime)) {
+        Outputs runtime_out = Outputs().object(
+            temp_dir.add_temp_object_file(static_library_name, "_runtime", m.target()));
+        debug(1) << "Module.compile(): runtime " << runtime_out.object_name << "\n";
+        Target runtime_target = m.target();
+        jobs.push_back([runtime_out, runtime_target]() {
+            compile_standalone_runtime(runtime_out, runtime_target);
+        });
+    }
+    run_compile_jobs(jobs);
+
+    debug(1) << "Module.compile(): static_library_name " << static_library_name << "\n";
+    Target base_target(m.target().os, m.target().arch, m.target().bits);
+    create_static_library(temp_dir.files(), base_target, static_library_name);
+    return true;
+}
+
 }  // namespace
 
 struct ModuleContents {
@@ -364,6 +567,16 @@ void Module::compile(const Outputs &output_files_arg) const {
         return;
     }
 
+    // If the only output that needs LLVM is a static library, the
+    // independent functions of the module can be compiled separately,
+    // on their own LLVMContexts, and linked together by the archive.
+    if (!output_files.static_library_name.empty() &&
+        output_files.object_name.empty() && output_files.assembly_name.empty() &&
+        output_files.bitcode_name.empty() && output_files.llvm_assembly_name.empty() &&
+        compile_static_library_in_parallel(*this, output_files.static_library_name)) {
+        output_files.static_library_name.clear();
+    }
+
     if (!output_files.object_name.empty() || !output_files.assembly_name.empty() ||
         !output_files.bitcode_name.empty() || !output_files.llvm_assembly_name.empty() ||
         !output_files.static_library_name.empty()) {
@@ -519,7 +732,11 @@ void compile_multitarget(const std::string &fn_name,
     constexpr int kFeaturesWordCount = (Target::FeatureEnd + 63) / (sizeof(uint64_t) * 8);
     uint64_t runtime_features[kFeaturesWordCount] = {(uint64_t)-1LL};
 
+    // The sub-targets, the runtime and the wrapper are compiled in
+    // parallel once they have all been produced. Generators aren't
+    // necessarily thread-safe, so the modules are produced serially.
     TemporaryObjectFileDir temp_dir;
+    std::vector<std::function<void()>> jobs;
     std::vector<Expr> wrapper_args;
     std::vector<LoweredArgument> base_target_args;
     for (const Target &target : targets) {
@@ -573,7 +790,9 @@ void compile_multitarget(const std::string &fn_name,
         internal_assert(sub_out.object_name.empty());
         sub_out.object_name = temp_dir.add_temp_object_file(output_files.static_library_name, suffix, target);
         debug(1) << "compile_multitarget: compile_sub_target " << sub_out.object_name << "\n";
-        sub_module.compile(sub_out);
+        jobs.push_back([sub_module, sub_out]() {
+            sub_module.compile(sub_out);
+        });
 
         uint64_t cur_target_features[kFeaturesWordCount] = {0};
         for (int i = 0; i < Target::FeatureEnd; ++i) {
@@ -622,7 +841,9 @@ void compile_multitarget(const std::string &fn_name,
         Outputs runtime_out = Outputs().object(
             temp_dir.add_temp_object_file(output_files.static_library_name, "_runtime", runtime_target));
         debug(1) << "compile_multitarget: compile_standalone_runtime " << runtime_out.static_library_name << "\n";
-        compile_standalone_runtime(runtime_out, runtime_target);
+        jobs.push_back([runtime_out, runtime_target]() {
+            compile_standalone_runtime(runtime_out, runtime_target);
+        });
     }
 
     if (needs_wrapper) {
@@ -661,9 +882,13 @@ void compile_multitarget(const std::string &fn_name,
         Outputs wrapper_out = Outputs().object(
             temp_dir.add_temp_object_file(output_files.static_library_name, "_wrapper", base_target, /* in_front*/ true));
         debug(1) << "compile_multitarget: wrapper " << wrapper_out.object_name << "\n";
-        wrapper_module.compile(wrapper_out);
+        jobs.push_back([wrapper_module, wrapper_out]() {
+            wrapper_module.compile(wrapper_out);
+        });
     }
 
+    run_compile_jobs(jobs);
+
     if (!output_files.c_header_name.empty()) {
         Module header_module(fn_name, base_target);
         header_module.append(LoweredFunc(fn_name, base_target_args, {}, LinkageType::ExternalPlusMetadata));
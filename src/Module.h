@@ -124,7 +124,9 @@ public:
     // @}
 
     /** Compile a halide Module to variety of outputs, depending on
-     * the fields set in output_files. */
+     * the fields set in output_files. If a static library is the only
+     * LLVM output requested, functions that don't refer to each other
+     * are compiled to separate objects in parallel. */
     void compile(const Outputs &output_files_arg) const;
 
     /** Compile a halide Module to in-memory object code. Currently
@@ -166,6 +168,10 @@ Outputs compile_standalone_runtime(const Outputs &output_files, Target t);
 
 typedef std::function<Module(const std::string &, const Target &)> ModuleProducer;
 
+/** Compile a static library that dispatches to the best of several
+ * variants of a function, one per target. The module_producer is
+ * called for each target in turn, then the variants are compiled in
+ * parallel. */
 void compile_multitarget(const std::string &fn_name,
                          const Outputs &output_files,
                          const std::vector<Target> &targets,
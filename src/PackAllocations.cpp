@@ -0,0 +1,360 @@
+#include <map>
+#include <set>
+
+#include "PackAllocations.h"
+#include "CodeGen_Internal.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Simplify.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+const int allocation_alignment = 128;
+
+// The interval over which an allocation made outside of all loops is
+// live, in terms of the order in which Allocate and Free nodes are
+// reached.
+struct LiveRange {
+    const Allocate *op;
+    Expr bytes;
+    int start, end;
+    // The other candidate allocations this one is nested inside
+    set<string> enclosing;
+    // The names bound by lets at the Allocate
+    set<string> in_scope;
+};
+
+class FindLiveRanges : public IRVisitor {
+    using IRVisitor::visit;
+
+    int loop_depth = 0;
+    int time = 0;
+    vector<string> enclosing;
+    set<string> in_scope;
+
+    void visit(const For *op) override {
+        loop_depth++;
+        IRVisitor::visit(op);
+        loop_depth--;
+    }
+
+    void visit(const LetStmt *op) override {
+        op->value.accept(this);
+        if (loop_depth == 0) {
+            in_scope.insert(op->name);
+        }
+        op->body.accept(this);
+        in_scope.erase(op->name);
+    }
+
+    void visit(const Allocate *op) override {
+        Expr bytes;
+        if (loop_depth == 0) {
+            bytes = heap_allocation_bytes(op);
+        }
+        if (!bytes.defined()) {
+            IRVisitor::visit(op);
+            return;
+        }
+
+        LiveRange r;
+        r.op = op;
+        r.bytes = bytes;
+        r.start = time++;
+        r.end = -1;
+        r.enclosing.insert(enclosing.begin(), enclosing.end());
+        r.in_scope = in_scope;
+        index[op->name] = ranges.size();
+        ranges.push_back(r);
+
+        enclosing.push_back(op->name);
+        IRVisitor::visit(op);
+        enclosing.pop_back();
+
+        LiveRange &range = ranges[index[op->name]];
+        if (range.end < 0) {
+            range.end = time++;
+        }
+    }
+
+    void visit(const Free *op) override {
+        auto it = index.find(op->name);
+        if (it != index.end() && ranges[it->second].end < 0) {
+            ranges[it->second].end = time++;
+            freed_early.insert(op->name);
+        }
+    }
+
+public:
+    vector<LiveRange> ranges;
+    map<string, size_t> index;
+    set<string> freed_early;
+};
+
+class FindPipelineLets : public IRVisitor {
+    using IRVisitor::visit;
+
+    int loop_depth = 0;
+
+    void bind(const string &name) {
+        if (!lets.bound.insert(name).second) {
+            lets.rebound.insert(name);
+        }
+    }
+
+    void visit(const For *op) override {
+        bind(op->name);
+        loop_depth++;
+        IRVisitor::visit(op);
+        loop_depth--;
+    }
+
+    void visit(const LetStmt *op) override {
+        bind(op->name);
+        if (loop_depth == 0) {
+            lets.values[op->name] = op->value;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Let *op) override {
+        bind(op->name);
+        IRVisitor::visit(op);
+    }
+
+public:
+    PipelineLets lets;
+};
+
+class HoistExpr : public IRMutator2 {
+    using IRMutator2::visit;
+
+    const set<string> &in_scope;
+    const PipelineLets &lets;
+
+    // Names bound by lets inside the expression itself
+    Scope<> inner;
+    // Lets already substituted, so that shared subexpressions stay shared
+    map<string, Expr> hoisted;
+
+    Expr visit(const Variable *op) override {
+        if (inner.contains(op->name)) {
+            return op;
+        }
+        if (lets.rebound.count(op->name)) {
+            // The value kept for it may not be the one in scope here
+            failed = true;
+            return op;
+        }
+        if (in_scope.count(op->name) ||
+            !lets.bound.count(op->name)) {
+            return op;
+        }
+        auto cached = hoisted.find(op->name);
+        if (cached != hoisted.end()) {
+            return cached->second;
+        }
+        auto it = lets.values.find(op->name);
+        if (it == lets.values.end()) {
+            failed = true;
+            return op;
+        }
+        Expr value = mutate(it->second);
+        hoisted[op->name] = value;
+        return value;
+    }
+
+    Expr visit(const Let *op) override {
+        Expr value = mutate(op->value);
+        ScopedBinding<> bind(inner, op->name);
+        Expr body = mutate(op->body);
+        return Let::make(op->name, value, body);
+    }
+
+    Expr visit(const Load *op) override {
+        failed = true;
+        return op;
+    }
+
+    Expr visit(const Call *op) override {
+        if (!op->is_pure()) {
+            failed = true;
+        }
+        return IRMutator2::visit(op);
+    }
+
+public:
+    bool failed = false;
+
+    HoistExpr(const set<string> &s, const PipelineLets &l) : in_scope(s), lets(l) {}
+};
+
+struct Slot {
+    string name;
+    // Indices into the live ranges, in order
+    vector<size_t> members;
+    int end;
+    Expr bytes, condition;
+};
+
+class PackIntoSlots : public IRMutator2 {
+    using IRMutator2::visit;
+
+    // The slot each packed allocation lives in, the slot allocated at
+    // each first member, and the slot freed after each last member.
+    map<string, const Slot *> slot_of, starts_slot, ends_slot;
+
+    Stmt visit(const Allocate *op) override {
+        auto it = slot_of.find(op->name);
+        if (it == slot_of.end()) {
+            return IRMutator2::visit(op);
+        }
+        const Slot *slot = it->second;
+        Expr ptr = Call::make(Handle(), "halide_arena_carve",
+                              {Variable::make(Handle(), slot->name), make_zero(UInt(64))},
+                              Call::Extern);
+        Stmt s = Allocate::make(op->name, op->type, op->memory_type, op->extents, op->condition,
+                                mutate(op->body), ptr, "halide_arena_uncarve");
+        if (starts_slot.count(op->name)) {
+            Expr chunks = cast(Int(32), slot->bytes / allocation_alignment);
+            s = Allocate::make(slot->name, UInt(8), MemoryType::Heap,
+                               {allocation_alignment, chunks},
+                               slot->condition, s);
+        }
+        return s;
+    }
+
+    Stmt visit(const Free *op) override {
+        auto it = ends_slot.find(op->name);
+        if (it != ends_slot.end()) {
+            return Block::make(op, Free::make(it->second->name));
+        }
+        return op;
+    }
+
+public:
+    PackIntoSlots(const vector<Slot> &slots, const FindLiveRanges &live) {
+        for (const Slot &slot : slots) {
+            for (size_t i : slot.members) {
+                slot_of[live.ranges[i].op->name] = &slot;
+            }
+            starts_slot[live.ranges[slot.members.front()].op->name] = &slot;
+            const string &last = live.ranges[slot.members.back()].op->name;
+            if (live.freed_early.count(last)) {
+                ends_slot[last] = &slot;
+            }
+        }
+    }
+};
+
+}  // namespace
+
+PipelineLets find_pipeline_lets(const Stmt &s) {
+    FindPipelineLets finder;
+    s.accept(&finder);
+    return finder.lets;
+}
+
+Expr hoist_expr(const Expr &e, const set<string> &in_scope, const PipelineLets &lets) {
+    HoistExpr hoister(in_scope, lets);
+    Expr result = hoister.mutate(e);
+    if (hoister.failed) {
+        return Expr();
+    }
+    return result;
+}
+
+Expr heap_allocation_bytes(const Allocate *op) {
+    if (op->new_expr.defined() ||
+        op->extents.empty() ||
+        (op->memory_type != MemoryType::Auto &&
+         op->memory_type != MemoryType::Heap)) {
+        return Expr();
+    }
+    int64_t bytes_per_element = op->type.lanes() * op->type.bytes();
+    int32_t constant_size = op->constant_allocation_size();
+    if (constant_size > 0 &&
+        op->memory_type == MemoryType::Auto &&
+        can_allocation_fit_on_stack(constant_size * bytes_per_element)) {
+        return Expr();
+    }
+    Expr bytes = make_const(UInt(64), bytes_per_element);
+    for (const Expr &e : op->extents) {
+        bytes *= cast(UInt(64), cast(UInt(32), e));
+    }
+    // Leave room for the padding codegen adds past the end of heap
+    // allocations, then round up to keep the next buffer aligned.
+    bytes += op->type.bytes() + allocation_alignment;
+    return simplify(bytes / allocation_alignment * allocation_alignment);
+}
+
+Stmt pack_allocations(const Stmt &s) {
+    FindLiveRanges live;
+    s.accept(&live);
+    PipelineLets lets = find_pipeline_lets(s);
+
+    // Greedily put each allocation, in the order they start, into the
+    // first slot that is free by then. The slot is allocated where its
+    // first member was, so later members must be nested inside that,
+    // and their sizes must be known there.
+    vector<Slot> slots;
+    for (size_t i = 0; i < live.ranges.size(); i++) {
+        const LiveRange &r = live.ranges[i];
+        bool packed = false;
+        for (Slot &slot : slots) {
+            const LiveRange &first = live.ranges[slot.members.front()];
+            if (slot.end >= r.start ||
+                !r.enclosing.count(first.op->name)) {
+                continue;
+            }
+            Expr bytes = hoist_expr(r.bytes, first.in_scope, lets);
+            if (!bytes.defined()) {
+                continue;
+            }
+            debug(3) << "Packing " << r.op->name << " into the storage of " << first.op->name << "\n";
+            slot.members.push_back(i);
+            slot.end = r.end;
+            slot.bytes = max(slot.bytes, bytes);
+            Expr condition = hoist_expr(r.op->condition, first.in_scope, lets);
+            if (condition.defined()) {
+                slot.condition = slot.condition || condition;
+            } else {
+                slot.condition = const_true();
+            }
+            packed = true;
+            break;
+        }
+        if (!packed) {
+            Slot slot;
+            slot.name = r.op->name + ".slot";
+            slot.members.push_back(i);
+            slot.end = r.end;
+            slot.bytes = r.bytes;
+            slot.condition = r.op->condition;
+            slots.push_back(slot);
+        }
+    }
+
+    // Slots with only one allocation in them are left as they were.
+    vector<Slot> shared;
+    for (Slot &slot : slots) {
+        if (slot.members.size() > 1) {
+            shared.push_back(slot);
+        }
+    }
+    if (shared.empty()) {
+        return s;
+    }
+    return PackIntoSlots(shared, live).mutate(s);
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,60 @@
+#ifndef HALIDE_PACK_ALLOCATIONS_H
+#define HALIDE_PACK_ALLOCATIONS_H
+
+/** \file
+ * Defines the lowering pass that lets heap allocations with disjoint
+ * lifetimes share storage.
+ */
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** The number of bytes a heap allocation needs, including the padding
+ * codegen adds past the end, rounded up to a multiple of 128 so that
+ * buffers placed back to back stay aligned for the widest native
+ * vectors. Returns an undefined Expr for allocations that will be
+ * placed on the stack, or that already have their own allocator. */
+Expr heap_allocation_bytes(const Allocate *op);
+
+/** The values of the lets made outside of all loops in a pipeline,
+ * every name bound anywhere in it, and the names bound more than
+ * once. */
+struct PipelineLets {
+    std::map<std::string, Expr> values;
+    std::set<std::string> bound, rebound;
+};
+
+PipelineLets find_pipeline_lets(const Stmt &s);
+
+/** Rewrite an expression used somewhere inside a pipeline so that it
+ * can be evaluated at a point where, of the names bound in the
+ * pipeline, only those in in_scope are, by substituting in the values
+ * of the lets it depends on. Returns an undefined Expr if that isn't
+ * possible, if the expression loads from memory or calls impure
+ * functions, or if it depends on a name bound more than once in the
+ * pipeline, since it can't tell which binding is meant. */
+Expr hoist_expr(const Expr &e, const std::set<std::string> &in_scope, const PipelineLets &lets);
+
+/** Find the heap allocations made outside of all loops, compute the
+ * interval from each Allocate to its Free (as injected by
+ * inject_early_frees) or to the end of its scope, and assign them to
+ * slots so that no two allocations in a slot are live at once, like a
+ * register allocator for buffers. Each slot with more than one
+ * allocation in it becomes a single allocation, as large as the largest
+ * of them, made where the first of them was, and the others point into
+ * it. A slot holds its storage from the start of its first member to
+ * the end of its last, so packing can raise the peak memory use of a
+ * pipeline as well as cut the number of allocations; it's only done
+ * for targets with Target::PackAllocs. */
+Stmt pack_allocations(const Stmt &s);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
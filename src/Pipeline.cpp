@@ -1,7 +1,11 @@
 #include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <thread>
 
 #include "Argument.h"
 #include "FindCalls.h"
+#include "Fingerprint.h"
 #include "Func.h"
 #include "IRVisitor.h"
 #include "InferArguments.h"
@@ -57,6 +61,59 @@ struct PipelineContents {
     JITModule jit_module;
     Target jit_target;
 
+    // A jit compilation running in the background, started by
+    // compile_jit_async, the thread running it, the target it's for,
+    // and the Pipeline to realize until it's done. Only the
+    // background thread touches the rest of the cached state while it
+    // runs.
+    std::shared_future<void *> async_jit;
+    std::thread async_jit_thread;
+    Target async_jit_target;
+    Pipeline jit_fallback;
+
+    /** Wait for the thread of the last background jit compilation to
+     * exit. The compilation holds a reference to the pipeline until
+     * then, so this can't be called from it. */
+    void join_async_jit_thread() {
+        if (async_jit_thread.joinable()) {
+            async_jit_thread.join();
+        }
+    }
+
+    /** Wait for a background jit compilation to finish. If it
+     * failed, the error is rethrown here. */
+    void finish_async_jit() {
+        if (async_jit.valid()) {
+            std::shared_future<void *> f = async_jit;
+            async_jit = std::shared_future<void *>();
+            f.wait();
+            join_async_jit_thread();
+            f.get();
+        }
+    }
+
+    /** Check if a background jit compilation is still running. */
+    bool async_jit_running() const {
+        return async_jit.valid() &&
+            async_jit.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+    }
+
+    // Tiered jit compilation (see Pipeline::set_jit_tier_threshold):
+    // the number of realizations after which to compile optimized
+    // code, the number so far, and the same pipeline compiled with
+    // Target::FastCompile to realize until the optimized code is
+    // ready.
+    int jit_tier_threshold;
+    int jit_tier_calls = 0;
+    Pipeline jit_fast_tier;
+
+    /** Drop the quickly compiled code, and start counting
+     * realizations again. */
+    void reset_jit_tiers() {
+        jit_fast_tier = Pipeline();
+        jit_tier_calls = 0;
+    }
+
     /** Clear all cached state */
     void invalidate_cache() {
         module = Module("", Target());
@@ -92,12 +149,23 @@ struct PipelineContents {
 
     PipelineContents() :
         module("", Target()) {
+        jit_tier_threshold = atoi(get_env_variable("HL_JIT_TIER_THRESHOLD").c_str());
         user_context_arg.arg = Argument("__user_context", Argument::InputScalar, type_of<const void*>(), 0);
         user_context_arg.param = Parameter(Handle(), false, 0, "__user_context",
                                            /*is_explicit_name*/ true);
     }
 
     ~PipelineContents() {
+        // A background compilation holds a reference to the pipeline,
+        // so if its thread is still around, it's either done with the
+        // pipeline or is the one dropping the last reference.
+        if (async_jit_thread.joinable()) {
+            if (async_jit_thread.get_id() == std::this_thread::get_id()) {
+                async_jit_thread.detach();
+            } else {
+                async_jit_thread.join();
+            }
+        }
         clear_custom_lowering_passes();
     }
 
@@ -324,6 +392,7 @@ vector<Argument> Pipeline::infer_arguments(Stmt body) {
 }
 
 vector<Argument> Pipeline::infer_arguments() {
+    contents->finish_async_jit();
     return infer_arguments(Stmt());
 }
 
@@ -411,7 +480,56 @@ std::string Pipeline::generate_function_name() const {
 
 void *Pipeline::compile_jit(const Target &target_arg) {
     user_assert(defined()) << "Pipeline is undefined\n";
+    contents->finish_async_jit();
+    return compile_jit_now(target_arg);
+}
+
+std::shared_future<void *> Pipeline::compile_jit_async(const Target &target_arg) {
+    user_assert(defined()) << "Pipeline is undefined\n";
+
+    if (contents->async_jit.valid()) {
+        if (contents->async_jit_target == target_arg) {
+            return contents->async_jit;
+        }
+        contents->finish_async_jit();
+    }
+
+    if (contents->jit_module.compiled() &&
+        contents->jit_target == target_arg.with_feature(Target::JIT).with_feature(Target::UserContext)) {
+        std::promise<void *> done;
+        done.set_value(contents->jit_module.main_function());
+        return done.get_future().share();
+    }
+
+    // The task holds a reference to the pipeline, so it outlives the
+    // compilation even if the caller drops it. The thread is joined
+    // by whatever waits for the compilation next, or when the
+    // pipeline is destroyed.
+    contents->join_async_jit_thread();
+    Pipeline p = *this;
+    std::packaged_task<void *()> task([p, target_arg]() mutable {
+        return p.compile_jit_now(target_arg);
+    });
+    contents->async_jit = task.get_future().share();
+    contents->async_jit_target = target_arg;
+    contents->async_jit_thread = std::thread(std::move(task));
+    return contents->async_jit;
+}
 
+void Pipeline::set_jit_fallback(const Pipeline &fallback) {
+    user_assert(defined()) << "Pipeline is undefined\n";
+    user_assert(!fallback.defined() || fallback.contents.get() != contents.get())
+        << "A Pipeline can't be its own jit fallback\n";
+    contents->jit_fallback = fallback;
+}
+
+void Pipeline::set_jit_tier_threshold(int calls) {
+    user_assert(defined()) << "Pipeline is undefined\n";
+    user_assert(calls >= 0) << "The jit tier threshold can't be negative\n";
+    contents->jit_tier_threshold = calls;
+}
+
+void *Pipeline::compile_jit_now(const Target &target_arg) {
     Target target(target_arg);
     target.set_feature(Target::JIT);
     target.set_feature(Target::UserContext);
@@ -431,7 +549,7 @@ void *Pipeline::compile_jit(const Target &target_arg) {
     contents->jit_target = target;
 
     // Infer an arguments vector
-    infer_arguments();
+    infer_arguments(Stmt());
 
     // Don't actually use the return value - it embeds all constant
     // images and we don't want to do that when jitting. Instead
@@ -445,14 +563,29 @@ void *Pipeline::compile_jit(const Target &target_arg) {
     // Come up with a name for the generated function
     string name = generate_function_name();
 
+    std::map<std::string, JITExtern> lowered_externs = contents->jit_externs;
+    std::vector<JITModule> externs = make_externs_jit_module(target_arg, lowered_externs);
+
+    // If there's an object cache, look for the pipeline in it by its
+    // fingerprint before lowering it. The fingerprint can't see what
+    // custom lowering passes do, so pipelines with any are looked up
+    // by the fingerprint of the lowered module instead.
+    string cache_key;
+    if (!get_env_variable("HL_JIT_CACHE_DIR").empty() && contents->custom_lowering_passes.empty()) {
+        cache_key = fingerprint(target);
+        JITModule cached = JITModule::from_object_cache(cache_key, name, target, externs);
+        if (cached.compiled()) {
+            contents->jit_module = cached;
+            return cached.main_function();
+        }
+    }
+
     // Compile to a module and also compile any submodules.
     Module module = compile_to_module(args, name, target).resolve_submodules();
     auto f = module.get_function_by_name(name);
 
-    std::map<std::string, JITExtern> lowered_externs = contents->jit_externs;
-
     // Compile to jit module
-    JITModule jit_module(module, f, make_externs_jit_module(target_arg, lowered_externs));
+    JITModule jit_module(module, f, externs, cache_key);
 
     // Dump bitcode to a file if the environment variable
     // HL_GENBITCODE is defined to a nonzero value.
@@ -471,6 +604,36 @@ void *Pipeline::compile_jit(const Target &target_arg) {
     return jit_module.main_function();
 }
 
+std::string Pipeline::fingerprint(const Target &target) const {
+    user_assert(defined()) << "Pipeline is undefined\n";
+
+    vector<string> extra;
+    // Custom lowering passes can't be looked into.
+    extra.push_back("custom_lowering_passes " + std::to_string(contents->custom_lowering_passes.size()));
+    for (const auto &it : contents->jit_externs) {
+        const JITExtern &e = it.second;
+        std::ostringstream s;
+        s << "jit_extern " << it.first << " ";
+        if (e.pipeline().defined()) {
+            s << "pipeline";
+        } else {
+            const ExternSignature &sig = e.extern_c_function().signature();
+            s << "(";
+            for (const Type &t : sig.arg_types()) {
+                s << t << ", ";
+            }
+            s << ") -> ";
+            if (sig.is_void_return()) {
+                s << "void";
+            } else {
+                s << sig.ret_type();
+            }
+        }
+        extra.push_back(s.str());
+    }
+
+    return Internal::fingerprint(contents->outputs, target, extra);
+}
 
 void Pipeline::set_error_handler(void (*handler)(void *, const char *)) {
     user_assert(defined()) << "Pipeline is undefined\n";
@@ -506,6 +669,7 @@ void Pipeline::set_custom_print(void (*cust_print)(void *, const char *)) {
 
 void Pipeline::set_jit_externs(const std::map<std::string, JITExtern> &externs) {
     user_assert(defined()) << "Pipeline is undefined\n";
+    contents->finish_async_jit();
     contents->jit_externs = externs;
     invalidate_cache();
 }
@@ -517,13 +681,14 @@ const std::map<std::string, JITExtern> &Pipeline::get_jit_externs() {
 
 void Pipeline::add_custom_lowering_pass(IRMutator2 *pass, std::function<void()> deleter) {
     user_assert(defined()) << "Pipeline is undefined\n";
-    contents->invalidate_cache();
+    invalidate_cache();
     CustomLoweringPass p = {pass, deleter};
     contents->custom_lowering_passes.push_back(p);
 }
 
 void Pipeline::clear_custom_lowering_passes() {
     if (!defined()) return;
+    invalidate_cache();
     contents->clear_custom_lowering_passes();
 }
 
@@ -852,6 +1017,23 @@ void Pipeline::realize(RealizationArg outputs, const Target &t,
             << "The Buffers passed to realize must all be allocated\n";
     }
 
+    // If the pipeline is being compiled in the background, realize
+    // the fallback, or the quickly compiled tier, until it's done.
+    if (contents->async_jit_running()) {
+        if (contents->jit_fallback.defined()) {
+            debug(2) << "Realizing jit fallback while compiling in the background\n";
+            contents->jit_fallback.realize(std::move(outputs), t, param_map);
+            return;
+        }
+        if (contents->jit_fast_tier.defined()) {
+            debug(2) << "Realizing fast compiled tier while compiling in the background\n";
+            contents->jit_fast_tier.contents->jit_handlers = contents->jit_handlers;
+            contents->jit_fast_tier.realize(std::move(outputs), contents->async_jit_target.with_feature(Target::FastCompile), param_map);
+            return;
+        }
+    }
+    contents->finish_async_jit();
+
     // If target is unspecified...
     if (target.os == Target::OSUnknown) {
         // If we've already jit-compiled for a specific target, use that.
@@ -863,6 +1045,39 @@ void Pipeline::realize(RealizationArg outputs, const Target &t,
         }
     }
 
+    // With tiered compilation, realize the pipeline compiled with
+    // Target::FastCompile until it has been realized
+    // jit_tier_threshold times, then compile the optimized pipeline
+    // in the background, and keep realizing the fast tier until it's
+    // ready.
+    Target jit_target = target.with_feature(Target::JIT).with_feature(Target::UserContext);
+    bool optimized_code_ready = contents->jit_module.compiled() && contents->jit_target == jit_target;
+    if (optimized_code_ready) {
+        contents->jit_fast_tier = Pipeline();
+    } else if (contents->jit_tier_threshold > 0 && !target.has_feature(Target::FastCompile)) {
+        if (!contents->jit_fast_tier.defined()) {
+            Pipeline fast_tier(this->outputs());
+            fast_tier.contents->jit_tier_threshold = 0;
+            fast_tier.contents->jit_externs = contents->jit_externs;
+            for (const CustomLoweringPass &pass : contents->custom_lowering_passes) {
+                // This pipeline still owns the passes.
+                fast_tier.contents->custom_lowering_passes.push_back({pass.pass, nullptr});
+            }
+            contents->jit_fast_tier = fast_tier;
+        }
+        contents->jit_fast_tier.contents->jit_handlers = contents->jit_handlers;
+        if (++contents->jit_tier_calls >= contents->jit_tier_threshold) {
+            // Both tiers lower the same Functions, which can't happen
+            // on two threads at once, so the fast tier must be
+            // compiled before the background compilation starts.
+            contents->jit_fast_tier.compile_jit(target.with_feature(Target::FastCompile));
+            debug(2) << "Compiling optimized code after " << contents->jit_tier_calls << " realizations\n";
+            compile_jit_async(target);
+        }
+        contents->jit_fast_tier.realize(std::move(outputs), target.with_feature(Target::FastCompile), param_map);
+        return;
+    }
+
     // We need to make a context for calling the jitted function to
     // carry the the set of custom handlers. Here's how handlers get
     // called when running jitted code:
@@ -1083,7 +1298,9 @@ void Pipeline::infer_input_bounds(int x_size, int y_size, int z_size, int w_size
 
 void Pipeline::invalidate_cache() {
     if (defined()) {
+        contents->finish_async_jit();
         contents->invalidate_cache();
+        contents->reset_jit_tiers();
     }
 }
 
@@ -7,6 +7,7 @@
  * pipeline.
  */
 
+#include <future>
 #include <vector>
 
 #include "AutoSchedule.h"
@@ -101,6 +102,9 @@ public:
     static std::vector<Internal::JITModule> make_externs_jit_module(const Target &target,
                                                                     std::map<std::string, JITExtern> &externs_in_out);
 
+    // compile_jit, without waiting for a background compilation.
+    void *compile_jit_now(const Target &target);
+
 public:
     /** Make an undefined Pipeline object. */
     Pipeline();
@@ -251,9 +255,62 @@ public:
      * then you can call this ahead of time. Returns the raw function
      * pointer to the compiled pipeline. Default is to use the Target
      * returned from Halide::get_jit_target_from_environment()
+     *
+     * If the environment variable HL_JIT_CACHE_DIR names a directory,
+     * the object code is cached there, keyed by the fingerprint of
+     * the pipeline, and later compiles of the same pipeline (in this
+     * process or another) load it instead of lowering the pipeline
+     * and running LLVM. Pipelines with custom lowering passes are
+     * always lowered, and only skip running LLVM.
      */
      void *compile_jit(const Target &target = get_jit_target_from_environment());
 
+    /** Start jit compiling the pipeline on a background thread, and
+     * return a future for what compile_jit would return. If Halide
+     * was built with exceptions (WITH_EXCEPTIONS), a compilation
+     * error is held by the future and thrown when it's waited for;
+     * otherwise the error handler runs on the background thread, and
+     * by default aborts. Until it's done, realize runs the jit
+     * fallback (see set_jit_fallback), or waits for it if there is
+     * none. Calls that would use or invalidate the compiled code, such
+     * as compile_jit, infer_input_bounds, set_jit_externs or
+     * invalidate_cache, wait for it first. Don't reschedule the Funcs
+     * of the pipeline or compile it in other ways until the future is
+     * ready. The compilation keeps the pipeline alive, so dropping
+     * the Pipeline doesn't stop or wait for it: wait for the future
+     * before the program exits. */
+    std::shared_future<void *> compile_jit_async(const Target &target = get_jit_target_from_environment());
+
+    /** Set a pipeline for realize to run instead of this one while
+     * compile_jit_async is compiling it, such as the same algorithm
+     * with a simpler schedule that compiles quickly. It must take the
+     * same parameters and produce outputs of the same types. Set an
+     * undefined Pipeline to make realize wait instead. */
+    void set_jit_fallback(const Pipeline &fallback);
+
+    /** Turn on tiered jit compilation. realize first runs the
+     * pipeline compiled with Target::FastCompile, which compiles
+     * quickly but runs slowly. Once it has been realized the given
+     * number of times, the optimized pipeline is compiled in the
+     * background with compile_jit_async, and realize switches to it
+     * when it's ready. Zero turns tiering off. The default is the
+     * value of the environment variable HL_JIT_TIER_THRESHOLD, or
+     * zero if it's not set. Compiling the pipeline with compile_jit
+     * skips the fast tier. */
+    void set_jit_tier_threshold(int calls);
+
+    /** Compute a fingerprint of the pipeline for a target: a hash of
+     * the definitions and schedules of all the Funcs it uses, the
+     * metadata of the Params and Buffers they refer to, its extern
+     * stages, the names and signatures of its jit externs, the
+     * target, and the build of Halide and LLVM. Pipelines with the same fingerprint compile to the same
+     * code, so the fingerprint can key a cache of compiled pipelines
+     * without lowering them. Funcs and Vars given no name are named
+     * by a counter, so give them names if the fingerprint must be
+     * stable across processes that build them in a different
+     * order. Custom lowering passes are only counted. */
+    std::string fingerprint(const Target &target = get_target_from_environment()) const;
+
     /** Set the error handler function that be called in the case of
      * runtime errors during halide pipelines. If you are compiling
      * statically, you can also just define your own function with
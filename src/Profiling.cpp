@@ -47,6 +47,9 @@ private:
 
     bool profiling_memory = true;
 
+    // How many loops we're inside of
+    int loop_depth = 0;
+
     // Strip down the tuple name, e.g. f.0 into f
     string normalize_name(const string &name) {
         vector<string> v = split_string(name, ".");
@@ -203,6 +206,19 @@ private:
         Expr profiler_token = Variable::make(Int(32), "profiler_token");
         Expr profiler_state = Variable::make(Handle(), "profiler_state");
 
+        if (op->is_producer && loop_depth == 0) {
+            // This Func is computed once per call, so we can also
+            // record how long it takes.
+            string start_time_name = op->name + ".profiler_start_time";
+            Expr start_time = Variable::make(UInt(64), start_time_name);
+            Expr now = Call::make(Int(64), "halide_current_time_ns", {}, Call::Extern);
+            Expr profiler_pipeline_state = Variable::make(Handle(), "profiler_pipeline_state");
+            Expr record = Call::make(Int(32), "halide_profiler_record_latency",
+                                     {profiler_pipeline_state, idx, start_time}, Call::Extern);
+            body = Block::make(body, Evaluate::make(record));
+            body = LetStmt::make(start_time_name, cast(UInt(64), now), body);
+        }
+
         // This call gets inlined and becomes a single store instruction.
         Expr set_task = Call::make(Int(32), "halide_profiler_set_current_func",
                                    {profiler_state, profiler_token, idx}, Call::Extern);
@@ -214,6 +230,7 @@ private:
 
     Stmt visit(const For *op) override {
         Stmt body = op->body;
+        loop_depth++;
 
         // The for loop indicates a device transition or a
         // parallel job launch. Decrement the number of active
@@ -258,6 +275,7 @@ private:
             body = op->body;
         }
 
+        loop_depth--;
         Stmt stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
 
         if (update_active_threads) {
@@ -304,10 +322,18 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
     Stmt decr_active_threads =
         Evaluate::make(Call::make(Int(32), "halide_profiler_decr_active_threads",
                                   {profiler_state}, Call::Extern));
-    s = Block::make({incr_active_threads, s, decr_active_threads});
+    // Record the time taken by calls that succeed
+    Expr profiler_pipeline_state = Variable::make(Handle(), "profiler_pipeline_state");
+    Expr start_time = Variable::make(UInt(64), "profiler_start_time");
+    Stmt record_latency =
+        Evaluate::make(Call::make(Int(32), "halide_profiler_record_latency",
+                                  {profiler_pipeline_state, -1, start_time}, Call::Extern));
+    s = Block::make({incr_active_threads, s, decr_active_threads, record_latency});
 
     s = LetStmt::make("profiler_pipeline_state", get_pipeline_state, s);
     s = LetStmt::make("profiler_state", get_state, s);
+    Expr now = Call::make(Int(64), "halide_current_time_ns", {}, Call::Extern);
+    s = LetStmt::make("profiler_start_time", cast(UInt(64), now), s);
     // If there was a problem starting the profiler, it will call an
     // appropriate halide error function and then return the
     // (negative) error code as the token.
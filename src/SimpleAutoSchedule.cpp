@@ -1,4 +1,5 @@
 #include "SimpleAutoSchedule.h"
+#include "Bounds.h"
 #include "DerivativeUtils.h"
 #include "FindCalls.h"
 #include "RealizationOrder.h"
@@ -7,7 +8,10 @@
 #include "IRVisitor.h"
 #include "RegionCosts.h"
 #include "AutoSchedule.h"
+#include "AutoScheduleUtils.h"
 
+#include <chrono>
+#include <memory>
 #include <numeric>
 
 namespace Halide {
@@ -23,10 +27,242 @@ std::vector<int> sort_indices(const std::vector<T> &v) {
     return idx;
 }
 
-void simple_autoschedule(std::vector<Func> &outputs,
-                         const std::map<std::string, int> &parameters,
-                         const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
-                         const SimpleAutoscheduleOptions &options) {
+namespace {
+
+/** Collect the arguments of all the calls to a Func. */
+class FindCallArgs : public IRGraphVisitor {
+public:
+    FindCallArgs(const std::string &name) : name(name) {}
+
+    std::vector<std::vector<Expr>> call_args;
+
+protected:
+    using IRGraphVisitor::visit;
+
+    void visit(const Call *op) {
+        IRGraphVisitor::visit(op);
+        if (op->call_type == Call::Halide && op->name == name) {
+            call_args.push_back(op->args);
+        }
+    }
+
+private:
+    std::string name;
+};
+
+/** Collect the arguments of the calls to producer in one stage of a Func. */
+std::vector<std::vector<Expr>> stage_call_args(const Function &func,
+                                               int update_id,
+                                               const std::string &producer) {
+    const Definition &def =
+        update_id == -1 ? func.definition() : func.update(update_id);
+    FindCallArgs finder(producer);
+    for (const auto &arg : def.args()) {
+        arg.accept(&finder);
+    }
+    for (const auto &value : def.values()) {
+        value.accept(&finder);
+    }
+    if (def.predicate().defined()) {
+        def.predicate().accept(&finder);
+    }
+    return finder.call_args;
+}
+
+Expr substitute_parameters(const std::map<std::string, int> &parameters, Expr e) {
+    for (const auto &param : parameters) {
+        e = substitute(param.first, Expr(param.second), e);
+    }
+    return simplify(e);
+}
+
+/**
+ *  Check that one iteration over the pure variables of a stage touches
+ *  at most max_extent points of the producer along each dimension,
+ *  i.e. the stage reads the producer with a small stencil.
+ *  stencil_extent is set to the largest extent found.
+ */
+bool is_small_stencil(const std::vector<std::vector<Expr>> &call_args,
+                      const Definition &def,
+                      const std::map<std::string, int> &parameters,
+                      int max_extent,
+                      int &stencil_extent) {
+    stencil_extent = 1;
+    Scope<Interval> scope;
+    for (const auto &rvar : def.schedule().rvars()) {
+        Expr min = substitute_parameters(parameters, rvar.min);
+        Expr extent = substitute_parameters(parameters, rvar.extent);
+        scope.push(rvar.var, Interval(min, simplify(min + extent - 1)));
+    }
+    for (const auto &args : call_args) {
+        for (const auto &arg : args) {
+            Interval interval = bounds_of_expr_in_scope(arg, scope);
+            if (!interval.is_bounded()) {
+                return false;
+            }
+            Expr extent = substitute_parameters(parameters, interval.max - interval.min + 1);
+            const int64_t *extent_int = as_const_int(extent);
+            if (extent_int == nullptr || *extent_int > max_extent) {
+                return false;
+            }
+            stencil_extent = std::max(stencil_extent, (int)*extent_int);
+        }
+    }
+    return true;
+}
+
+/** Bytes of the Func and its producers touched when computing
+ *  a region of the Func. */
+Expr region_footprint_bytes(RegionCosts &costs,
+                            const Function &func,
+                            const Box &region) {
+    DimBounds pure_bounds;
+    for (int i = 0; i < (int)func.args().size(); i++) {
+        pure_bounds.emplace(func.args()[i], region[i]);
+    }
+    std::map<std::string, Box> regions;
+    for (int stage = 0; stage <= (int)func.updates().size(); stage++) {
+        Scope<Interval> scope;
+        for (const auto &it : get_stage_bounds(func, stage, pure_bounds)) {
+            scope.push(it.first, it.second);
+        }
+        Definition def = get_stage_definition(func, stage);
+        std::vector<Expr> exprs = def.values();
+        exprs.insert(exprs.end(), def.args().begin(), def.args().end());
+        for (const auto &e : exprs) {
+            for (const auto &it : boxes_required(e, scope)) {
+                auto region_it = regions.find(it.first);
+                if (region_it == regions.end()) {
+                    regions.emplace(it.first, it.second);
+                } else {
+                    merge_boxes(region_it->second, it.second);
+                }
+            }
+        }
+    }
+    Expr bytes = costs.region_size(func.name(), region);
+    for (const auto &it : regions) {
+        if (!bytes.defined()) {
+            break;
+        }
+        if (it.first == func.name()) {
+            continue;
+        }
+        if (costs.inputs.find(it.first) != costs.inputs.end()) {
+            Expr size = costs.input_region_size(it.first, it.second);
+            bytes = size.defined() ? bytes + size : Expr();
+        } else if (costs.env.find(it.first) != costs.env.end()) {
+            Expr size = costs.region_size(it.first, it.second);
+            bytes = size.defined() ? bytes + size : Expr();
+        }
+    }
+    return bytes;
+}
+
+struct TileSizes {
+    int width;
+    int height;
+    // Split only dimension largest_dim by width
+    bool split_1d;
+};
+
+/**
+ *  Search the 2D tile (on dimensions dim_width and dim_height), or the
+ *  1D split factor of largest_dim if no 2D tiling has enough tiles, that
+ *  minimizes the estimated cost of computing the Func on CPU. A tile costs
+ *  its arithmetic plus the bytes it touches, which are charged balance
+ *  times more when they don't fit in the per-core share of the last level
+ *  cache; tiles run in waves of machine parallelism.
+ *  Returns false if the costs cannot be estimated.
+ */
+bool search_tile_sizes(RegionCosts &costs,
+                       const Function &func,
+                       const Box &bounds,
+                       const std::vector<int> &int_bounds,
+                       int dim_width,
+                       int dim_height,
+                       int largest_dim,
+                       const std::map<std::string, int> &parameters,
+                       const std::set<std::string> &inlined,
+                       int vectorize_width,
+                       int parallelism,
+                       int64_t cache_bytes,
+                       int64_t balance,
+                       TileSizes &result) {
+    auto tile_cost = [&](const std::vector<std::pair<int, int>> &tile,
+                         double &cost) -> bool {
+        Box region = bounds;
+        int64_t num_tiles = 1, num_full_tiles = 1;
+        for (const auto &dim : tile) {
+            Expr min = substitute_parameters(parameters, bounds[dim.first].min);
+            region[dim.first] = Interval(min, simplify(min + dim.second - 1));
+            num_tiles *= (int_bounds[dim.first] + dim.second - 1) / dim.second;
+            num_full_tiles *= int_bounds[dim.first] / dim.second;
+        }
+        // Same parallelism requirement as the tiling below
+        if (num_full_tiles < parallelism) {
+            return false;
+        }
+        Cost region_cost = costs.region_cost(func.name(), region, inlined);
+        Expr footprint = region_footprint_bytes(costs, func, region);
+        if (!region_cost.defined() || !footprint.defined()) {
+            return false;
+        }
+        const int64_t *arith =
+            as_const_int(substitute_parameters(parameters, region_cost.arith));
+        const int64_t *bytes =
+            as_const_int(substitute_parameters(parameters, footprint));
+        if (arith == nullptr || bytes == nullptr) {
+            return false;
+        }
+        double load_cost = *bytes <= cache_bytes / parallelism ?
+            (double)*bytes : (double)*bytes * balance;
+        int64_t waves = (num_tiles + parallelism - 1) / parallelism;
+        cost = (double)waves * ((double)*arith + load_cost);
+        return true;
+    };
+
+    bool found = false;
+    double best_cost = 0;
+    if (dim_width != -1 && dim_height != -1) {
+        for (int width = vectorize_width;
+                width <= int_bounds[dim_width]; width *= 2) {
+            for (int height = 1; height <= int_bounds[dim_height]; height *= 2) {
+                double cost;
+                if (tile_cost({{dim_width, width}, {dim_height, height}}, cost) &&
+                        (!found || cost < best_cost)) {
+                    found = true;
+                    best_cost = cost;
+                    result = TileSizes{width, height, false};
+                }
+            }
+        }
+    }
+    if (!found && largest_dim != -1) {
+        for (int factor = vectorize_width;
+                factor <= int_bounds[largest_dim]; factor *= 2) {
+            double cost;
+            if (tile_cost({{largest_dim, factor}}, cost) &&
+                    (!found || cost < best_cost)) {
+                found = true;
+                best_cost = cost;
+                result = TileSizes{factor, 1, true};
+            }
+        }
+    }
+    if (found) {
+        debug(1) << "[simple_autoschedule] searched tile size:" << result.width <<
+            "x" << result.height << ", split_1d:" << result.split_1d <<
+            ", cost:" << best_cost << "\n";
+    }
+    return found;
+}
+
+void autoschedule_funcs(std::vector<Func> &outputs,
+                        const std::map<std::string, int> &parameters,
+                        const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+                        const SimpleAutoscheduleOptions &options,
+                        const Derivative *derivative) {
     user_assert(outputs.size() == output_bounds.size()) <<
         "[simple_autoschedule] outputs size and output_bounds size don't match \n";
     for (int i = 0; i < (int)output_bounds.size(); i++) {
@@ -92,6 +328,58 @@ void simple_autoschedule(std::vector<Func> &outputs,
         output_set.insert(output.name());
     }
 
+    // When scheduling a training step, split the Funcs into the backward
+    // pass (the adjoints, the forward Funcs recomputed for them, and
+    // everything derived from those) and the forward pass.
+    std::set<std::string> backward_set;
+    std::set<std::string> recomputed_set;
+    if (derivative != nullptr) {
+        for (const auto &it : derivative->adjoints) {
+            backward_set.insert(it.second.name());
+        }
+        for (const auto &it : derivative->recomputed) {
+            backward_set.insert(it.second.name());
+            recomputed_set.insert(it.second.name());
+        }
+        for (const auto &name : order) {
+            if (backward_set.find(name) != backward_set.end()) {
+                continue;
+            }
+            for (const auto &it : find_direct_calls(env[name])) {
+                if (backward_set.find(it.first) != backward_set.end()) {
+                    backward_set.insert(name);
+                    break;
+                }
+            }
+        }
+    }
+    // Cost model and machine description for searching the tile sizes
+    std::unique_ptr<RegionCosts> costs;
+    int parallelism = 8;
+    int64_t cache_bytes = 0;
+    int64_t balance = 1;
+    std::set<std::string> inlined;
+    if (options.search_tile_sizes && !options.gpu) {
+        costs.reset(new RegionCosts(env));
+        const MachineParams &params = options.machine_params;
+        const int64_t *parallelism_int = as_const_int(params.parallelism);
+        const int64_t *llc_int = as_const_int(params.last_level_cache_size);
+        const int64_t *balance_int = as_const_int(params.balance);
+        user_assert(parallelism_int != nullptr && llc_int != nullptr &&
+                    balance_int != nullptr) <<
+            "[simple_autoschedule] machine_params should be constants.\n";
+        parallelism = std::max((int)*parallelism_int, 1);
+        cache_bytes = *llc_int;
+        balance = *balance_int;
+    }
+
+    // The parallel tile loop of each stage that is tiled on CPU,
+    // producers can be computed at these loops.
+    std::map<FuncKey, Var> tile_vars;
+    // The serial row loop inside the 2D tiles, producers with overlapping
+    // stencils are computed at these loops and slide along the rows.
+    std::map<FuncKey, Var> row_vars;
+
     debug(1) << "[simple_autoschedule] order:\n";
     for (auto it = order.begin(); it != order.end(); it++) {
         debug(1) << *it << "\n";
@@ -141,10 +429,6 @@ void simple_autoschedule(std::vector<Func> &outputs,
             // func.memoize();
         }
 
-        func.compute_root();
-        // Initial definition is easy: everything is pure variables.
-        // Just parallelize and vectorize if there are enough entries to launch threads.
-        debug(1) << "[simple_autoschedule] scheduling initial definition" << "\n";
         int tile_width =
             options.gpu ? options.gpu_tile_width : options.cpu_tile_width;
         int tile_height =
@@ -154,9 +438,112 @@ void simple_autoschedule(std::vector<Func> &outputs,
         int min_cpu_threads = 8;
         int min_threads = options.gpu ? min_gpu_threads : min_cpu_threads;
         int vectorize_width = 8;
+
+        bool is_forward = derivative != nullptr &&
+            (backward_set.find(func.name()) == backward_set.end() ||
+             recomputed_set.find(func.name()) != recomputed_set.end());
+        if (!options.gpu &&
+                output_set.find(func.name()) == output_set.end() &&
+                (options.fuse_producers || is_forward)) {
+            // A Func read by exactly one tiled stage with a small stencil is
+            // produced inside the tiles of that stage instead of into a
+            // full-size buffer. In a training step this also keeps the
+            // forward values reread by the backward pass in cache.
+            std::vector<FuncKey> consumer_stages;
+            for (const auto &it : env) {
+                if (it.first == func.name()) {
+                    continue;
+                }
+                for (int update_id = -1;
+                        update_id < (int)it.second.updates().size(); update_id++) {
+                    if (!stage_call_args(it.second, update_id, func.name()).empty()) {
+                        consumer_stages.push_back(FuncKey{it.first, update_id});
+                    }
+                }
+            }
+            bool fused = false;
+            if (consumer_stages.size() == 1 &&
+                    !func.has_update_definition() &&
+                    !func.function().has_extern_definition() &&
+                    (options.fuse_producers ||
+                     backward_set.find(consumer_stages[0].first) != backward_set.end()) &&
+                    tile_vars.find(consumer_stages[0]) != tile_vars.end()) {
+                const FuncKey &key = consumer_stages[0];
+                const Function &consumer = env[key.first];
+                const Definition &def = key.second == -1 ?
+                    consumer.definition() : consumer.update(key.second);
+                int stencil_extent = 1;
+                if (is_small_stencil(stage_call_args(consumer, key.second, func.name()),
+                                     def, parameters, std::min(tile_width, tile_height),
+                                     stencil_extent)) {
+                    Func consumer_func(consumer);
+                    LoopLevel tile_level(consumer_func, tile_vars[key], key.second);
+                    auto row_it = row_vars.find(key);
+                    if (stencil_extent > 1 && row_it != row_vars.end()) {
+                        // Neighboring rows of the tile overlap, compute row
+                        // by row so that sliding window reuses the overlap
+                        debug(1) << "[simple_autoschedule] slide over " << key.first <<
+                            "." << key.second << " tile rows\n";
+                        func.store_at(tile_level)
+                            .compute_at(LoopLevel(consumer_func, row_it->second, key.second));
+                    } else {
+                        debug(1) << "[simple_autoschedule] compute at " << key.first <<
+                            "." << key.second << " tile\n";
+                        func.compute_at(tile_level).store_at(tile_level);
+                    }
+                    if (func.args().size() > 0 &&
+                            (int_bounds.empty() || int_bounds[0] >= vectorize_width)) {
+                        func.vectorize(func.args()[0], vectorize_width);
+                    }
+                    fused = true;
+                }
+            }
+            if (fused) {
+                continue;
+            }
+            if (recomputed_set.find(func.name()) != recomputed_set.end() &&
+                    func.function().can_be_inlined()) {
+                // Checkpointing chose to recompute it rather than store it
+                debug(1) << "[simple_autoschedule] inline recomputed Func\n";
+                func.compute_inline();
+                inlined.insert(func.name());
+                continue;
+            }
+        }
+
+        bool split_1d = false;
+        if (costs) {
+            // The narrowest output type decides the natural vector width
+            int natural_width = 0;
+            for (const auto &type : func.output_types()) {
+                natural_width = std::max(natural_width,
+                                         options.target.natural_vector_size(type));
+            }
+            if (natural_width > 0) {
+                vectorize_width = natural_width;
+            }
+            min_threads = parallelism;
+            TileSizes tile_sizes;
+            if (!func.function().has_extern_definition() &&
+                    search_tile_sizes(*costs, func.function(), bounds, int_bounds,
+                                      dim_width, dim_height, largest_dim,
+                                      parameters, inlined, vectorize_width,
+                                      parallelism, cache_bytes, balance,
+                                      tile_sizes)) {
+                tile_width = tile_sizes.width;
+                tile_height = tile_sizes.height;
+                split_1d = tile_sizes.split_1d;
+            }
+        }
+
+        func.compute_root();
+        // Initial definition is easy: everything is pure variables.
+        // Just parallelize and vectorize if there are enough entries to launch threads.
+        debug(1) << "[simple_autoschedule] scheduling initial definition" << "\n";
         bool tilable = false;
         // If there's enough tiles
-        if ((int)int_bounds.size() >= 2 &&
+        if (!split_1d &&
+                (int)int_bounds.size() >= 2 &&
                 int_bounds[dim_width] >= tile_width &&
                 int_bounds[dim_height] >= tile_height &&
                 (int_bounds[dim_width] / tile_width) *
@@ -213,6 +600,8 @@ void simple_autoschedule(std::vector<Func> &outputs,
                     .fuse(xo, yo, tile_index)
                     .parallel(tile_index)
                     .vectorize(xi, vectorize_width);
+                tile_vars[FuncKey{func.name(), -1}] = tile_index;
+                row_vars[FuncKey{func.name(), -1}] = yi;
             }
             tilable = true;
         } else if ((int)int_bounds.size() >= 1 &&
@@ -268,6 +657,7 @@ void simple_autoschedule(std::vector<Func> &outputs,
                            xo, xi, tile_width * tile_height)
                     .parallel(xo)
                     .vectorize(xi, vectorize_width);
+                tile_vars[FuncKey{func.name(), -1}] = xo;
             }
             tilable = true;
         } else if (options.gpu) {
@@ -302,6 +692,9 @@ void simple_autoschedule(std::vector<Func> &outputs,
             int rdim_width = -1;
             int rdim_height = -1;
             int largest_rdim = -1;
+            // The largest reduction variable regardless of the tile size
+            int max_rdim = -1;
+            int max_rdim_extent = 0;
             bool rvar_tilable = false;
             if (rvars.size() > 0) {
                 std::vector<int> rvar_extents;
@@ -343,6 +736,8 @@ void simple_autoschedule(std::vector<Func> &outputs,
                     }
                 }
                 if ((int)bounds_rank.size() >= 1) {
+                    max_rdim = bounds_rank.back();
+                    max_rdim_extent = rvar_extents[max_rdim];
                     if (rvar_extents[bounds_rank.back()] >=
                             tile_width * tile_height) {
                         largest_rdim = bounds_rank.back();
@@ -372,7 +767,59 @@ void simple_autoschedule(std::vector<Func> &outputs,
             // TODO: gracefully fallback if factorization is impossible
             if (!tilable && rvar_tilable) {
                 debug(1) << "[simple_autoschedule] Perform parallel reduction\n";
-                if (rdim_width != -1 && rdim_height != -1) {
+                if (!options.gpu && options.multi_level_rfactor) {
+                    debug(1) << "[simple_autoschedule] Multi-level parallel reduction\n";
+                    // Three levels: each thread reduces chunks of the largest
+                    // reduction variable into a vector of partials, the
+                    // partials of all threads are merged lane-wise, then the
+                    // lanes are merged into the output. The lanes are
+                    // factored out of the output first and the chunks out of
+                    // the lanes, so the intermediates get distinct names
+                    // (rfactor names them after the Func it's called on).
+                    const int64_t *cores_int =
+                        as_const_int(options.machine_params.parallelism);
+                    int cores = cores_int != nullptr ? std::max((int)*cores_int, 1) : 8;
+                    // A few chunks per core for load balancing, each at least
+                    // a few vectors long
+                    int num_chunks = std::max(1, std::min(cores * 4,
+                        max_rdim_extent / (vectorize_width * 4)));
+                    int chunk_size = (max_rdim_extent + num_chunks - 1) / num_chunks;
+                    chunk_size = ((chunk_size + vectorize_width - 1) / vectorize_width) *
+                        vectorize_width;
+                    debug(1) << "[simple_autoschedule] chunk_size:" << chunk_size << "\n";
+                    RVar rx(rvars[max_rdim].var);
+                    RVar rxo, rxi, rxm, rxv;
+                    func.update(update_id)
+                        .split(rx, rxo, rxi, chunk_size)
+                        .split(rxi, rxm, rxv, vectorize_width);
+                    Var u, v;
+                    Func lanes = func.update(update_id).rfactor(rxv, v);
+                    Func partials = lanes.update().rfactor(rxo, u);
+                    std::vector<VarOrRVar> new_order;
+                    new_order.push_back(v);
+                    new_order.push_back(rxm);
+                    for (const auto &arg : partials.update_args()) {
+                        const Variable *var = arg.as<Variable>();
+                        if (var != nullptr && !var->reduction_domain.defined() &&
+                                var->name != u.name() && var->name != v.name()) {
+                            new_order.push_back(Var(var->name));
+                        }
+                    }
+                    new_order.push_back(u);
+                    partials.compute_root()
+                            .parallel(u)
+                            .vectorize(v);
+                    partials.update()
+                            .reorder(new_order)
+                            .parallel(u)
+                            .vectorize(v);
+                    // Tree merge: reduce over the chunks for each lane
+                    // with vector instructions, then across the lanes.
+                    lanes.compute_root()
+                         .vectorize(v);
+                    lanes.update()
+                         .vectorize(v);
+                } else if (rdim_width != -1 && rdim_height != -1) {
                     debug(1) << "[simple_autoschedule] 2D parallel reduction\n";
                     // 2D tiling
                     if (options.gpu) {
@@ -604,6 +1051,8 @@ void simple_autoschedule(std::vector<Func> &outputs,
                         .fuse(xo, yo, tile_index)
                         .parallel(tile_index)
                         .vectorize(xi, vectorize_width);
+                    tile_vars[FuncKey{func.name(), update_id}] = tile_index;
+                    row_vars[FuncKey{func.name(), update_id}] = yi;
                 }
             } else if ((int)pure_arg_bounds.size() >= 1 &&
                             pure_arg_bounds[largest_pdim] >= (tile_width * tile_height) &&
@@ -648,6 +1097,7 @@ void simple_autoschedule(std::vector<Func> &outputs,
                                TailStrategy::GuardWithIf)
                         .parallel(xo)
                         .vectorize(xi, vectorize_width);
+                    tile_vars[FuncKey{func.name(), update_id}] = xo;
                 }
             } else if (!options.gpu && pure_args.size() > 0) {
                 debug(1) << "[simple_autoschedule] \n" << 
@@ -820,6 +1270,108 @@ void simple_autoschedule(std::vector<Func> &outputs,
     }
 }
 
+/** Best time in seconds of realizing the outputs over the given bounds. */
+double benchmark_outputs(std::vector<Func> &outputs,
+                         const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+                         const Target &target,
+                         int runs) {
+    double total = 0;
+    for (int i = 0; i < (int)outputs.size(); i++) {
+        std::vector<int> mins, extents;
+        for (const auto &bound : output_bounds[i]) {
+            mins.push_back(bound.first);
+            extents.push_back(bound.second - bound.first + 1);
+        }
+        std::vector<Buffer<>> buffers;
+        for (const auto &type : outputs[i].output_types()) {
+            Buffer<> buffer(type, extents);
+            buffer.set_min(mins);
+            buffers.push_back(buffer);
+        }
+        Realization realization(buffers);
+        outputs[i].compile_jit(target);
+        double best = std::numeric_limits<double>::max();
+        for (int run = 0; run < runs; run++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            outputs[i].realize(realization, target);
+            auto end = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double>(end - start).count());
+        }
+        total += best;
+    }
+    return total;
+}
+
+/**
+ *  Schedule with the searched tile sizes, and if asked, validate the search
+ *  by timing it against the fixed tile sizes on deep copies of the pipeline.
+ */
+void autoschedule_and_validate(std::vector<Func> &outputs,
+                               const std::map<std::string, int> &parameters,
+                               const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+                               const SimpleAutoscheduleOptions &options,
+                               const Derivative *derivative) {
+    if (!options.search_tile_sizes || options.gpu || options.validation_runs <= 0) {
+        autoschedule_funcs(outputs, parameters, output_bounds, options, derivative);
+        return;
+    }
+    if (!Pipeline(outputs).infer_arguments().empty()) {
+        debug(1) << "[simple_autoschedule] Pipeline has unbound inputs, " <<
+            "skip validation.\n";
+        autoschedule_funcs(outputs, parameters, output_bounds, options, derivative);
+        return;
+    }
+
+    std::vector<Function> output_functions;
+    std::map<std::string, Function> env;
+    for (const auto &func : outputs) {
+        output_functions.push_back(func.function());
+        std::map<std::string, Function> local_env =
+            find_transitive_calls(func.function());
+        env.insert(local_env.begin(), local_env.end());
+    }
+    SimpleAutoscheduleOptions fixed_options = options;
+    fixed_options.search_tile_sizes = false;
+    std::vector<SimpleAutoscheduleOptions> candidates{options, fixed_options};
+    int best_candidate = 0;
+    double best_time = std::numeric_limits<double>::max();
+    for (int i = 0; i < (int)candidates.size(); i++) {
+        std::vector<Func> copied_outputs;
+        for (const auto &func : deep_copy(output_functions, env).first) {
+            copied_outputs.push_back(Func(func));
+        }
+        autoschedule_funcs(copied_outputs, parameters, output_bounds,
+                           candidates[i], derivative);
+        double time = benchmark_outputs(copied_outputs, output_bounds,
+                                        options.target, options.validation_runs);
+        debug(1) << "[simple_autoschedule] candidate " << i << " takes " <<
+            time * 1e3 << " ms\n";
+        if (time < best_time) {
+            best_time = time;
+            best_candidate = i;
+        }
+    }
+    autoschedule_funcs(outputs, parameters, output_bounds,
+                       candidates[best_candidate], derivative);
+}
+
+}  // namespace
+
+void simple_autoschedule(std::vector<Func> &outputs,
+                         const std::map<std::string, int> &parameters,
+                         const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+                         const SimpleAutoscheduleOptions &options) {
+    autoschedule_and_validate(outputs, parameters, output_bounds, options, nullptr);
+}
+
+void simple_autoschedule(std::vector<Func> &outputs,
+                         const Derivative &derivative,
+                         const std::map<std::string, int> &parameters,
+                         const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+                         const SimpleAutoscheduleOptions &options) {
+    autoschedule_and_validate(outputs, parameters, output_bounds, options, &derivative);
+}
+
 void simple_autoschedule(Func &output,
                          const std::map<std::string, int> &parameters,
                          const std::vector<std::pair<int, int>> &output_bounds,
@@ -834,8 +1386,68 @@ void simple_autoschedule(Func &output,
 
 namespace Internal {
 
+namespace {
+
+// Fill a buffer with small integers, so that sums of them are exact in
+// any order.
+void fill_small_ints(Buffer<float> buf) {
+    buf.for_each_element([&](const int *pos) {
+        int h = 0;
+        for (int i = 0; i < buf.dimensions(); i++) {
+            h = h * 31 + pos[i];
+        }
+        buf(pos) = (float)(h % 7 - 3);
+    });
+}
+
+void check_same(const Buffer<float> &output, const Buffer<float> &reference, const char *what) {
+    output.for_each_element([&](const int *pos) {
+        internal_assert(output(pos) == reference(pos))
+            << "[simple_autoschedule] " << what << " differs from the unscheduled pipeline: "
+            << output(pos) << " instead of " << reference(pos) << "\n";
+    });
+}
+
+// Records the loops each Func is produced inside of in a lowered Stmt.
+class FindProducerLoops : public IRVisitor {
+    using IRVisitor::visit;
+
+    std::vector<std::string> loops;
+
+    void visit(const For *op) override {
+        loops.push_back(op->name);
+        IRVisitor::visit(op);
+        loops.pop_back();
+    }
+
+    void visit(const ProducerConsumer *op) override {
+        if (op->is_producer) {
+            producers[op->name] = loops;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    std::map<std::string, std::vector<std::string>> producers;
+};
+
+std::map<std::string, std::vector<std::string>> producer_loops(Func f) {
+    Module m = f.compile_to_module(f.infer_arguments(), f.name());
+    FindProducerLoops finder;
+    for (const LoweredFunc &lf : m.functions()) {
+        if (lf.name == f.name()) {
+            lf.body.accept(&finder);
+        }
+    }
+    return finder.producers;
+}
+
+}  // namespace
+
 void simple_autoschedule_test() {
-    // For now we just test whether it compiles or not.
+    // Most cases just test that the schedule compiles and runs. Some also
+    // check the output against the unscheduled pipeline and the structure
+    // of the lowered code.
     SimpleAutoscheduleOptions cpu_options;
     Var x("x"), y("y"), z("z");
     { // Simple pointwise operations. Should inline.
@@ -948,6 +1560,137 @@ void simple_autoschedule_test() {
 
         Buffer<float> output = sum.realize();
     }
+    { // Large 1D reduction onto a scalar. Should perform multi-level reduction
+        Buffer<float> buf(1 << 18);
+        fill_small_ints(buf);
+        Func sum("sum");
+        RDom r(buf);
+        sum() += buf(r);
+        Func reference("reference");
+        reference() += buf(r);
+
+        SimpleAutoscheduleOptions multi_level_options;
+        multi_level_options.multi_level_rfactor = true;
+        simple_autoschedule(sum,
+                            {}, // parameters map
+                            {}, // output bounds (min, max)
+                            multi_level_options);
+
+        Buffer<float> output = sum.realize();
+        check_same(output, reference.realize(), "The multi-level reduction");
+
+        // The partials of each chunk, merged into a vector of lanes
+        auto producers = producer_loops(sum);
+        internal_assert(producers.count("sum_intm") && producers.count("sum_intm_intm"))
+            << "[simple_autoschedule] Expected two levels of rfactor intermediates\n";
+    }
+    { // Separable blur. blur_x should be computed at the tiles of blur_y.
+        Buffer<float> buf(130, 130);
+        fill_small_ints(buf);
+        Func blur_x("blur_x");
+        blur_x(x, y) = buf(x, y) + buf(x + 1, y) + buf(x + 2, y);
+        Func blur_y("blur_y");
+        blur_y(x, y) = blur_x(x, y) + blur_x(x, y + 1) + blur_x(x, y + 2);
+        Func reference("reference");
+        reference(x, y) = (buf(x, y) + buf(x + 1, y) + buf(x + 2, y)) +
+            (buf(x, y + 1) + buf(x + 1, y + 1) + buf(x + 2, y + 1)) +
+            (buf(x, y + 2) + buf(x + 1, y + 2) + buf(x + 2, y + 2));
+
+        SimpleAutoscheduleOptions fuse_options;
+        fuse_options.fuse_producers = true;
+        simple_autoschedule(blur_y,
+                            {}, // parameters map
+                            {{0, 127},
+                             {0, 127}}, // output bounds (min, max)
+                            fuse_options);
+
+        Buffer<float> output = blur_y.realize(128, 128);
+        check_same(output, reference.realize(128, 128), "The fused blur");
+
+        auto producers = producer_loops(blur_y);
+        bool in_tiles = false;
+        for (const std::string &loop : producers["blur_x"]) {
+            in_tiles |= starts_with(loop, "blur_y.s0.");
+        }
+        internal_assert(in_tiles)
+            << "[simple_autoschedule] blur_x isn't computed inside the loops of blur_y\n";
+    }
+    { // 2D convolution with searched tile sizes, validated by timing.
+        Buffer<float> buf(256, 256);
+        Buffer<float> k(5, 5);
+        Func conv("conv");
+        RDom r(k);
+        conv(x, y) = 0.f;
+        conv(x, y) += buf(x + r.x, y + r.y) * k(r.x, r.y);
+
+        SimpleAutoscheduleOptions search_options;
+        search_options.search_tile_sizes = true;
+        search_options.validation_runs = 2;
+        simple_autoschedule(conv,
+                            {}, // parameters map
+                            {{0, 256 - 6},
+                             {0, 256 - 6}}, // output bounds (min, max)
+                            search_options);
+
+        Buffer<float> output = conv.realize(256 - 5, 256 - 5);
+    }
+    { // The tile size search should pick smaller tiles when the larger
+      // ones no longer fit in the cache.
+        Buffer<float> buf(258, 258);
+        Func blur("blur");
+        blur(x, y) = buf(x, y) + buf(x + 2, y) + buf(x, y + 2) + buf(x + 2, y + 2);
+        std::map<std::string, Function> env = find_transitive_calls(blur.function());
+        RegionCosts costs(env);
+        Box bounds({Interval(0, 255), Interval(0, 255)});
+        auto search = [&](int64_t cache_bytes) {
+            TileSizes tile_sizes;
+            bool found = search_tile_sizes(costs, blur.function(), bounds, {256, 256},
+                                           0, 1, 0, {}, {}, 8, 8, cache_bytes, 40,
+                                           tile_sizes);
+            internal_assert(found) << "Tile size search failed\n";
+            return tile_sizes;
+        };
+        const int64_t *llc = as_const_int(MachineParams::generic().last_level_cache_size);
+        internal_assert(llc != nullptr);
+        TileSizes large = search(*llc);
+        TileSizes small = search(32 * 1024);
+        internal_assert(large.width * large.height > small.width * small.height)
+            << "Expected a smaller tile for a smaller cache, got "
+            << large.width << "x" << large.height << " and "
+            << small.width << "x" << small.height << "\n";
+    }
+    { // Training step of a separable blur. The recomputed forward Funcs
+      // should be computed at the tiles of the adjoints.
+        Buffer<float> buf(132, 132);
+        fill_small_ints(buf);
+        RDom r(0, 128, 0, 128);
+        auto make_loss = [&](Func blur_x, Func blur_y, Func loss) {
+            blur_x(x, y) = buf(x, y) + buf(x + 1, y) + buf(x + 2, y);
+            blur_y(x, y) = blur_x(x, y) + blur_x(x, y + 1) + blur_x(x, y + 2);
+            loss() += blur_y(r.x, r.y) * blur_y(r.x, r.y);
+        };
+        Func blur_x("blur_x"), blur_y("blur_y"), loss("loss");
+        make_loss(blur_x, blur_y, loss);
+        CheckpointOptions checkpoint;
+        checkpoint.recomputed = {"blur_x", "blur_y"};
+        Derivative d = propagate_adjoints(loss, checkpoint);
+        Func d_buf = d(buf);
+
+        // The same gradient, unscheduled
+        Func ref_blur_x("ref_blur_x"), ref_blur_y("ref_blur_y"), ref_loss("ref_loss");
+        make_loss(ref_blur_x, ref_blur_y, ref_loss);
+        Func ref_d_buf = propagate_adjoints(ref_loss)(buf);
+
+        std::vector<Func> outputs{loss, d_buf};
+        simple_autoschedule(outputs,
+                            d,
+                            {}, // parameters map
+                            {{}, {{0, 131}, {0, 131}}}, // output bounds (min, max)
+                            cpu_options);
+
+        Buffer<float> output = d_buf.realize(132, 132);
+        check_same(output, ref_d_buf.realize(132, 132), "The gradient");
+    }
 
     debug(0) << "Simple autoschedule test passed\n";
 }
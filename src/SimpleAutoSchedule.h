@@ -4,12 +4,16 @@
 /** \file
  *  A less sophisticated automatic scheduler (compare to AutoSchedule)
  *  It inlines some trivial and element-wise functions (as in AutoSchedule),
+ *  computes producers with small stencils at the tiles of their consumers,
  *  tiles on the rest and parallelize.
  *  It also recognize large reduction and try to rfactor() to increase parallelism.
  *  In addition it supports GPU scheduling.
  */
 
+#include "AutoSchedule.h"
+#include "Derivative.h"
 #include "Func.h"
+#include "Target.h"
 
 #include <string>
 #include <vector>
@@ -26,6 +30,25 @@ struct SimpleAutoscheduleOptions {
     int gpu_tile_height = 16;
     int gpu_tile_channel = 4;
     int unroll_rvar_size = 0;
+    // On CPU, compute a Func read by a single tiled stage with a small
+    // stencil at the tiles of that stage instead of at root
+    bool fuse_producers = false;
+    // On CPU, parallelize large reductions onto small outputs hierarchically
+    // (per-thread vector partials, then a lane-wise merge, then a final
+    // merge) instead of with a single rfactor
+    bool multi_level_rfactor = false;
+    // On CPU, pick the tile sizes, the vector widths and the parallel split
+    // factors of each Func with the RegionCosts cost model instead of using
+    // the fixed sizes above
+    bool search_tile_sizes = false;
+    // Target (for the natural vector sizes) and machine (for the parallelism,
+    // cache size and load cost) the search optimizes for
+    Target target = get_host_target();
+    MachineParams machine_params = MachineParams::generic();
+    // If positive, the searched schedule and the fixed-size schedule are
+    // both JIT compiled and timed for this many runs, and the faster one is
+    // kept. Only applies to pipelines without unbound inputs.
+    int validation_runs = 0;
 };
 
 /**
@@ -38,6 +61,19 @@ void simple_autoschedule(std::vector<Func> &outputs,
                          const std::map<std::string, int> &parameters,
                          const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
                          const SimpleAutoscheduleOptions &options = SimpleAutoscheduleOptions());
+/**
+ *  Schedule a whole training step: the forward outputs together with the
+ *  adjoints in derivative. Forward Funcs (and the Funcs recomputed by
+ *  gradient checkpointing) that are read by a single tiled backward stage
+ *  with a small stencil are computed and stored at the tiles of that stage,
+ *  the rest of the recomputed Funcs are inlined.
+ *  outputs should list both the forward outputs and the gradients.
+ */
+void simple_autoschedule(std::vector<Func> &outputs,
+                         const Derivative &derivative,
+                         const std::map<std::string, int> &parameters,
+                         const std::vector<std::vector<std::pair<int, int>>> &output_bounds,
+                         const SimpleAutoscheduleOptions &options = SimpleAutoscheduleOptions());
 void simple_autoschedule(Func &output,
                          const std::map<std::string, int> &parameters,
                          const std::vector<std::pair<int, int>> &output_bounds,
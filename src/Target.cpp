@@ -270,6 +270,9 @@ const std::map<std::string, Target::Feature> feature_name_map = {
     {"tsan", Target::TSAN},
     {"asan", Target::ASAN},
     {"check_unsafe_promises", Target::CheckUnsafePromises},
+    {"arena_alloc", Target::ArenaAlloc},
+    {"fast_compile", Target::FastCompile},
+    {"pack_allocs", Target::PackAllocs},
     // NOTE: When adding features to this map, be sure to update
     // PyEnums.cpp and halide.cmake as well.
 };
@@ -99,6 +99,9 @@ struct Target {
         TSAN = halide_target_feature_tsan,
         ASAN = halide_target_feature_asan,
         CheckUnsafePromises = halide_target_feature_check_unsafe_promises,
+        ArenaAlloc = halide_target_feature_arena_alloc,
+        FastCompile = halide_target_feature_fast_compile,
+        PackAllocs = halide_target_feature_pack_allocs,
         FeatureEnd = halide_target_feature_end
     };
     Target() : os(OSUnknown), arch(ArchUnknown), bits(0) {}
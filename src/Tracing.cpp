@@ -1,8 +1,11 @@
+#include <algorithm>
+
 #include "Tracing.h"
 #include "IRMutator.h"
 #include "IROperator.h"
 #include "runtime/HalideRuntime.h"
 #include "Bounds.h"
+#include "Random.h"
 #include "RealizationOrder.h"
 
 namespace Halide {
@@ -94,6 +97,39 @@ private:
         }
     }
 
+    // The condition under which a load from or store to f at the
+    // given coordinates is traced, or an undefined Expr if they all
+    // are.
+    Expr trace_condition(const Function &f, const vector<Expr> &coordinates) {
+        Expr condition;
+        const vector<string> args = f.args();
+        for (const Bound &b : f.get_trace_region()) {
+            size_t i = std::find(args.begin(), args.end(), b.var) - args.begin();
+            internal_assert(i < coordinates.size());
+            Expr inside = (coordinates[i] >= b.min &&
+                           coordinates[i] < b.min + b.extent);
+            condition = condition.defined() ? (condition && inside) : inside;
+        }
+        int sample = f.get_trace_sample();
+        if (sample > 1 && !coordinates.empty()) {
+            // Hash the coordinates rather than counting, so that loads
+            // and stores of the same site agree, and so that it works
+            // the same way in parallel loops.
+            Expr chosen = (random_int(coordinates) % make_const(UInt(32), sample)) == 0;
+            condition = condition.defined() ? (condition && chosen) : chosen;
+        }
+        return condition;
+    }
+
+    Expr maybe_trace(const Expr &trace, const Expr &condition) {
+        if (!condition.defined()) {
+            return trace;
+        }
+        // Note: VectorizeLoops special-cases this too.
+        return Call::make(Int(32), Call::if_then_else,
+                          {condition, trace, make_zero(Int(32))}, Call::PureIntrinsic);
+    }
+
     using IRMutator2::visit;
 
     Expr visit(const Call *op) override {
@@ -102,10 +138,13 @@ private:
         internal_assert(op);
         bool trace_it = false;
         Expr trace_parent;
+        // The Function whose tracing options apply, if any
+        const Function *traced = nullptr;
         if (op->call_type == Call::Halide) {
             auto it = env.find(op->name);
             internal_assert(it != env.end()) << op->name << " not in environment\n";
             Function f = it->second;
+            traced = &it->second;
             internal_assert(!f.can_be_inlined() || !f.schedule().compute_level().is_inlined());
 
             trace_it = f.is_tracing_loads() || trace_all_loads;
@@ -128,6 +167,7 @@ private:
                     f.can_be_inlined() &&
                     f.schedule().compute_level().is_inlined()) {
                     trace_it = true;
+                    traced = &it->second;
                     add_trace_tags(op->name, f.get_trace_tags());
                 }
             }
@@ -150,6 +190,9 @@ private:
             builder.parent_id = trace_parent;
             builder.value_index = op->value_index;
             Expr trace = builder.build();
+            if (traced) {
+                trace = maybe_trace(trace, trace_condition(*traced, op->args));
+            }
 
             expr = Let::make(value_var_name, op,
                              Call::make(op->type, Call::return_second,
@@ -179,6 +222,7 @@ private:
             builder.coordinates = op->args;
             builder.event = halide_trace_store;
             builder.parent_id = Variable::make(Int(32), op->name + ".trace_id");
+            Expr condition = trace_condition(f, op->args);
             for (size_t i = 0; i < values.size(); i++) {
                 Type t = values[i].type();
                 add_func_touched(f.name(), (int) i, t);
@@ -188,7 +232,7 @@ private:
                 builder.type = t;
                 builder.value_index = (int)i;
                 builder.value = {value_var};
-                Expr trace = builder.build();
+                Expr trace = maybe_trace(builder.build(), condition);
 
                 traces[i] = Let::make(value_var_name, values[i],
                                       Call::make(t, Call::return_second,
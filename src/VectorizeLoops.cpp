@@ -481,6 +481,19 @@ class VectorSubs : public IRMutator2 {
 
         if (!changed) {
             return op;
+        } else if (op->is_intrinsic(Call::if_then_else) &&
+                   new_args[0].type().is_vector() &&
+                   new_args[1].as<Call>() &&
+                   new_args[1].as<Call>()->name == Call::trace) {
+            // A load or store traced only at some sites (see
+            // Tracing.cpp). There's one trace call for the whole
+            // vector, so make it if any of the lanes would have.
+            Expr condition = extract_lane(new_args[0], 0);
+            for (int k = 1; k < new_args[0].type().lanes(); k++) {
+                condition = condition || extract_lane(new_args[0], k);
+            }
+            return Call::make(op->type, Call::if_then_else,
+                              {condition, new_args[1], new_args[2]}, op->call_type);
         } else if (op->name == Call::trace) {
             const int64_t *event = as_const_int(op->args[6]);
             internal_assert(event != nullptr);
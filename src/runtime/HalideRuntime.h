@@ -177,6 +177,31 @@ extern void halide_join_thread(struct halide_thread *);
  */
 extern int halide_set_num_threads(int n);
 
+/** Select the scheduler of the default thread pool: a single locked
+ * work queue (enabled == 0, the default) or per-thread task ranges with
+ * lock-free stealing (enabled != 0), which scales better on machines with
+ * many cores and with nested parallelism. The initial value can also be
+ * set with the HL_WORK_STEALING environment variable. Should not be called
+ * while a pipeline is running. Returns the old setting.
+ *
+ * The work-stealing pool is sized on first use; changes made with
+ * halide_set_num_threads afterwards take effect once the pool is shut
+ * down with halide_shutdown_thread_pool.
+ */
+extern int halide_set_work_stealing(int enabled);
+
+/** Turn on NUMA-aware scheduling and allocation (on Linux; elsewhere this
+ * does nothing and returns 0). The default thread pool then uses the
+ * work-stealing scheduler with each worker pinned to a cpu, parallel
+ * loops are split node by node, and threads steal from their own node
+ * first. Large allocations made by halide_default_malloc get fresh pages,
+ * which the OS places on the node of the thread that first writes them.
+ * The initial value can also be set with the HL_NUMA environment
+ * variable. Like halide_set_work_stealing, takes effect when the pool is
+ * (re)started. Returns the old setting.
+ */
+extern int halide_set_numa_aware(int enabled);
+
 /** Halide calls these functions to allocate and free memory. To
  * replace in AOT code, use the halide_set_custom_malloc and
  * halide_set_custom_free, or (on platforms that support weak
@@ -205,6 +230,64 @@ extern halide_malloc_t halide_set_custom_malloc(halide_malloc_t user_malloc);
 extern halide_free_t halide_set_custom_free(halide_free_t user_free);
 //@}
 
+/** A pooling allocator, to install with halide_set_custom_malloc and
+ * halide_set_custom_free (or to make halide_default_malloc/free use, by
+ * setting the HL_POOL_ALLOCATOR environment variable to 1). Freed
+ * blocks are cached on free lists by size class, in 16 stripes that
+ * threads are spread over for blocks up to 1MB and in one shared set of
+ * lists for bigger ones, and are reused by later allocations of the
+ * same class, including by later invocations of a pipeline. Blocks are
+ * rounded up by at most a quarter of their size. */
+//@{
+extern void *halide_pool_malloc(void *user_context, size_t x);
+extern void halide_pool_free(void *user_context, void *ptr);
+//@}
+
+/** Set the most memory the pooling allocator keeps cached (1GB by
+ * default, or if max_cached_bytes is negative). Blocks freed past it
+ * are given back to the system, and blocks already cached past it are
+ * released now, largest first. */
+extern void halide_pool_allocator_set_limit(void *user_context, int64_t max_cached_bytes);
+
+/** Release memory cached by the pooling allocator, largest blocks
+ * first, until at most max_cached_bytes are left cached. */
+extern void halide_pool_allocator_trim(void *user_context, int64_t max_cached_bytes);
+
+/** Statistics of the pooling allocator. The reuse rate is
+ * reused / allocations. */
+struct halide_pool_allocator_stats_t {
+    /** Calls to halide_pool_malloc, how many of them were served from
+     * the cache, and how many went to the system. */
+    uint64_t allocations, reused, system_allocations;
+    /** Calls to halide_pool_free, and blocks given back to the system. */
+    uint64_t frees, released;
+    /** Memory currently handed out (rounded up to the size classes) and
+     * cached, and the most ever handed out at once. Blocks over 1GB
+     * bypass the pool and aren't counted. */
+    int64_t bytes_in_use, bytes_cached, peak_bytes_in_use;
+};
+
+extern void halide_pool_allocator_get_stats(void *user_context,
+                                            struct halide_pool_allocator_stats_t *stats);
+
+/** Pipelines compiled with the arena_alloc target feature carve the
+ * heap allocations they make once per call out of a single arena,
+ * acquired with halide_arena_acquire at the start of the call and
+ * released with halide_arena_release at the end. By default the arena
+ * comes from halide_malloc. halide_set_custom_arena supplies a block
+ * to use instead, aligned to at least the alignment halide_malloc
+ * guarantees; it is used by one call at a time, and calls that find it
+ * busy or too small fall back to halide_malloc. Pass NULL to stop using
+ * it. Don't change it while pipelines are running. The carve/uncarve
+ * functions hand out and return the individual buffers. */
+// @{
+extern void halide_set_custom_arena(void *arena, size_t size);
+extern void *halide_arena_acquire(void *user_context, uint64_t size);
+extern void halide_arena_release(void *user_context, void *arena);
+extern void *halide_arena_carve(void *arena, uint64_t offset);
+extern void halide_arena_uncarve(void *user_context, void *ptr);
+// @}
+
 /** Halide calls these functions to interact with the underlying
  * system runtime functions. To replace in AOT code on platforms that
  * support weak linking, define these functions yourself, or use
@@ -518,6 +601,14 @@ extern void halide_set_trace_file(int fd);
  * information to stdout. */
 extern int halide_get_trace_file(void *user_context);
 
+/** Make the default halide_trace buffer binary trace events in
+ * per-thread rings, drained to the trace file by a background thread,
+ * instead of in a single buffer shared by all threads. This perturbs
+ * the timing of parallel pipelines much less. The file written is the
+ * same. The initial value can also be set with the HL_TRACE_RING
+ * environment variable. Returns the old setting. */
+extern int halide_set_trace_ring_buffers(int enabled);
+
 /** If tracing is writing to a file. This call closes that file
  * (flushing the trace). Returns zero on success. */
 extern int halide_shutdown_trace();
@@ -706,6 +797,88 @@ extern int halide_get_gpu_device(void *user_context);
  */
 extern void halide_memoization_cache_set_size(void *user_context, int64_t size);
 
+/** How the memoization cache chooses which unused results to evict
+ * when it is over its size. The cache is split into shards by key hash
+ * to reduce lock contention, but the size is shared by all of them, and
+ * the victim is the best one under the policy among all the shards. */
+typedef enum halide_memoization_eviction_policy_t {
+    /** The least recently used result first. This is the default. */
+    halide_memoization_evict_lru = 0,
+    /** Among the few least recently used results, the one that took the
+     * least time to compute per byte. */
+    halide_memoization_evict_cost_aware = 1,
+    /** Among the few least recently used results, the largest. */
+    halide_memoization_evict_size_aware = 2,
+} halide_memoization_eviction_policy_t;
+
+/** Set the eviction policy of the memoization cache. Takes effect the
+ * next time the cache is pruned. Recompute times are only measured for
+ * results computed while the cost-aware policy is active. */
+extern void halide_memoization_cache_set_eviction_policy(void *user_context,
+                                                         halide_memoization_eviction_policy_t policy);
+
+/** Add a persistent second tier to the memoization cache. Results
+ * evicted from memory, and all remaining results when the cache is
+ * cleaned up, are appended to two log files in directory, and a lookup
+ * that misses in memory reads a matching result back (after checking
+ * its key, shape and a checksum of its contents) instead of recomputing
+ * it. Results stay valid across processes as long as the memoized
+ * Funcs keep their names and algorithms; use a new directory (or
+ * memoize tags) when they change. The files are kept under max_bytes
+ * in total (1GB if max_bytes is 0, and at most 4GB) by discarding the
+ * older file when the newer one is full. Pass a NULL directory to turn
+ * the tier off. The initial directory can also be set with the
+ * HL_MEMOIZE_CACHE_DIR environment variable. Returns 0 on success.
+ */
+extern int halide_memoization_cache_set_disk_tier(void *user_context, const char *directory,
+                                                  int64_t max_bytes);
+
+/** Statistics of the memoization cache, for sizing it. */
+struct halide_memoization_cache_stats_t {
+    /** Lookups that found the result in memory. */
+    uint64_t hits;
+    /** Lookups that read the result back from the disk tier. */
+    uint64_t disk_hits;
+    /** Lookups after which the result had to be computed. */
+    uint64_t misses;
+    /** Results added to memory (including the ones read back from disk). */
+    uint64_t stores;
+    /** Results evicted from memory to stay within the cache size. */
+    uint64_t evictions;
+    /** Results written to the disk tier. */
+    uint64_t disk_spills;
+    /** The size and number of the results currently in memory, and the
+     * number of outstanding uses of them (lookups not yet released).
+     * Results in use can't be evicted. */
+    int64_t bytes_resident;
+    int64_t entries_resident;
+    int64_t in_use_pins;
+};
+
+/** Statistics of the memoization cache for the results of one
+ * memoized Func. The cache key doesn't include the pipeline, so a Func
+ * memoized by several pipelines gets one set of statistics. The name
+ * points to storage owned by the runtime. */
+struct halide_memoization_cache_func_stats_t {
+    const char *name;
+    struct halide_memoization_cache_stats_t stats;
+};
+
+/** Get the statistics of the memoization cache since the start of the
+ * process or the last halide_memoization_cache_reset_stats. */
+extern void halide_memoization_cache_get_stats(void *user_context,
+                                               struct halide_memoization_cache_stats_t *stats);
+
+/** Get the statistics of each memoized Func (up to 256 of them) into
+ * stats, which has room for max_funcs entries. Returns the number of
+ * Funcs, which may be more than max_funcs. */
+extern int halide_memoization_cache_get_func_stats(void *user_context,
+                                                   struct halide_memoization_cache_func_stats_t *stats,
+                                                   int max_funcs);
+
+/** Reset the event counts of the memoization cache statistics. */
+extern void halide_memoization_cache_reset_stats(void *user_context);
+
 /** Given a cache key for a memoized result, currently constructed
  *  from the Func name and top-level Func name plus the arguments of
  *  the computation, determine if the result is in the cache and
@@ -1138,7 +1311,10 @@ typedef enum halide_target_feature_t {
     halide_target_feature_asan = 53, ///< Enable hooks for ASAN support.
     halide_target_feature_d3d12compute = 54, ///< Enable Direct3D 12 Compute runtime.
     halide_target_feature_check_unsafe_promises = 55, ///< Insert assertions for promises.
-    halide_target_feature_end = 56 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
+    halide_target_feature_arena_alloc = 56, ///< Carve the heap allocations made once per call out of a single arena.
+    halide_target_feature_fast_compile = 57, ///< Run a minimal set of LLVM passes, trading the speed of the code for the speed of compilation.
+    halide_target_feature_pack_allocs = 58, ///< Let heap allocations with disjoint lifetimes share storage.
+    halide_target_feature_end = 59 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
 } halide_target_feature_t;
 
 /** This function is called internally by Halide in some situations to determine
@@ -1484,6 +1660,35 @@ struct halide_filter_metadata_t {
  * the -profile target flag, which runs a sampling profiler thread
  * alongside the pipeline. */
 
+/** The hardware event counters the sampling profiler can attribute to
+ * each Func. See halide_profiler_set_counters. */
+enum halide_profiler_counter_t {
+    halide_profiler_cycles = 0,
+    halide_profiler_instructions,
+    halide_profiler_cache_misses, ///< Usually last level cache misses
+    halide_profiler_branch_misses,
+    halide_profiler_counter_count
+};
+
+/** The number of buckets in a latency histogram. */
+enum {
+    halide_profiler_latency_buckets = 656
+};
+
+/** A histogram of latencies in nanoseconds. Buckets are spaced
+ * logarithmically, with 16 buckets per power of two, so percentiles
+ * are accurate to within about 6%. */
+struct halide_profiler_latency_histogram {
+    /** The number of latencies recorded, their sum, and the largest. */
+    uint64_t count, total, max;
+
+    /** The number of latencies falling in each bucket. Bucket i < 16
+     * holds latencies of i ns. Above that, bucket 16 * k + m holds
+     * latencies in [(16 + m) << (k - 1), (17 + m) << (k - 1)). The
+     * last bucket also holds anything larger. */
+    uint64_t buckets[halide_profiler_latency_buckets];
+};
+
 /** Per-Func state tracked by the sampling profiler. */
 struct halide_profiler_func_stats {
     /** Total time taken evaluating this Func (in nanoseconds). */
@@ -1509,6 +1714,17 @@ struct halide_profiler_func_stats {
 
     /** The total number of memory allocation of this Func. */
     int num_allocs;
+
+    /** Hardware event counts while computing this Func, indexed by
+     * halide_profiler_counter_t. Counted over all the threads of the
+     * process (see halide_profiler_set_counters). Zero unless counters
+     * are enabled. */
+    uint64_t counters[halide_profiler_counter_count];
+
+    /** The time taken to compute this Func in each call to the
+     * pipeline, for Funcs computed at root. Null until the first is
+     * recorded. */
+    struct halide_profiler_latency_histogram *latency;
 };
 
 /** Per-pipeline state tracked by the sampling profiler. These exist
@@ -1554,6 +1770,16 @@ struct halide_profiler_pipeline_stats {
 
     /** The total number of memory allocation of funcs in this pipeline. */
     int num_allocs;
+
+    /** Hardware event counts while inside this pipeline, indexed by
+     * halide_profiler_counter_t. Counted over all the threads of the
+     * process (see halide_profiler_set_counters). Zero unless counters
+     * are enabled. */
+    uint64_t counters[halide_profiler_counter_count];
+
+    /** The time taken by each call to the pipeline that
+     * succeeded. Null until the first is recorded. */
+    struct halide_profiler_latency_histogram *latency;
 };
 
 /** The global state of the profiler. */
@@ -1623,6 +1849,41 @@ extern void halide_profiler_reset();
  * state without grabbing the global profiler state's lock. */
 void halide_profiler_shutdown();
 
+/** Also attribute hardware event counts (cycles, instructions, cache
+ * misses and branch misses) to each Func. The counts are per process,
+ * not per pipeline: the sampling thread reads the counters of every
+ * thread in the process, Halide's or not, and attributes the events
+ * since its last sample to the Func running at the time. Work done by
+ * other threads while a pipeline runs is therefore included. Only
+ * supported on x86 Linux, subject to the perf_event_paranoid setting;
+ * elsewhere the counts stay zero. The initial value can also be set
+ * with the HL_PROFILER_COUNTERS environment variable. Returns the old
+ * setting. */
+extern int halide_profiler_set_counters(int enabled);
+
+/** Turn the sampling thread on or off. With it off, pipelines still
+ * record latency histograms, and memory statistics, but not the time
+ * taken by each Func. The initial value can also be set with the
+ * HL_PROFILER_SAMPLING environment variable (default on). Takes
+ * effect the next time a pipeline is run. Returns the old setting. */
+extern int halide_profiler_set_sampling(int enabled);
+
+/** Return the given percentile (between 0 and 100) of the latencies of
+ * calls to the named pipeline, or if func_name is non-null, of the
+ * time taken to compute that Func within those calls, in nanoseconds.
+ * Returns zero if none have been recorded. This function grabs the
+ * global profiler state's lock on entry. */
+extern uint64_t halide_profiler_latency_percentile(const char *pipeline_name,
+                                                   const char *func_name,
+                                                   float percentile);
+
+/** Write the latency histograms of all pipelines and Funcs as JSON
+ * into buf, truncating it (but always null-terminating it) if it's
+ * longer than size bytes. Returns the length of the whole JSON
+ * string, like snprintf. This function grabs the global profiler
+ * state's lock on entry. */
+extern int halide_profiler_latency_json(char *buf, int size);
+
 /** Print out timing statistics for everything run since the last
  * reset. Also happens at process exit. */
 extern void halide_profiler_report(void *user_context);
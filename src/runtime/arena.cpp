@@ -0,0 +1,64 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+// Per-call arenas for pipelines compiled with the arena_alloc target
+// feature. The lowering pass sizes the arena from the allocation
+// bounds, and each buffer is a fixed offset into it, so there's nothing
+// to track here beyond the optional caller-supplied block.
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK void *custom_arena = NULL;
+WEAK size_t custom_arena_size = 0;
+// Set while a call is using the custom arena
+WEAK int custom_arena_in_use = 0;
+
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK void halide_set_custom_arena(void *arena, size_t size) {
+    custom_arena = arena;
+    custom_arena_size = arena ? size : 0;
+    __atomic_store_n(&custom_arena_in_use, 0, __ATOMIC_SEQ_CST);
+}
+
+WEAK void *halide_arena_acquire(void *user_context, uint64_t size) {
+    void *arena = custom_arena;
+    const size_t alignment = halide_malloc_alignment();
+    if (arena != NULL &&
+        size <= (uint64_t)custom_arena_size &&
+        ((size_t)arena & (alignment - 1)) == 0) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&custom_arena_in_use, &expected, 1, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            return arena;
+        }
+    }
+    if (size > (uint64_t)(size_t)(-1)) {
+        // Too big for this address space. Will result in a failed
+        // assertion and a call to halide_error.
+        return NULL;
+    }
+    // The arena can be empty if every stage in it is skipped, but a
+    // null pointer would look like a failed allocation.
+    return halide_malloc(user_context, size == 0 ? 1 : (size_t)size);
+}
+
+WEAK void halide_arena_release(void *user_context, void *arena) {
+    if (arena != NULL && arena == custom_arena) {
+        __atomic_store_n(&custom_arena_in_use, 0, __ATOMIC_SEQ_CST);
+        return;
+    }
+    halide_free(user_context, arena);
+}
+
+WEAK void *halide_arena_carve(void *arena, uint64_t offset) {
+    return (uint8_t *)arena + offset;
+}
+
+WEAK void halide_arena_uncarve(void *user_context, void *ptr) {
+    // Nothing to do; the memory goes back with the arena.
+}
+
+}
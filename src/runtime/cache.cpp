@@ -74,12 +74,18 @@ struct CacheEntry {
     uint8_t *key;
     uint32_t hash;
     uint32_t in_use_count; // 0 if none returned from halide_cache_lookup
+    // Value of cache_clock when the entry was last stored or hit
+    uint64_t last_used;
     uint32_t tuple_count;
     // The shape of the computed data. There may be more data allocated than this.
     int32_t dimensions;
     halide_dimension_t *computed_bounds;
     // The actual stored data.
     halide_buffer_t *buf;
+    // Total size of the tuple buffers, and the time it took to compute
+    // them (0 if it wasn't measured).
+    int64_t size_in_bytes;
+    int64_t compute_time_ns;
 
     bool init(const uint8_t *cache_key, size_t cache_key_size,
               uint32_t key_hash,
@@ -93,6 +99,9 @@ struct CacheEntry {
 struct CacheBlockHeader {
     CacheEntry *entry;
     uint32_t hash;
+    // When the lookup that missed allocated this block, if the eviction
+    // policy needs compute times.
+    int64_t start_time_ns;
 };
 
 // Each host block has extra space to store a header just before the
@@ -114,6 +123,7 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
                            uint32_t key_hash, const halide_buffer_t *computed_bounds_buf,
                            int32_t tuples, halide_buffer_t **tuple_buffers) {
     next = NULL;
+    last_used = 0;
     more_recent = NULL;
     less_recent = NULL;
     key_size = cache_key_size;
@@ -121,6 +131,8 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
     in_use_count = 0;
     tuple_count = tuples;
     dimensions = computed_bounds_buf->dimensions;
+    size_in_bytes = 0;
+    compute_time_ns = 0;
 
     // Allocate all the necessary space (or die)
     size_t storage_bytes = 0;
@@ -165,6 +177,7 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
         for (int j = 0; j < dimensions; j++) {
             buf[i].dim[j] = tuple_buffers[i]->dim[j];
         }
+        size_in_bytes += buf[i].size_in_bytes();
     }
     return true;
 }
@@ -177,57 +190,255 @@ WEAK void CacheEntry::destroy(void *user_context) {
     halide_free(user_context, metadata_storage);
 }
 
-WEAK uint32_t djb_hash(const uint8_t *key, size_t key_size)  {
-    uint32_t h = 5381;
-    for (size_t i = 0; i < key_size; i++) {
-        h = (h << 5) + h + key[i];
+WEAK __attribute__((always_inline)) uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Hash the key eight bytes at a time in four independent lanes, so that
+// the main loop has no serial dependence from one word to the next and
+// the compiler can keep the lanes in vector registers. Keys are mostly
+// a few dozen bytes of scalar arguments, so this matters less than
+// avoiding the byte-at-a-time loop. The mixing constants are those of
+// xxHash64.
+WEAK uint64_t key_hash64(const uint8_t *key, size_t key_size)  {
+    const uint64_t p1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t p2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t p3 = 0x165667B19E3779F9ULL;
+    uint64_t lanes[4] = {p1 + p2, p2, 0, (uint64_t)0 - p1};
+    size_t i = 0;
+    for (; i + 32 <= key_size; i += 32) {
+        for (int l = 0; l < 4; l++) {
+            uint64_t word;
+            memcpy(&word, key + i + 8 * l, sizeof(word));
+            lanes[l] = rotl64(lanes[l] + word * p2, 31) * p1;
+        }
+    }
+    uint64_t h = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) +
+                 rotl64(lanes[2], 12) + rotl64(lanes[3], 18) + key_size;
+    for (; i + 8 <= key_size; i += 8) {
+        uint64_t word;
+        memcpy(&word, key + i, sizeof(word));
+        h = rotl64(h ^ (rotl64(word * p2, 31) * p1), 27) * p1 + p3;
     }
+    for (; i < key_size; i++) {
+        h = rotl64(h ^ (key[i] * p3), 11) * p1;
+    }
+    h ^= h >> 33;
+    h *= p2;
+    h ^= h >> 29;
+    h *= p3;
+    h ^= h >> 32;
     return h;
 }
 
-WEAK halide_mutex memoization_lock = { { 0 } };
+WEAK uint32_t key_hash(const uint8_t *key, size_t key_size)  {
+    return (uint32_t)key_hash64(key, key_size);
+}
 
+// The cache is split into independent shards, each with its own lock,
+// hash table and recency list, so that concurrent lookups of different
+// keys rarely contend. The size budget is shared: the total size is
+// kept in a global counter, and eviction picks the best victim among
+// the shards. The high half of the key hash picks the shard and the
+// low bits the bucket.
+const size_t kCacheShards = 16;
 const size_t kHashTableSize = 256;
 
-WEAK CacheEntry *cache_entries[kHashTableSize];
+struct CacheShard {
+    halide_mutex lock;
+    CacheEntry *entries[kHashTableSize];
+    CacheEntry *most_recently_used;
+    CacheEntry *least_recently_used;
+    int64_t current_size;
+};
 
-WEAK CacheEntry *most_recently_used = NULL;
-WEAK CacheEntry *least_recently_used = NULL;
+WEAK CacheShard cache_shards[kCacheShards];
+
+WEAK __attribute__((always_inline)) CacheShard *shard_for_hash(uint32_t h) {
+    return &cache_shards[(h >> 16) % kCacheShards];
+}
 
 // HACK for siggraph paper: default cache size is huge so we don't have to think about it
 const uint64_t kDefaultCacheSize = 1LL << 32LL;
 WEAK int64_t max_cache_size = kDefaultCacheSize;
-WEAK int64_t current_cache_size = 0;
+
+// The total size of the entries of all shards
+WEAK int64_t cache_total_size = 0;
+
+// Orders the entries of all shards by recency
+WEAK uint64_t cache_clock = 0;
+
+WEAK bool cache_over_budget() {
+    return __atomic_load_n(&cache_total_size, __ATOMIC_SEQ_CST) >
+        __atomic_load_n(&max_cache_size, __ATOMIC_SEQ_CST);
+}
+
+WEAK halide_memoization_eviction_policy_t eviction_policy = halide_memoization_evict_lru;
+
+// How many of the least recently used entries the cost and size aware
+// policies choose among.
+const int kEvictionWindow = 8;
+
+// Statistics. The event counters are updated atomically outside the
+// shard locks, in total and per memoized Func; the resident sizes are
+// computed from the shards when the statistics are queried.
+struct CacheCounters {
+    uint64_t hits;
+    uint64_t disk_hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+    uint64_t disk_spills;
+};
+
+WEAK CacheCounters cache_counters;
+
+const size_t kMaxFuncStats = 256;
+const size_t kMaxFuncNameLength = 128;
+
+struct FuncCacheStats {
+    // Hash of the Func name part of the key, or 0 if the slot is free
+    uint64_t name_hash;
+    // Nonzero once name has been filled in
+    int ready;
+    char name[kMaxFuncNameLength];
+    CacheCounters counters;
+};
+
+// An open addressed table keyed by name_hash. Slots are never freed.
+WEAK FuncCacheStats func_cache_stats[kMaxFuncStats];
+
+// Memoization keys start with the length of the Func name, followed by
+// the name packed four characters to a 32-bit word, then a hash of the
+// Func's definition and the parameters (see Memoization.cpp). Returns the number of bytes of the key holding the
+// name, or 0 if the key doesn't look like that.
+WEAK size_t func_name_key_bytes(const uint8_t *key, size_t key_size) {
+    if (key_size < 4) {
+        return 0;
+    }
+    uint32_t length;
+    memcpy(&length, key, sizeof(length));
+    size_t bytes = 4 + (((size_t)length + 3) & ~(size_t)3);
+    return bytes <= key_size ? bytes : 0;
+}
+
+WEAK void decode_func_name(const uint8_t *key, char *name, size_t name_size) {
+    uint32_t length;
+    memcpy(&length, key, sizeof(length));
+    size_t i = 0;
+    for (; i < length && i + 1 < name_size; i++) {
+        uint32_t word;
+        memcpy(&word, key + 4 + (i & ~(size_t)3), sizeof(word));
+        // The first character of a word is in its most significant
+        // used byte; the last word may hold fewer than four.
+        size_t in_word = length - (i & ~(size_t)3);
+        if (in_word > 4) {
+            in_word = 4;
+        }
+        name[i] = (char)((word >> (8 * (in_word - 1 - (i & 3)))) & 0xff);
+    }
+    name[i] = 0;
+}
+
+// The statistics slot of the Func a key belongs to, claiming a free one
+// if insert is set. NULL if the key is malformed or the table is full.
+WEAK FuncCacheStats *func_stats_for_key(const uint8_t *key, size_t key_size, bool insert) {
+    size_t name_bytes = func_name_key_bytes(key, key_size);
+    if (name_bytes == 0) {
+        return NULL;
+    }
+    uint64_t h = key_hash64(key, name_bytes) | 1;
+    for (size_t i = 0; i < kMaxFuncStats; i++) {
+        FuncCacheStats *fs = &func_cache_stats[(h + i) % kMaxFuncStats];
+        uint64_t slot_hash = __atomic_load_n(&fs->name_hash, __ATOMIC_SEQ_CST);
+        if (slot_hash == 0 && insert) {
+            if (__atomic_compare_exchange_n(&fs->name_hash, &slot_hash, h, false,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                decode_func_name(key, fs->name, sizeof(fs->name));
+                __atomic_store_n(&fs->ready, 1, __ATOMIC_SEQ_CST);
+                return fs;
+            }
+            // Someone else claimed it; slot_hash now holds their hash.
+        }
+        if (slot_hash == h) {
+            return fs;
+        }
+        if (slot_hash == 0) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+WEAK void count_cache_event(const uint8_t *key, size_t key_size, uint64_t CacheCounters::*counter) {
+    __atomic_add_fetch(&(cache_counters.*counter), 1, __ATOMIC_SEQ_CST);
+    FuncCacheStats *fs = func_stats_for_key(key, key_size, true);
+    if (fs) {
+        __atomic_add_fetch(&(fs->counters.*counter), 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+WEAK void copy_counters(const CacheCounters &counters, halide_memoization_cache_stats_t *stats) {
+    stats->hits = __atomic_load_n(&counters.hits, __ATOMIC_SEQ_CST);
+    stats->disk_hits = __atomic_load_n(&counters.disk_hits, __ATOMIC_SEQ_CST);
+    stats->misses = __atomic_load_n(&counters.misses, __ATOMIC_SEQ_CST);
+    stats->stores = __atomic_load_n(&counters.stores, __ATOMIC_SEQ_CST);
+    stats->evictions = __atomic_load_n(&counters.evictions, __ATOMIC_SEQ_CST);
+    stats->disk_spills = __atomic_load_n(&counters.disk_spills, __ATOMIC_SEQ_CST);
+    stats->bytes_resident = 0;
+    stats->entries_resident = 0;
+    stats->in_use_pins = 0;
+}
+
+WEAK void reset_counters(CacheCounters *counters) {
+    __atomic_store_n(&counters->hits, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->disk_hits, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->misses, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->stores, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->evictions, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->disk_spills, 0, __ATOMIC_SEQ_CST);
+}
+
+WEAK void add_resident(const CacheEntry *entry, halide_memoization_cache_stats_t *stats) {
+    stats->bytes_resident += entry->size_in_bytes;
+    stats->entries_resident++;
+    stats->in_use_pins += entry->in_use_count;
+}
 
 #if CACHE_DEBUGGING
-WEAK void validate_cache() {
-    print(NULL) << "validating cache, "
-                << "current size " << current_cache_size
+WEAK void validate_cache(CacheShard *shard) {
+    print(NULL) << "validating cache shard " << (int)(shard - cache_shards) << ", "
+                << "current size " << shard->current_size
+                << ", total size " << cache_total_size
                 << " of maximum " << max_cache_size << "\n";
     int entries_in_hash_table = 0;
     for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
+        CacheEntry *entry = shard->entries[i];
         while (entry != NULL) {
             entries_in_hash_table++;
-            if (entry->more_recent == NULL && entry != most_recently_used) {
+            if (entry->more_recent == NULL && entry != shard->most_recently_used) {
                 halide_print(NULL, "cache invalid case 1\n");
                 __builtin_trap();
             }
-            if (entry->less_recent == NULL && entry != least_recently_used) {
+            if (entry->less_recent == NULL && entry != shard->least_recently_used) {
                 halide_print(NULL, "cache invalid case 2\n");
                 __builtin_trap();
             }
+            if (shard_for_hash(entry->hash) != shard) {
+                halide_print(NULL, "cache invalid case 5\n");
+                __builtin_trap();
+            }
             entry = entry->next;
         }
     }
     int entries_from_mru = 0;
-    CacheEntry *mru_chain = most_recently_used;
+    CacheEntry *mru_chain = shard->most_recently_used;
     while (mru_chain != NULL) {
         entries_from_mru++;
         mru_chain = mru_chain->less_recent;
     }
     int entries_from_lru = 0;
-    CacheEntry *lru_chain = least_recently_used;
+    CacheEntry *lru_chain = shard->least_recently_used;
     while (lru_chain != NULL) {
         entries_from_lru++;
         lru_chain = lru_chain->more_recent;
@@ -243,187 +454,555 @@ WEAK void validate_cache() {
         halide_print(NULL, "cache invalid case 4\n");
         __builtin_trap();
     }
-    if (current_cache_size < 0) {
+    if (shard->current_size < 0) {
         halide_print(NULL, "cache size is negative\n");
         __builtin_trap();
     }
 }
 #endif
 
-WEAK void prune_cache(void *user_context) {
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
-    CacheEntry *prune_candidate = least_recently_used;
-    while (current_cache_size > max_cache_size &&
-           prune_candidate != NULL) {
-        CacheEntry *more_recent = prune_candidate->more_recent;
-
-        if (prune_candidate->in_use_count == 0) {
-            uint32_t h = prune_candidate->hash;
-            uint32_t index = h % kHashTableSize;
-
-            // Remove from hash table
-            CacheEntry *prev_hash_entry = cache_entries[index];
-            if (prev_hash_entry == prune_candidate) {
-                cache_entries[index] = prune_candidate->next;
-            } else {
-                while (prev_hash_entry != NULL && prev_hash_entry->next != prune_candidate) {
-                    prev_hash_entry = prev_hash_entry->next;
-                }
-                halide_assert(NULL, prev_hash_entry != NULL);
-                prev_hash_entry->next = prune_candidate->next;
-            }
-
-            // Remove from less recent chain.
-            if (least_recently_used == prune_candidate) {
-                least_recently_used = more_recent;
-            }
-            if (more_recent != NULL) {
-                more_recent->less_recent = prune_candidate->less_recent;
-            }
-
-            // Remove from more recent chain.
-            if (most_recently_used == prune_candidate) {
-                most_recently_used = prune_candidate->less_recent;
-            }
-            if (prune_candidate->less_recent != NULL) {
-                prune_candidate->less_recent = more_recent;
-            }
+// Whether a is a better entry to evict than b under the policy.
+WEAK bool evict_before(const CacheEntry *a, const CacheEntry *b,
+                       halide_memoization_eviction_policy_t policy) {
+    if (policy == halide_memoization_evict_lru) {
+        return a->last_used < b->last_used;
+    } else if (policy == halide_memoization_evict_cost_aware) {
+        // Least recompute time per byte freed first.
+        return (double)a->compute_time_ns * (double)b->size_in_bytes <
+               (double)b->compute_time_ns * (double)a->size_in_bytes;
+    } else {
+        // Largest first.
+        return a->size_in_bytes > b->size_in_bytes;
+    }
+}
 
-            // Decrease cache used amount.
-            for (uint32_t i = 0; i < prune_candidate->tuple_count; i++) {
-                current_cache_size -= prune_candidate->buf[i].size_in_bytes();
-            }
+// Choose the next entry to evict from a shard, or NULL if all of them
+// are in use. Must be called with the shard lock held.
+WEAK CacheEntry *choose_eviction_victim(CacheShard *shard,
+                                        halide_memoization_eviction_policy_t policy) {
+    CacheEntry *victim = NULL;
+    int candidates = 0;
+    for (CacheEntry *entry = shard->least_recently_used;
+         entry != NULL && candidates < kEvictionWindow;
+         entry = entry->more_recent) {
+        if (entry->in_use_count != 0) {
+            continue;
+        }
+        if (policy == halide_memoization_evict_lru) {
+            return entry;
+        }
+        // Ties go to the less recently used entry.
+        if (victim == NULL || evict_before(entry, victim, policy)) {
+            victim = entry;
+        }
+        candidates++;
+    }
+    return victim;
+}
 
-            // Deallocate the entry.
-            prune_candidate->destroy(user_context);
-            halide_free(user_context, prune_candidate);
+// Unlink an entry from the hash table and the recency list of its
+// shard. Must be called with the shard lock held.
+WEAK void remove_entry(CacheShard *shard, CacheEntry *entry) {
+    uint32_t index = entry->hash % kHashTableSize;
+    CacheEntry *prev_hash_entry = shard->entries[index];
+    if (prev_hash_entry == entry) {
+        shard->entries[index] = entry->next;
+    } else {
+        while (prev_hash_entry != NULL && prev_hash_entry->next != entry) {
+            prev_hash_entry = prev_hash_entry->next;
         }
+        halide_assert(NULL, prev_hash_entry != NULL);
+        prev_hash_entry->next = entry->next;
+    }
 
-        prune_candidate = more_recent;
+    if (entry->more_recent != NULL) {
+        entry->more_recent->less_recent = entry->less_recent;
+    } else {
+        halide_assert(NULL, shard->most_recently_used == entry);
+        shard->most_recently_used = entry->less_recent;
     }
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+    if (entry->less_recent != NULL) {
+        entry->less_recent->more_recent = entry->more_recent;
+    } else {
+        halide_assert(NULL, shard->least_recently_used == entry);
+        shard->least_recently_used = entry->more_recent;
+    }
+
+    shard->current_size -= entry->size_in_bytes;
+    __atomic_sub_fetch(&cache_total_size, entry->size_in_bytes, __ATOMIC_SEQ_CST);
 }
 
-}}} // namespace Halide::Runtime::Internal
+// The optional on-disk tier. Entries evicted from memory, and all of
+// them at cleanup, are appended as records to one of two log files in a
+// directory. When the current file would grow past half the size cap,
+// the other one is truncated and becomes current, so the total stays
+// under the cap and only the older records are dropped. An index from
+// key to record is built by scanning the files on first use, and a
+// lookup that misses in memory reads the record back, checks it, and
+// reinserts it. All file access goes through stdio, which every
+// runtime platform has. fseek takes a long, which is 32 bits on Windows
+// and 32-bit targets, so each file is capped at 2GB.
+
+#define DISK_CACHE_MAGIC 0x6d656d48  // "Hmem"
+#define DISK_CACHE_VERSION 1
+
+struct DiskRecordHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Hash of the key and the computed bounds, and of the contents
+    uint64_t lookup_hash;
+    uint64_t payload_hash;
+    uint64_t payload_bytes;
+    uint32_t key_size;
+    int32_t dimensions;
+    int32_t tuple_count;
+    uint32_t padding;
+    // Followed by the key, the computed bounds, the type and shape of
+    // each tuple buffer, and then the contents of each tuple buffer.
+};
 
-extern "C" {
+struct DiskIndexEntry {
+    uint64_t lookup_hash;
+    int32_t file;
+    int64_t offset;
+    // The next (older) entry in the same bucket, or -1
+    int32_t next;
+};
 
-WEAK void halide_memoization_cache_set_size(void *user_context, int64_t size) {
-    if (size == 0) {
-        size = kDefaultCacheSize;
-    }
+struct DiskTier {
+    // Protects everything below, and serializes file access
+    halide_mutex lock;
+    // Whether HL_MEMOIZE_CACHE_DIR has been read
+    bool initialized;
+    bool enabled;
+    bool index_loaded;
+    char paths[2][1024];
+    int64_t file_bytes[2];
+    int32_t current;
+    int64_t max_bytes;
+    // The records in the order they were written, and a hash table of
+    // them keyed by lookup_hash, with index_capacity buckets each
+    // holding the first entry of a chain.
+    DiskIndexEntry *index;
+    int32_t *index_buckets;
+    int32_t index_size, index_capacity;
+};
 
-    ScopedMutexLock lock(&memoization_lock);
+WEAK DiskTier disk_tier;
 
-    max_cache_size = size;
-    prune_cache(user_context);
+const int64_t kDefaultDiskCacheSize = 1LL << 30;
+const int64_t kMaxDiskCacheFileSize = 0x7fffffffLL;
+
+WEAK size_t disk_record_metadata_bytes(size_t key_size, int32_t dimensions, int32_t tuple_count) {
+    return sizeof(DiskRecordHeader) + key_size +
+        sizeof(halide_dimension_t) * dimensions * (tuple_count + 1) +
+        sizeof(halide_type_t) * tuple_count;
 }
 
-WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
-                                         halide_buffer_t *computed_bounds, int32_t tuple_count, halide_buffer_t **tuple_buffers) {
-    uint32_t h = djb_hash(cache_key, size);
-    uint32_t index = h % kHashTableSize;
+WEAK uint64_t disk_lookup_hash(const uint8_t *key, size_t key_size,
+                               const halide_dimension_t *computed_bounds, int32_t dimensions,
+                               int32_t tuple_count) {
+    uint64_t h = key_hash64(key, key_size);
+    h = (h << 17 | h >> 47) + key_hash64((const uint8_t *)computed_bounds,
+                                         sizeof(halide_dimension_t) * dimensions);
+    return h + tuple_count;
+}
 
-    ScopedMutexLock lock(&memoization_lock);
+WEAK uint64_t disk_payload_hash(const halide_buffer_t *bufs, int32_t tuple_count) {
+    uint64_t h = 0;
+    for (int32_t i = 0; i < tuple_count; i++) {
+        h = h * 0x9E3779B185EBCA87ULL + key_hash64(bufs[i].host, bufs[i].size_in_bytes());
+    }
+    return h;
+}
 
-#if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
+// The capacity is a power of two, so the low bits of the hash pick the
+// bucket.
+WEAK __attribute__((always_inline)) int32_t disk_index_bucket(uint64_t lookup_hash) {
+    return (int32_t)(lookup_hash & (uint64_t)(disk_tier.index_capacity - 1));
+}
 
-    debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
+// Chain the entries into their buckets, oldest first so that each
+// chain starts with the most recent record.
+WEAK void disk_index_rehash() {
+    for (int32_t i = 0; i < disk_tier.index_capacity; i++) {
+        disk_tier.index_buckets[i] = -1;
+    }
+    for (int32_t i = 0; i < disk_tier.index_size; i++) {
+        int32_t bucket = disk_index_bucket(disk_tier.index[i].lookup_hash);
+        disk_tier.index[i].next = disk_tier.index_buckets[bucket];
+        disk_tier.index_buckets[bucket] = i;
+    }
+}
 
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            debug_print_buffer(user_context, "Allocation bounds", *buf);
+WEAK void disk_index_add(uint64_t lookup_hash, int32_t file, int64_t offset) {
+    if (disk_tier.index_size == disk_tier.index_capacity) {
+        int32_t new_capacity = disk_tier.index_capacity ? disk_tier.index_capacity * 2 : 256;
+        DiskIndexEntry *new_index =
+            (DiskIndexEntry *)halide_malloc(NULL, sizeof(DiskIndexEntry) * new_capacity);
+        int32_t *new_buckets =
+            (int32_t *)halide_malloc(NULL, sizeof(int32_t) * new_capacity);
+        if (!new_index || !new_buckets) {
+            if (new_index) {
+                halide_free(NULL, new_index);
+            }
+            if (new_buckets) {
+                halide_free(NULL, new_buckets);
+            }
+            return;
         }
+        if (disk_tier.index) {
+            memcpy(new_index, disk_tier.index, sizeof(DiskIndexEntry) * disk_tier.index_size);
+            halide_free(NULL, disk_tier.index);
+            halide_free(NULL, disk_tier.index_buckets);
+        }
+        disk_tier.index = new_index;
+        disk_tier.index_buckets = new_buckets;
+        disk_tier.index_capacity = new_capacity;
+        disk_index_rehash();
     }
-#endif
+    int32_t i = disk_tier.index_size++;
+    DiskIndexEntry &e = disk_tier.index[i];
+    e.lookup_hash = lookup_hash;
+    e.file = file;
+    e.offset = offset;
+    int32_t bucket = disk_index_bucket(lookup_hash);
+    e.next = disk_tier.index_buckets[bucket];
+    disk_tier.index_buckets[bucket] = i;
+}
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
+WEAK void disk_index_drop_file(int32_t file) {
+    int32_t kept = 0;
+    for (int32_t i = 0; i < disk_tier.index_size; i++) {
+        if (disk_tier.index[i].file != file) {
+            disk_tier.index[kept++] = disk_tier.index[i];
+        }
+    }
+    disk_tier.index_size = kept;
+    if (disk_tier.index) {
+        disk_index_rehash();
+    }
+}
 
-            // Check all the tuple buffers have the same bounds (they should).
-            bool all_bounds_equal = true;
-            for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
-            }
+// The most recent record with the given hash, or NULL.
+WEAK DiskIndexEntry *disk_index_find(uint64_t lookup_hash) {
+    if (!disk_tier.index) {
+        return NULL;
+    }
+    for (int32_t i = disk_tier.index_buckets[disk_index_bucket(lookup_hash)];
+         i >= 0; i = disk_tier.index[i].next) {
+        if (disk_tier.index[i].lookup_hash == lookup_hash) {
+            return &disk_tier.index[i];
+        }
+    }
+    return NULL;
+}
 
-            if (all_bounds_equal) {
-                if (entry != most_recently_used) {
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    if (entry->less_recent != NULL) {
-                        entry->less_recent->more_recent = entry->more_recent;
-                    } else {
-                        halide_assert(user_context, least_recently_used == entry);
-                        least_recently_used = entry->more_recent;
-                    }
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    entry->more_recent->less_recent = entry->less_recent;
+// Add the records of a log file to the index. A truncated last record
+// is indexed too; reading it back fails the checks.
+WEAK void disk_scan_file(int32_t file) {
+    disk_tier.file_bytes[file] = 0;
+    void *f = fopen(disk_tier.paths[file], "rb");
+    if (!f) {
+        return;
+    }
+    int64_t offset = 0;
+    DiskRecordHeader header;
+    while (fread(&header, sizeof(header), 1, f) == 1 &&
+           header.magic == DISK_CACHE_MAGIC && header.version == DISK_CACHE_VERSION) {
+        disk_index_add(header.lookup_hash, file, offset);
+        int64_t record_bytes =
+            disk_record_metadata_bytes(header.key_size, header.dimensions, header.tuple_count) +
+            header.payload_bytes;
+        if (offset + record_bytes > kMaxDiskCacheFileSize) {
+            // Written with a larger cap; count it as full, so that it is
+            // dropped rather than appended to.
+            offset = kMaxDiskCacheFileSize;
+            break;
+        }
+        offset += record_bytes;
+        if (fseek(f, (long)(record_bytes - sizeof(header)), 1 /* SEEK_CUR */) != 0) {
+            break;
+        }
+    }
+    fclose(f);
+    disk_tier.file_bytes[file] = offset;
+}
 
-                    entry->more_recent = NULL;
-                    entry->less_recent = most_recently_used;
-                    if (most_recently_used != NULL) {
-                        most_recently_used->more_recent = entry;
-                    }
-                    most_recently_used = entry;
-                }
+// Must be called with the disk tier lock held.
+WEAK void disk_load_index() {
+    if (disk_tier.index_loaded) {
+        return;
+    }
+    disk_scan_file(0);
+    disk_scan_file(1);
+    disk_tier.current = disk_tier.file_bytes[0] < disk_tier.max_bytes / 2 ? 0 : 1;
+    disk_tier.index_loaded = true;
+}
 
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    halide_buffer_t *buf = tuple_buffers[i];
-                    *buf = entry->buf[i];
-                }
+// Must be called with the disk tier lock held.
+WEAK void disk_tier_configure(const char *directory, int64_t max_bytes) {
+    if (disk_tier.index) {
+        halide_free(NULL, disk_tier.index);
+        halide_free(NULL, disk_tier.index_buckets);
+    }
+    disk_tier.index = NULL;
+    disk_tier.index_buckets = NULL;
+    disk_tier.index_size = disk_tier.index_capacity = 0;
+    disk_tier.index_loaded = false;
+    disk_tier.max_bytes = max_bytes > 0 ? max_bytes : kDefaultDiskCacheSize;
+    if (disk_tier.max_bytes / 2 > kMaxDiskCacheFileSize) {
+        disk_tier.max_bytes = 2 * kMaxDiskCacheFileSize;
+    }
+    if (directory) {
+        for (int32_t file = 0; file < 2; file++) {
+            char *end = disk_tier.paths[file] + sizeof(disk_tier.paths[file]);
+            char *dst = halide_string_to_string(disk_tier.paths[file], end, directory);
+            dst = halide_string_to_string(dst, end, file ? "/halide_memoize.1.log" : "/halide_memoize.0.log");
+        }
+    }
+    __atomic_store_n(&disk_tier.enabled, directory != NULL, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&disk_tier.initialized, true, __ATOMIC_SEQ_CST);
+}
 
-                entry->in_use_count += tuple_count;
+WEAK bool disk_tier_active() {
+    if (!__atomic_load_n(&disk_tier.initialized, __ATOMIC_SEQ_CST)) {
+        ScopedMutexLock lock(&disk_tier.lock);
+        if (!disk_tier.initialized) {
+            disk_tier_configure(getenv("HL_MEMOIZE_CACHE_DIR"), kDefaultDiskCacheSize);
+        }
+    }
+    return __atomic_load_n(&disk_tier.enabled, __ATOMIC_SEQ_CST);
+}
 
-                return 0;
-            }
+// Append an entry to the current log file, unless it is already on disk.
+WEAK void disk_spill(void *user_context, const CacheEntry *entry) {
+    uint64_t payload_bytes = 0;
+    for (uint32_t i = 0; i < entry->tuple_count; i++) {
+        if (entry->buf[i].device_dirty()) {
+            // The host copy is stale.
+            return;
         }
-        entry = entry->next;
+        payload_bytes += entry->buf[i].size_in_bytes();
+    }
+    int64_t record_bytes =
+        disk_record_metadata_bytes(entry->key_size, entry->dimensions, entry->tuple_count) + payload_bytes;
+    uint64_t lookup_hash = disk_lookup_hash(entry->key, entry->key_size, entry->computed_bounds,
+                                            entry->dimensions, entry->tuple_count);
+
+    ScopedMutexLock lock(&disk_tier.lock);
+    if (!disk_tier.enabled || record_bytes > disk_tier.max_bytes / 2) {
+        return;
+    }
+    disk_load_index();
+    if (disk_index_find(lookup_hash)) {
+        return;
+    }
+    if (disk_tier.file_bytes[disk_tier.current] + record_bytes > disk_tier.max_bytes / 2) {
+        // Drop the older file and start appending to it.
+        int32_t other = 1 - disk_tier.current;
+        void *f = fopen(disk_tier.paths[other], "wb");
+        if (f) {
+            fclose(f);
+        }
+        disk_index_drop_file(other);
+        disk_tier.file_bytes[other] = 0;
+        disk_tier.current = other;
     }
 
-    for (int32_t i = 0; i < tuple_count; i++) {
-        halide_buffer_t *buf = tuple_buffers[i];
+    void *f = fopen(disk_tier.paths[disk_tier.current], "ab");
+    if (!f) {
+        return;
+    }
+    fseek(f, 0, 2 /* SEEK_END */);
+    int64_t offset = ftell(f);
+
+    DiskRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = DISK_CACHE_MAGIC;
+    header.version = DISK_CACHE_VERSION;
+    header.lookup_hash = lookup_hash;
+    header.payload_hash = disk_payload_hash(entry->buf, entry->tuple_count);
+    header.payload_bytes = payload_bytes;
+    header.key_size = entry->key_size;
+    header.dimensions = entry->dimensions;
+    header.tuple_count = entry->tuple_count;
+
+    size_t dims_bytes = sizeof(halide_dimension_t) * entry->dimensions;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(entry->key, entry->key_size, 1, f) == 1;
+    ok = ok && (dims_bytes == 0 || fwrite(entry->computed_bounds, dims_bytes, 1, f) == 1);
+    for (uint32_t i = 0; ok && i < entry->tuple_count; i++) {
+        ok = fwrite(&entry->buf[i].type, sizeof(halide_type_t), 1, f) == 1 &&
+            (dims_bytes == 0 || fwrite(entry->buf[i].dim, dims_bytes, 1, f) == 1);
+    }
+    for (uint32_t i = 0; ok && i < entry->tuple_count; i++) {
+        size_t bytes = entry->buf[i].size_in_bytes();
+        ok = bytes == 0 || fwrite(entry->buf[i].host, bytes, 1, f) == 1;
+    }
+    fclose(f);
 
-        buf->host = ((uint8_t *)halide_malloc(user_context, buf->size_in_bytes() + header_bytes()));
-        if (buf->host == NULL) {
-            for (int32_t j = i; j > 0; j--) {
-                halide_free(user_context, get_pointer_to_header(tuple_buffers[j - 1]->host));
-                tuple_buffers[j - 1]->host = NULL;
-            }
-            return -1;
+    if (ok) {
+        disk_index_add(lookup_hash, disk_tier.current, offset);
+        count_cache_event(entry->key, entry->key_size, &CacheCounters::disk_spills);
+        disk_tier.file_bytes[disk_tier.current] = offset + record_bytes;
+    } else {
+        debug(user_context) << "Failed to spill a memoized result to " << disk_tier.paths[disk_tier.current] << "\n";
+    }
+}
+
+// Read the record for a key back into freshly allocated tuple buffers.
+// Returns whether it was found and passed all the checks.
+WEAK bool disk_load(void *user_context, const uint8_t *cache_key, int32_t size,
+                    const halide_buffer_t *computed_bounds,
+                    int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    uint64_t lookup_hash = disk_lookup_hash(cache_key, size, computed_bounds->dim,
+                                            computed_bounds->dimensions, tuple_count);
+
+    char path[sizeof(disk_tier.paths[0])];
+    int64_t offset;
+    {
+        ScopedMutexLock lock(&disk_tier.lock);
+        if (!disk_tier.enabled) {
+            return false;
         }
-        buf->host += header_bytes();
-        CacheBlockHeader *header = get_pointer_to_header(buf->host);
-        header->hash = h;
-        header->entry = NULL;
+        disk_load_index();
+        DiskIndexEntry *index_entry = disk_index_find(lookup_hash);
+        if (!index_entry) {
+            return false;
+        }
+        memcpy(path, disk_tier.paths[index_entry->file], sizeof(path));
+        offset = index_entry->offset;
     }
 
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+    // The record is read without the lock. If a spill drops the file in
+    // the meantime, the checks below fail and the lookup misses.
+    void *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    int32_t dimensions = computed_bounds->dimensions;
+    size_t metadata_bytes = disk_record_metadata_bytes(size, dimensions, tuple_count);
+    uint8_t *metadata = (uint8_t *)halide_malloc(user_context, metadata_bytes);
+    bool ok = metadata != NULL &&
+        fseek(f, (long)offset, 0 /* SEEK_SET */) == 0 &&
+        fread(metadata, metadata_bytes, 1, f) == 1;
+
+    // Check the record is for this key, bounds and tuple buffer shapes.
+    if (ok) {
+        const DiskRecordHeader *header = (const DiskRecordHeader *)metadata;
+        uint64_t payload_bytes = 0;
+        for (int32_t i = 0; i < tuple_count; i++) {
+            payload_bytes += tuple_buffers[i]->size_in_bytes();
+        }
+        ok = header->magic == DISK_CACHE_MAGIC &&
+            header->version == DISK_CACHE_VERSION &&
+            header->lookup_hash == lookup_hash &&
+            header->key_size == (uint32_t)size &&
+            header->dimensions == dimensions &&
+            header->tuple_count == tuple_count &&
+            header->payload_bytes == payload_bytes;
+        const uint8_t *key = metadata + sizeof(DiskRecordHeader);
+        const uint8_t *shapes = key + size;
+        size_t dims_bytes = sizeof(halide_dimension_t) * dimensions;
+        ok = ok && keys_equal(key, cache_key, size) &&
+            buffer_has_shape(computed_bounds, (const halide_dimension_t *)shapes);
+        shapes += dims_bytes;
+        for (int32_t i = 0; ok && i < tuple_count; i++) {
+            halide_type_t type;
+            memcpy(&type, shapes, sizeof(type));
+            shapes += sizeof(type);
+            ok = type == tuple_buffers[i]->type &&
+                buffer_has_shape(tuple_buffers[i], (const halide_dimension_t *)shapes);
+            shapes += dims_bytes;
+        }
+    }
 
-    return 1;
+    // Read the contents and check they weren't corrupted.
+    for (int32_t i = 0; ok && i < tuple_count; i++) {
+        size_t bytes = tuple_buffers[i]->size_in_bytes();
+        ok = bytes == 0 || fread(tuple_buffers[i]->host, bytes, 1, f) == 1;
+    }
+    if (ok) {
+        uint64_t payload_hash = 0;
+        for (int32_t i = 0; i < tuple_count; i++) {
+            payload_hash = payload_hash * 0x9E3779B185EBCA87ULL +
+                key_hash64(tuple_buffers[i]->host, tuple_buffers[i]->size_in_bytes());
+        }
+        ok = payload_hash == ((const DiskRecordHeader *)metadata)->payload_hash;
+    }
+
+    fclose(f);
+    if (metadata) {
+        halide_free(user_context, metadata);
+    }
+    return ok;
 }
 
-WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache_key, int32_t size,
-                                        halide_buffer_t *computed_bounds,
-                                        int32_t tuple_count, halide_buffer_t **tuple_buffers) {
-    debug(user_context) << "halide_memoization_cache_store\n";
+// Free entries unlinked from the cache, spilling them to the disk tier
+// first if it is on.
+WEAK void free_evicted_entries(void *user_context, CacheEntry *evicted) {
+    bool spill = evicted != NULL && disk_tier_active();
+    while (evicted != NULL) {
+        CacheEntry *next = evicted->next;
+        if (spill) {
+            disk_spill(user_context, evicted);
+        }
+        evicted->destroy(user_context);
+        halide_free(user_context, evicted);
+        evicted = next;
+    }
+}
 
-    uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
+// Evict unused entries until the cache is within its size. Each round
+// visits the shards one at a time to find the best victim under the
+// policy, then locks its shard again to evict it, so no two shard locks
+// are ever held at once. Concurrent lookups may change the victim of a
+// shard in between, which only makes the choice approximate. Must be
+// called without any shard lock held.
+WEAK void prune_cache(void *user_context) {
+    halide_memoization_eviction_policy_t policy =
+        __atomic_load_n(&eviction_policy, __ATOMIC_SEQ_CST);
+    CacheEntry *evicted = NULL;
+    while (cache_over_budget()) {
+        CacheShard *best_shard = NULL;
+        CacheEntry best;
+        for (size_t s = 0; s < kCacheShards; s++) {
+            ScopedMutexLock lock(&cache_shards[s].lock);
+            CacheEntry *victim = choose_eviction_victim(&cache_shards[s], policy);
+            if (victim != NULL && (best_shard == NULL || evict_before(victim, &best, policy))) {
+                best = *victim;
+                best_shard = &cache_shards[s];
+            }
+        }
+        if (best_shard == NULL) {
+            // Everything left is in use
+            break;
+        }
+        ScopedMutexLock lock(&best_shard->lock);
+        CacheEntry *victim = choose_eviction_victim(best_shard, policy);
+        if (victim == NULL || !cache_over_budget()) {
+            continue;
+        }
+        remove_entry(best_shard, victim);
+        count_cache_event(victim->key, victim->key_size, &CacheCounters::evictions);
+        victim->next = evicted;
+        evicted = victim;
+#if CACHE_DEBUGGING
+        validate_cache(best_shard);
+#endif
+    }
+    free_evicted_entries(user_context, evicted);
+}
 
+// The body of halide_memoization_cache_store. Must be called with the
+// shard lock held; the cache is pruned once it is released.
+WEAK int store_in_shard(void *user_context, CacheShard *shard, uint32_t h,
+                        int64_t compute_time_ns, const uint8_t *cache_key, int32_t size,
+                        halide_buffer_t *computed_bounds,
+                        int32_t tuple_count, halide_buffer_t **tuple_buffers) {
     uint32_t index = h % kHashTableSize;
 
-    ScopedMutexLock lock(&memoization_lock);
-
 #if CACHE_DEBUGGING
     debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
 
@@ -437,7 +1016,7 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
     }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
+    CacheEntry *entry = shard->entries[index];
     while (entry != NULL) {
         if (entry->hash == h && entry->key_size == (size_t)size &&
             keys_equal(entry->key, cache_key, size) &&
@@ -476,17 +1055,12 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
             added_size += buf->size_in_bytes();
         }
     }
-    current_cache_size += added_size;
-    prune_cache(user_context);
-
     CacheEntry *new_entry = (CacheEntry *)halide_malloc(NULL, sizeof(CacheEntry));
     bool inited = false;
     if (new_entry) {
         inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers);
     }
     if (!inited) {
-        current_cache_size -= added_size;
-
         // This entry is still in use by the caller. Mark it as having no cache entry
         // so halide_memoization_cache_release can free the buffer.
         for (int32_t i = 0; i < tuple_count; i++) {
@@ -498,32 +1072,251 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
         }
         return 0;
     }
-
-    new_entry->next = cache_entries[index];
-    new_entry->less_recent = most_recently_used;
-    if (most_recently_used != NULL) {
-        most_recently_used->more_recent = new_entry;
+    new_entry->compute_time_ns = compute_time_ns;
+    new_entry->last_used = __atomic_add_fetch(&cache_clock, 1, __ATOMIC_SEQ_CST);
+    shard->current_size += added_size;
+    __atomic_add_fetch(&cache_total_size, (int64_t)added_size, __ATOMIC_SEQ_CST);
+
+    new_entry->next = shard->entries[index];
+    new_entry->less_recent = shard->most_recently_used;
+    if (shard->most_recently_used != NULL) {
+        shard->most_recently_used->more_recent = new_entry;
     }
-    most_recently_used = new_entry;
-    if (least_recently_used == NULL) {
-        least_recently_used = new_entry;
+    shard->most_recently_used = new_entry;
+    if (shard->least_recently_used == NULL) {
+        shard->least_recently_used = new_entry;
     }
-    cache_entries[index] = new_entry;
+    shard->entries[index] = new_entry;
 
     new_entry->in_use_count = tuple_count;
+    count_cache_event(cache_key, size, &CacheCounters::stores);
 
     for (int32_t i = 0; i < tuple_count; i++) {
         get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
     }
 
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_cache(shard);
 #endif
-    debug(user_context) << "Exiting halide_memoization_cache_store\n";
 
     return 0;
 }
 
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK void halide_memoization_cache_set_size(void *user_context, int64_t size) {
+    if (size == 0) {
+        size = kDefaultCacheSize;
+    }
+
+    __atomic_store_n(&max_cache_size, size, __ATOMIC_SEQ_CST);
+    prune_cache(user_context);
+}
+
+WEAK void halide_memoization_cache_set_eviction_policy(void *user_context,
+                                                       halide_memoization_eviction_policy_t policy) {
+    __atomic_store_n(&eviction_policy, policy, __ATOMIC_SEQ_CST);
+}
+
+WEAK int halide_memoization_cache_set_disk_tier(void *user_context, const char *directory,
+                                                int64_t max_bytes) {
+    if (directory != NULL && strlen(directory) + 32 > sizeof(disk_tier.paths[0])) {
+        error(user_context) << "Memoization cache directory name is too long: " << directory << "\n";
+        return halide_error_code_generic_error;
+    }
+    ScopedMutexLock lock(&disk_tier.lock);
+    disk_tier_configure(directory, max_bytes);
+    return 0;
+}
+
+WEAK void halide_memoization_cache_get_stats(void *user_context, halide_memoization_cache_stats_t *stats) {
+    copy_counters(cache_counters, stats);
+    for (size_t s = 0; s < kCacheShards; s++) {
+        ScopedMutexLock lock(&cache_shards[s].lock);
+        for (CacheEntry *entry = cache_shards[s].most_recently_used; entry != NULL;
+             entry = entry->less_recent) {
+            add_resident(entry, stats);
+        }
+    }
+}
+
+WEAK int halide_memoization_cache_get_func_stats(void *user_context,
+                                                 halide_memoization_cache_func_stats_t *stats,
+                                                 int max_funcs) {
+    // Where each slot's statistics go in stats, or -1
+    int16_t output_index[kMaxFuncStats];
+    int num_funcs = 0;
+    for (size_t i = 0; i < kMaxFuncStats; i++) {
+        output_index[i] = -1;
+        FuncCacheStats *fs = &func_cache_stats[i];
+        if (!__atomic_load_n(&fs->ready, __ATOMIC_SEQ_CST)) {
+            continue;
+        }
+        if (num_funcs < max_funcs) {
+            output_index[i] = (int16_t)num_funcs;
+            stats[num_funcs].name = fs->name;
+            copy_counters(fs->counters, &stats[num_funcs].stats);
+        }
+        num_funcs++;
+    }
+    for (size_t s = 0; s < kCacheShards; s++) {
+        ScopedMutexLock lock(&cache_shards[s].lock);
+        for (CacheEntry *entry = cache_shards[s].most_recently_used; entry != NULL;
+             entry = entry->less_recent) {
+            FuncCacheStats *fs = func_stats_for_key(entry->key, entry->key_size, false);
+            if (fs && output_index[fs - func_cache_stats] >= 0) {
+                add_resident(entry, &stats[output_index[fs - func_cache_stats]].stats);
+            }
+        }
+    }
+    return num_funcs;
+}
+
+WEAK void halide_memoization_cache_reset_stats(void *user_context) {
+    reset_counters(&cache_counters);
+    for (size_t i = 0; i < kMaxFuncStats; i++) {
+        reset_counters(&func_cache_stats[i].counters);
+    }
+}
+
+WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
+                                         halide_buffer_t *computed_bounds, int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    uint32_t h = key_hash(cache_key, size);
+    uint32_t index = h % kHashTableSize;
+    CacheShard *shard = shard_for_hash(h);
+
+    {
+        ScopedMutexLock lock(&shard->lock);
+
+#if CACHE_DEBUGGING
+        debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
+
+        debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
+
+        {
+            for (int32_t i = 0; i < tuple_count; i++) {
+                halide_buffer_t *buf = tuple_buffers[i];
+                debug_print_buffer(user_context, "Allocation bounds", *buf);
+            }
+        }
+#endif
+
+        CacheEntry *entry = shard->entries[index];
+        while (entry != NULL) {
+            if (entry->hash == h && entry->key_size == (size_t)size &&
+                keys_equal(entry->key, cache_key, size) &&
+                buffer_has_shape(computed_bounds, entry->computed_bounds) &&
+                entry->tuple_count == (uint32_t)tuple_count) {
+
+                // Check all the tuple buffers have the same bounds (they should).
+                bool all_bounds_equal = true;
+                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                    all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
+                }
+
+                if (all_bounds_equal) {
+                    if (entry != shard->most_recently_used) {
+                        halide_assert(user_context, entry->more_recent != NULL);
+                        if (entry->less_recent != NULL) {
+                            entry->less_recent->more_recent = entry->more_recent;
+                        } else {
+                            halide_assert(user_context, shard->least_recently_used == entry);
+                            shard->least_recently_used = entry->more_recent;
+                        }
+                        halide_assert(user_context, entry->more_recent != NULL);
+                        entry->more_recent->less_recent = entry->less_recent;
+
+                        entry->more_recent = NULL;
+                        entry->less_recent = shard->most_recently_used;
+                        if (shard->most_recently_used != NULL) {
+                            shard->most_recently_used->more_recent = entry;
+                        }
+                        shard->most_recently_used = entry;
+                    }
+
+                    for (int32_t i = 0; i < tuple_count; i++) {
+                        halide_buffer_t *buf = tuple_buffers[i];
+                        *buf = entry->buf[i];
+                    }
+
+                    entry->in_use_count += tuple_count;
+                    entry->last_used = __atomic_add_fetch(&cache_clock, 1, __ATOMIC_SEQ_CST);
+                    count_cache_event(cache_key, size, &CacheCounters::hits);
+
+                    return 0;
+                }
+            }
+            entry = entry->next;
+        }
+    }
+
+    // A miss. Allocate the buffers to compute into outside the lock.
+    int64_t start_time_ns = 0;
+    if (__atomic_load_n(&eviction_policy, __ATOMIC_SEQ_CST) == halide_memoization_evict_cost_aware) {
+        halide_start_clock(user_context);
+        start_time_ns = halide_current_time_ns(user_context);
+    }
+    for (int32_t i = 0; i < tuple_count; i++) {
+        halide_buffer_t *buf = tuple_buffers[i];
+
+        buf->host = ((uint8_t *)halide_malloc(user_context, buf->size_in_bytes() + header_bytes()));
+        if (buf->host == NULL) {
+            for (int32_t j = i; j > 0; j--) {
+                halide_free(user_context, get_pointer_to_header(tuple_buffers[j - 1]->host));
+                tuple_buffers[j - 1]->host = NULL;
+            }
+            return -1;
+        }
+        buf->host += header_bytes();
+        CacheBlockHeader *header = get_pointer_to_header(buf->host);
+        header->hash = h;
+        header->entry = NULL;
+        header->start_time_ns = start_time_ns;
+    }
+
+    if (disk_tier_active() &&
+        disk_load(user_context, cache_key, size, computed_bounds, tuple_count, tuple_buffers)) {
+        count_cache_event(cache_key, size, &CacheCounters::disk_hits);
+        // Put it back in memory. Storing returns the buffers in use, as
+        // for a hit.
+        halide_memoization_cache_store(user_context, cache_key, size, computed_bounds,
+                                       tuple_count, tuple_buffers);
+        return 0;
+    }
+
+    count_cache_event(cache_key, size, &CacheCounters::misses);
+    return 1;
+}
+
+WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache_key, int32_t size,
+                                        halide_buffer_t *computed_bounds,
+                                        int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    debug(user_context) << "halide_memoization_cache_store\n";
+
+    CacheBlockHeader *first_header = get_pointer_to_header(tuple_buffers[0]->host);
+    uint32_t h = first_header->hash;
+    CacheShard *shard = shard_for_hash(h);
+
+    int64_t compute_time_ns = 0;
+    if (first_header->start_time_ns != 0) {
+        compute_time_ns = halide_current_time_ns(user_context) - first_header->start_time_ns;
+    }
+
+    int result;
+    {
+        ScopedMutexLock lock(&shard->lock);
+        result = store_in_shard(user_context, shard, h, compute_time_ns, cache_key, size,
+                                computed_bounds, tuple_count, tuple_buffers);
+    }
+    prune_cache(user_context);
+
+    debug(user_context) << "Exiting halide_memoization_cache_store\n";
+
+    return result;
+}
+
 WEAK void halide_memoization_cache_release(void *user_context, void *host) {
     CacheBlockHeader *header = get_pointer_to_header((uint8_t *)host);
     debug(user_context) << "halide_memoization_cache_release\n";
@@ -532,12 +1325,13 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
     if (entry == NULL) {
         halide_free(user_context, header);
     } else {
-        ScopedMutexLock lock(&memoization_lock);
+        CacheShard *shard = shard_for_hash(header->hash);
+        ScopedMutexLock lock(&shard->lock);
 
         halide_assert(user_context, entry->in_use_count > 0);
         entry->in_use_count--;
 #if CACHE_DEBUGGING
-        validate_cache();
+        validate_cache(shard);
 #endif
     }
 
@@ -546,19 +1340,20 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
 
 WEAK void halide_memoization_cache_cleanup(void *user_context) {
     debug(NULL) << "halide_memoization_cache_cleanup\n";
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        cache_entries[i] = NULL;
-        while (entry != NULL) {
-            CacheEntry *next = entry->next;
-            entry->destroy(user_context);
-            halide_free(user_context, entry);
-            entry = next;
+    for (size_t s = 0; s < kCacheShards; s++) {
+        CacheShard *shard = &cache_shards[s];
+        for (size_t i = 0; i < kHashTableSize; i++) {
+            // Entries are chained through next, so a bucket is already a
+            // list free_evicted_entries can take.
+            CacheEntry *entry = shard->entries[i];
+            shard->entries[i] = NULL;
+            free_evicted_entries(user_context, entry);
         }
+        __atomic_sub_fetch(&cache_total_size, shard->current_size, __ATOMIC_SEQ_CST);
+        shard->current_size = 0;
+        shard->most_recently_used = NULL;
+        shard->least_recently_used = NULL;
     }
-    current_cache_size = 0;
-    most_recently_used = NULL;
-    least_recently_used = NULL;
 }
 
 namespace {
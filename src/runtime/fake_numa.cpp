@@ -0,0 +1,39 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+// NUMA support for platforms where it isn't implemented: a single node,
+// and the NUMA mode can't be turned on.
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK bool halide_numa_enabled() {
+    return false;
+}
+
+WEAK int halide_numa_node_count() {
+    return 1;
+}
+
+WEAK int halide_numa_node_of_cpu(int cpu) {
+    return 0;
+}
+
+WEAK void halide_numa_pin_thread(int cpu) {
+}
+
+WEAK void *halide_numa_alloc_pages(size_t size) {
+    return NULL;
+}
+
+WEAK void halide_numa_free_pages(void *ptr, size_t size) {
+}
+
+}}}  // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK int halide_set_numa_aware(int enabled) {
+    return 0;
+}
+
+}
@@ -0,0 +1,20 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+// Hardware event counters for the profiler on platforms where they
+// aren't implemented.
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK bool halide_perf_counters_scan_threads() {
+    return false;
+}
+
+WEAK bool halide_perf_counters_read(uint64_t *totals) {
+    return false;
+}
+
+WEAK void halide_perf_counters_close() {
+}
+
+}}}  // namespace Halide::Runtime::Internal
@@ -51,6 +51,10 @@ WEAK int halide_set_num_threads(int n) {
     return 1;
 }
 
+WEAK int halide_set_work_stealing(int enabled) {
+    return 0;
+}
+
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
     halide_do_task_t result = custom_do_task;
     custom_do_task = f;
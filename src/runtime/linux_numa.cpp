@@ -0,0 +1,131 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+extern "C" {
+
+extern int sched_setaffinity(int pid, size_t cpusetsize, const void *mask);
+extern void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+extern int munmap(void *addr, size_t length);
+
+}
+
+#define NUMA_MAX_CPUS 1024
+
+// Values shared by x86 and ARM Linux. Other architectures (e.g. MIPS, where
+// MAP_ANONYMOUS is 0x800) link fake_numa instead.
+#define NUMA_PROT_READ_WRITE 0x3
+#define NUMA_MAP_PRIVATE_ANONYMOUS 0x22
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// -1 until decided from HL_NUMA on first use
+WEAK int numa_mode = -1;
+
+// The node of each cpu, read from sysfs on first use
+WEAK int16_t numa_cpu_nodes[NUMA_MAX_CPUS];
+WEAK int numa_node_count = 1;
+WEAK int numa_topology_read = 0;
+
+// Assign the cpus of a sysfs cpu list such as "0-3,8-11" to a node.
+WEAK void numa_parse_cpulist(const char *list, int node) {
+    const char *c = list;
+    while (*c >= '0' && *c <= '9') {
+        int first = 0;
+        while (*c >= '0' && *c <= '9') {
+            first = first * 10 + (*c++ - '0');
+        }
+        int last = first;
+        if (*c == '-') {
+            c++;
+            last = 0;
+            while (*c >= '0' && *c <= '9') {
+                last = last * 10 + (*c++ - '0');
+            }
+        }
+        for (int cpu = first; cpu <= last && cpu < NUMA_MAX_CPUS; cpu++) {
+            numa_cpu_nodes[cpu] = (int16_t)node;
+        }
+        if (*c == ',') {
+            c++;
+        }
+    }
+}
+
+WEAK void numa_read_topology() {
+    if (__atomic_load_n(&numa_topology_read, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    // Racing readers compute the same values, so no lock is needed.
+    int node_count = 1;
+    for (int node = 0; node < NUMA_MAX_CPUS; node++) {
+        char path[64];
+        char *end = path + sizeof(path);
+        char *dst = halide_string_to_string(path, end, "/sys/devices/system/node/node");
+        dst = halide_int64_to_string(dst, end, node, 1);
+        halide_string_to_string(dst, end, "/cpulist");
+        void *file = fopen(path, "r");
+        if (!file) {
+            break;
+        }
+        char list[1024];
+        size_t bytes = fread(list, 1, sizeof(list) - 1, file);
+        fclose(file);
+        list[bytes] = 0;
+        numa_parse_cpulist(list, node);
+        node_count = node + 1;
+    }
+    numa_node_count = node_count;
+    __atomic_store_n(&numa_topology_read, 1, __ATOMIC_SEQ_CST);
+}
+
+WEAK bool halide_numa_enabled() {
+    int mode = __atomic_load_n(&numa_mode, __ATOMIC_SEQ_CST);
+    if (mode < 0) {
+        char *numa_str = getenv("HL_NUMA");
+        mode = (numa_str && atoi(numa_str) != 0) ? 1 : 0;
+        __atomic_store_n(&numa_mode, mode, __ATOMIC_SEQ_CST);
+    }
+    return mode != 0;
+}
+
+WEAK int halide_numa_node_count() {
+    numa_read_topology();
+    return numa_node_count;
+}
+
+WEAK int halide_numa_node_of_cpu(int cpu) {
+    numa_read_topology();
+    return (cpu >= 0 && cpu < NUMA_MAX_CPUS) ? numa_cpu_nodes[cpu] : 0;
+}
+
+WEAK void halide_numa_pin_thread(int cpu) {
+    if (cpu < 0 || cpu >= NUMA_MAX_CPUS) {
+        return;
+    }
+    uint64_t mask[NUMA_MAX_CPUS / 64];
+    memset(mask, 0, sizeof(mask));
+    mask[cpu / 64] = (uint64_t)1 << (cpu % 64);
+    // pid 0 is the calling thread
+    sched_setaffinity(0, sizeof(mask), mask);
+}
+
+WEAK void *halide_numa_alloc_pages(size_t size) {
+    void *ptr = mmap(NULL, size, NUMA_PROT_READ_WRITE, NUMA_MAP_PRIVATE_ANONYMOUS, -1, 0);
+    return ptr == (void *)-1 ? NULL : ptr;
+}
+
+WEAK void halide_numa_free_pages(void *ptr, size_t size) {
+    munmap(ptr, size);
+}
+
+}}}  // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK int halide_set_numa_aware(int enabled) {
+    int old = halide_numa_enabled() ? 1 : 0;
+    __atomic_store_n(&numa_mode, enabled ? 1 : 0, __ATOMIC_SEQ_CST);
+    return old;
+}
+
+}
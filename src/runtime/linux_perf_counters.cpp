@@ -0,0 +1,203 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+// Hardware event counters for the profiler, using perf_event_open. The
+// kernel only counts events per thread (inherited counters can't be
+// read until the threads exit), so we look for the threads of the
+// process in /proc/self/task and open a group of counters on each.
+
+extern "C" {
+
+extern int syscall(int num, ...);
+extern ssize_t read(int fd, void *buf, size_t count);
+
+}
+
+// The syscall numbers vary across platforms. This module is only used
+// on x86.
+#ifdef BITS_64
+#define SYS_PERF_EVENT_OPEN 298
+#define SYS_GETDENTS64 217
+#define SYS_GETTID 186
+#endif
+
+#ifdef BITS_32
+#define SYS_PERF_EVENT_OPEN 336
+#define SYS_GETDENTS64 220
+#define SYS_GETTID 224
+#endif
+
+#define PERF_TYPE_HARDWARE 0
+#define PERF_FORMAT_GROUP 8
+// The disabled, exclude_kernel and exclude_hv bits of the flags
+#define PERF_FLAG_DISABLED (1 << 0)
+#define PERF_FLAG_EXCLUDE_KERNEL (1 << 5)
+#define PERF_FLAG_EXCLUDE_HV (1 << 6)
+// From ioctl.h
+#define PERF_EVENT_IOC_ENABLE 0x2400
+#define PERF_IOC_FLAG_GROUP 1
+
+#define PERF_MAX_THREADS 256
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// The first version of struct perf_event_attr. The kernel accepts it
+// from newer userspace too.
+struct perf_event_attr_v0 {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t flags;
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t config1;
+};
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+// The PERF_COUNT_HW_* event for each halide_profiler_counter_t
+const static uint64_t perf_counter_events[halide_profiler_counter_count] = {
+    0,  // PERF_COUNT_HW_CPU_CYCLES
+    1,  // PERF_COUNT_HW_INSTRUCTIONS
+    3,  // PERF_COUNT_HW_CACHE_MISSES, usually the last level cache
+    5,  // PERF_COUNT_HW_BRANCH_MISSES
+};
+
+struct perf_thread {
+    int tid;
+    // The group leader, which counts cycles
+    int fd;
+    // The other members of the group, or -1 if the event isn't
+    // supported
+    int member_fds[halide_profiler_counter_count - 1];
+};
+
+// Only used by the profiler thread.
+WEAK perf_thread perf_threads[PERF_MAX_THREADS];
+WEAK int perf_thread_count = 0;
+// Set if a group couldn't be opened on a thread, e.g. because there's
+// no PMU or the perf_event_paranoid setting doesn't allow it.
+WEAK bool perf_counters_unavailable = false;
+
+WEAK int perf_event_open(uint64_t event, int tid, int group_fd) {
+    perf_event_attr_v0 attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = event;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.flags = PERF_FLAG_EXCLUDE_KERNEL | PERF_FLAG_EXCLUDE_HV;
+    if (group_fd == -1) {
+        // The leader starts disabled, so that the whole group can be
+        // started at once.
+        attr.flags |= PERF_FLAG_DISABLED;
+    }
+    return syscall(SYS_PERF_EVENT_OPEN, &attr, tid, -1, group_fd, 0);
+}
+
+WEAK void perf_counters_add_thread(int tid) {
+    for (int i = 0; i < perf_thread_count; i++) {
+        if (perf_threads[i].tid == tid) {
+            return;
+        }
+    }
+    if (perf_thread_count == PERF_MAX_THREADS) {
+        return;
+    }
+    perf_thread *t = &perf_threads[perf_thread_count];
+    t->tid = tid;
+    t->fd = perf_event_open(perf_counter_events[0], tid, -1);
+    if (t->fd < 0) {
+        // The thread may have just exited, but if we have no counters
+        // at all, they aren't going to work.
+        if (perf_thread_count == 0) {
+            perf_counters_unavailable = true;
+        }
+        return;
+    }
+    for (int i = 1; i < halide_profiler_counter_count; i++) {
+        t->member_fds[i - 1] = perf_event_open(perf_counter_events[i], tid, t->fd);
+    }
+    ioctl(t->fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    perf_thread_count++;
+}
+
+WEAK bool halide_perf_counters_scan_threads() {
+    if (perf_counters_unavailable) {
+        return false;
+    }
+    void *dir = fopen("/proc/self/task", "r");
+    if (!dir) {
+        perf_counters_unavailable = true;
+        return false;
+    }
+    int self = syscall(SYS_GETTID);
+    char buf[4096];
+    int bytes;
+    while ((bytes = syscall(SYS_GETDENTS64, fileno(dir), buf, sizeof(buf))) > 0) {
+        for (int pos = 0; pos < bytes;) {
+            linux_dirent64 *d = (linux_dirent64 *)(buf + pos);
+            pos += d->d_reclen;
+            if (d->d_name[0] < '0' || d->d_name[0] > '9') {
+                continue;
+            }
+            int tid = atoi(d->d_name);
+            if (tid != self) {
+                perf_counters_add_thread(tid);
+            }
+        }
+    }
+    fclose(dir);
+    return !perf_counters_unavailable;
+}
+
+WEAK bool halide_perf_counters_read(uint64_t *totals) {
+    if (perf_counters_unavailable || perf_thread_count == 0) {
+        return false;
+    }
+    for (int i = 0; i < halide_profiler_counter_count; i++) {
+        totals[i] = 0;
+    }
+    for (int i = 0; i < perf_thread_count; i++) {
+        perf_thread *t = &perf_threads[i];
+        // The number of counters, then their values in the order they
+        // were added to the group.
+        uint64_t values[halide_profiler_counter_count + 1];
+        if (read(t->fd, values, sizeof(values)) <= 0) {
+            continue;
+        }
+        totals[0] += values[1];
+        int next = 2;
+        for (int j = 1; j < halide_profiler_counter_count; j++) {
+            if (t->member_fds[j - 1] >= 0 && next <= (int)values[0]) {
+                totals[j] += values[next++];
+            }
+        }
+    }
+    return true;
+}
+
+WEAK void halide_perf_counters_close() {
+    for (int i = 0; i < perf_thread_count; i++) {
+        perf_thread *t = &perf_threads[i];
+        for (int j = 0; j < halide_profiler_counter_count - 1; j++) {
+            if (t->member_fds[j] >= 0) {
+                close(t->member_fds[j]);
+            }
+        }
+        close(t->fd);
+    }
+    perf_thread_count = 0;
+    perf_counters_unavailable = false;
+}
+
+}}} // namespace Halide::Runtime::Internal
@@ -0,0 +1,226 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+#include "scoped_mutex_lock.h"
+
+// A pooling allocator for halide_malloc. Freed blocks are kept on free
+// lists by size class and handed out again, so that a pipeline that
+// allocates the same buffers on every invocation stops paying for
+// malloc, free and fresh page faults after the first one. Install it
+// with halide_set_custom_malloc(halide_pool_malloc) and
+// halide_set_custom_free(halide_pool_free), or make the default
+// allocator use it by setting HL_POOL_ALLOCATOR=1.
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Size classes are 64 bytes, then four per power of two (80, 96, 112,
+// 128, 160, ...), so at most a quarter of a block is wasted.
+const int kPoolMinClassBits = 6;
+const int kPoolMaxClassBits = 30;
+const int kPoolNumClasses = (kPoolMaxClassBits - kPoolMinClassBits) * 4 + 1;
+// Marks a block too big to pool, which goes straight back to free.
+const uint32_t kPoolUnpooled = 0xffffffff;
+
+// Blocks up to this size are cached in stripes, bigger ones in a single
+// shared set of lists so that they get reused whichever thread frees them.
+const size_t kPoolMaxStripedSize = 1 << 20;
+const int kPoolStripes = 16;
+
+const int64_t kPoolDefaultMaxCachedBytes = 1LL << 30;
+
+struct PoolBlockHeader {
+    void *orig;
+    uint32_t size_class;
+    uint32_t padding;
+};
+
+struct PoolFreeLists {
+    halide_mutex mutex;
+    // Freed blocks chained through their first word
+    void *heads[kPoolNumClasses];
+};
+
+struct PoolCounters {
+    uint64_t allocations;
+    uint64_t reused;
+    uint64_t system_allocations;
+    uint64_t frees;
+    uint64_t released;
+    int64_t bytes_in_use;
+    int64_t bytes_cached;
+    int64_t peak_bytes_in_use;
+};
+
+WEAK PoolFreeLists pool_stripes[kPoolStripes];
+WEAK PoolFreeLists pool_large_lists;
+WEAK PoolCounters pool_counters;
+WEAK int64_t pool_max_cached_bytes = kPoolDefaultMaxCachedBytes;
+
+WEAK __attribute__((always_inline)) uint32_t pool_size_class(size_t size) {
+    if (size <= ((size_t)1 << kPoolMinClassBits)) {
+        return 0;
+    }
+    if (size > ((size_t)1 << kPoolMaxClassBits)) {
+        return kPoolUnpooled;
+    }
+    // 2^b <= size - 1 < 2^(b + 1)
+    int b = 63 - __builtin_clzll((uint64_t)(size - 1));
+    uint32_t sub = (uint32_t)((size - 1) >> (b - 2)) - 4;
+    return (b - kPoolMinClassBits) * 4 + sub + 1;
+}
+
+WEAK __attribute__((always_inline)) size_t pool_class_size(uint32_t size_class) {
+    if (size_class == 0) {
+        return (size_t)1 << kPoolMinClassBits;
+    }
+    int b = (size_class - 1) / 4 + kPoolMinClassBits;
+    size_t sub = (size_class - 1) % 4;
+    return (5 + sub) << (b - 2);
+}
+
+// Threads are spread over the stripes by the address of their stack, so
+// that a thread usually finds its own recently freed blocks uncontended.
+WEAK PoolFreeLists *pool_lists_for(uint32_t size_class) {
+    if (pool_class_size(size_class) > kPoolMaxStripedSize) {
+        return &pool_large_lists;
+    }
+    int local;
+    uint64_t h = ((uint64_t)(uintptr_t)&local >> 16) * 0x9E3779B97F4A7C15ULL;
+    return &pool_stripes[h >> 60];
+}
+
+WEAK __attribute__((always_inline)) PoolBlockHeader *pool_header(void *ptr) {
+    return (PoolBlockHeader *)ptr - 1;
+}
+
+WEAK void pool_count_in_use(int64_t bytes) {
+    int64_t in_use = __atomic_add_fetch(&pool_counters.bytes_in_use, bytes, __ATOMIC_SEQ_CST);
+    int64_t peak = __atomic_load_n(&pool_counters.peak_bytes_in_use, __ATOMIC_SEQ_CST);
+    while (in_use > peak &&
+           !__atomic_compare_exchange_n(&pool_counters.peak_bytes_in_use, &peak, in_use, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    }
+}
+
+// Give a block's memory back to the system.
+WEAK void pool_release(void *ptr) {
+    __atomic_add_fetch(&pool_counters.released, 1, __ATOMIC_SEQ_CST);
+    free(pool_header(ptr)->orig);
+}
+
+// Release cached blocks from a set of lists, largest first, until at
+// most max_cached_bytes are cached.
+WEAK void pool_trim_lists(PoolFreeLists *lists, int64_t max_cached_bytes) {
+    ScopedMutexLock lock(&lists->mutex);
+    for (int c = kPoolNumClasses - 1; c >= 0; c--) {
+        while (lists->heads[c] != NULL &&
+               __atomic_load_n(&pool_counters.bytes_cached, __ATOMIC_SEQ_CST) > max_cached_bytes) {
+            void *block = lists->heads[c];
+            lists->heads[c] = *(void **)block;
+            __atomic_sub_fetch(&pool_counters.bytes_cached, (int64_t)pool_class_size(c), __ATOMIC_SEQ_CST);
+            pool_release(block);
+        }
+    }
+}
+
+WEAK void pool_trim(int64_t max_cached_bytes) {
+    pool_trim_lists(&pool_large_lists, max_cached_bytes);
+    for (int i = 0; i < kPoolStripes; i++) {
+        pool_trim_lists(&pool_stripes[i], max_cached_bytes);
+    }
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK void *halide_pool_malloc(void *user_context, size_t x) {
+    __atomic_add_fetch(&pool_counters.allocations, 1, __ATOMIC_SEQ_CST);
+    uint32_t size_class = pool_size_class(x);
+    size_t size = size_class == kPoolUnpooled ? x : pool_class_size(size_class);
+
+    if (size_class != kPoolUnpooled) {
+        PoolFreeLists *lists = pool_lists_for(size_class);
+        void *block = NULL;
+        {
+            ScopedMutexLock lock(&lists->mutex);
+            block = lists->heads[size_class];
+            if (block != NULL) {
+                lists->heads[size_class] = *(void **)block;
+            }
+        }
+        if (block != NULL) {
+            __atomic_add_fetch(&pool_counters.reused, 1, __ATOMIC_SEQ_CST);
+            __atomic_sub_fetch(&pool_counters.bytes_cached, (int64_t)size, __ATOMIC_SEQ_CST);
+            pool_count_in_use(size);
+            return block;
+        }
+    }
+
+    // Allocate enough space for the header, for aligning the pointer we
+    // return, and for the 8 bytes past the end that may be read.
+    const size_t alignment = halide_malloc_alignment();
+    void *orig = malloc(size + sizeof(PoolBlockHeader) + alignment + 8);
+    if (orig == NULL) {
+        // Will result in a failed assertion and a call to halide_error
+        return NULL;
+    }
+    __atomic_add_fetch(&pool_counters.system_allocations, 1, __ATOMIC_SEQ_CST);
+    void *ptr = (void *)(((size_t)orig + sizeof(PoolBlockHeader) + alignment - 1) & ~(alignment - 1));
+    pool_header(ptr)->orig = orig;
+    pool_header(ptr)->size_class = size_class;
+    if (size_class != kPoolUnpooled) {
+        pool_count_in_use(size);
+    }
+    return ptr;
+}
+
+WEAK void halide_pool_free(void *user_context, void *ptr) {
+    __atomic_add_fetch(&pool_counters.frees, 1, __ATOMIC_SEQ_CST);
+    uint32_t size_class = pool_header(ptr)->size_class;
+    if (size_class == kPoolUnpooled) {
+        // The size isn't recorded for these; they aren't counted in use.
+        pool_release(ptr);
+        return;
+    }
+    int64_t size = (int64_t)pool_class_size(size_class);
+    __atomic_sub_fetch(&pool_counters.bytes_in_use, size, __ATOMIC_SEQ_CST);
+
+    // Keep at most pool_max_cached_bytes cached; past that, give blocks
+    // back to the system.
+    int64_t cached = __atomic_add_fetch(&pool_counters.bytes_cached, size, __ATOMIC_SEQ_CST);
+    if (cached > __atomic_load_n(&pool_max_cached_bytes, __ATOMIC_SEQ_CST)) {
+        __atomic_sub_fetch(&pool_counters.bytes_cached, size, __ATOMIC_SEQ_CST);
+        pool_release(ptr);
+        return;
+    }
+
+    PoolFreeLists *lists = pool_lists_for(size_class);
+    ScopedMutexLock lock(&lists->mutex);
+    *(void **)ptr = lists->heads[size_class];
+    lists->heads[size_class] = ptr;
+}
+
+WEAK void halide_pool_allocator_set_limit(void *user_context, int64_t max_cached_bytes) {
+    if (max_cached_bytes < 0) {
+        max_cached_bytes = kPoolDefaultMaxCachedBytes;
+    }
+    __atomic_store_n(&pool_max_cached_bytes, max_cached_bytes, __ATOMIC_SEQ_CST);
+    pool_trim(max_cached_bytes);
+}
+
+WEAK void halide_pool_allocator_trim(void *user_context, int64_t max_cached_bytes) {
+    pool_trim(max_cached_bytes);
+}
+
+WEAK void halide_pool_allocator_get_stats(void *user_context, halide_pool_allocator_stats_t *stats) {
+    stats->allocations = __atomic_load_n(&pool_counters.allocations, __ATOMIC_SEQ_CST);
+    stats->reused = __atomic_load_n(&pool_counters.reused, __ATOMIC_SEQ_CST);
+    stats->system_allocations = __atomic_load_n(&pool_counters.system_allocations, __ATOMIC_SEQ_CST);
+    stats->frees = __atomic_load_n(&pool_counters.frees, __ATOMIC_SEQ_CST);
+    stats->released = __atomic_load_n(&pool_counters.released, __ATOMIC_SEQ_CST);
+    stats->bytes_in_use = __atomic_load_n(&pool_counters.bytes_in_use, __ATOMIC_SEQ_CST);
+    stats->bytes_cached = __atomic_load_n(&pool_counters.bytes_cached, __ATOMIC_SEQ_CST);
+    stats->peak_bytes_in_use = __atomic_load_n(&pool_counters.peak_bytes_in_use, __ATOMIC_SEQ_CST);
+}
+
+}
@@ -6,9 +6,51 @@ extern "C" {
 extern void *malloc(size_t);
 extern void free(void *);
 
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// -1 until decided from HL_POOL_ALLOCATOR on first use. Fixed from then
+// on, so that blocks are always freed by the allocator they came from.
+WEAK int pool_allocator_mode = -1;
+
+WEAK bool pool_allocator_enabled() {
+    int mode = __atomic_load_n(&pool_allocator_mode, __ATOMIC_SEQ_CST);
+    if (mode < 0) {
+        char *pool_str = getenv("HL_POOL_ALLOCATOR");
+        mode = (pool_str && atoi(pool_str) != 0) ? 1 : 0;
+        __atomic_store_n(&pool_allocator_mode, mode, __ATOMIC_SEQ_CST);
+    }
+    return mode != 0;
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+// In NUMA mode, allocations at least this big get fresh pages of their
+// own instead of (possibly recycled) heap memory, so that each page is
+// placed on the node of the thread that first writes it.
+#define NUMA_FIRST_TOUCH_MIN_SIZE (1 << 20)
+
 WEAK void *halide_default_malloc(void *user_context, size_t x) {
+    if (pool_allocator_enabled()) {
+        return halide_pool_malloc(user_context, x);
+    }
     // Allocate enough space for aligning the pointer we return.
     const size_t alignment = halide_malloc_alignment();
+    if (x >= NUMA_FIRST_TOUCH_MIN_SIZE && halide_numa_enabled()) {
+        void *orig = halide_numa_alloc_pages(x + alignment);
+        if (orig != NULL) {
+            // The pages are page aligned. Store the original pointer
+            // tagged in its low bit, and the size to unmap, before the
+            // pointer we return.
+            void *ptr = (void *)((size_t)orig + alignment);
+            ((void **)ptr)[-1] = (void *)((size_t)orig | 1);
+            ((size_t *)ptr)[-2] = x + alignment;
+            return ptr;
+        }
+    }
     void *orig = malloc(x + alignment);
     if (orig == NULL) {
         // Will result in a failed assertion and a call to halide_error
@@ -21,7 +63,16 @@ WEAK void *halide_default_malloc(void *user_context, size_t x) {
 }
 
 WEAK void halide_default_free(void *user_context, void *ptr) {
-    free(((void**)ptr)[-1]);
+    if (pool_allocator_enabled()) {
+        halide_pool_free(user_context, ptr);
+        return;
+    }
+    void *orig = ((void**)ptr)[-1];
+    if ((size_t)orig & 1) {
+        halide_numa_free_pages((void *)((size_t)orig & ~(size_t)1), ((size_t *)ptr)[-2]);
+        return;
+    }
+    free(orig);
 }
 
 }
@@ -16,6 +16,32 @@ WEAK halide_profiler_state *halide_profiler_get_state() {
 
 namespace Halide { namespace Runtime { namespace Internal {
 
+// -1 until decided from HL_PROFILER_COUNTERS on first use
+WEAK int profiler_counters_mode = -1;
+
+WEAK bool profiler_counters_enabled() {
+    int mode = __atomic_load_n(&profiler_counters_mode, __ATOMIC_SEQ_CST);
+    if (mode < 0) {
+        char *counters_str = getenv("HL_PROFILER_COUNTERS");
+        mode = (counters_str && atoi(counters_str) != 0) ? 1 : 0;
+        __atomic_store_n(&profiler_counters_mode, mode, __ATOMIC_SEQ_CST);
+    }
+    return mode != 0;
+}
+
+// -1 until decided from HL_PROFILER_SAMPLING on first use
+WEAK int profiler_sampling_mode = -1;
+
+WEAK bool profiler_sampling_enabled() {
+    int mode = __atomic_load_n(&profiler_sampling_mode, __ATOMIC_SEQ_CST);
+    if (mode < 0) {
+        char *sampling_str = getenv("HL_PROFILER_SAMPLING");
+        mode = (sampling_str && atoi(sampling_str) == 0) ? 0 : 1;
+        __atomic_store_n(&profiler_sampling_mode, mode, __ATOMIC_SEQ_CST);
+    }
+    return mode != 0;
+}
+
 WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipeline_name, int num_funcs, const uint64_t *func_names) {
     halide_profiler_state *s = halide_profiler_get_state();
 
@@ -45,6 +71,10 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
     p->num_allocs = 0;
     p->active_threads_numerator = 0;
     p->active_threads_denominator = 0;
+    for (int j = 0; j < halide_profiler_counter_count; j++) {
+        p->counters[j] = 0;
+    }
+    p->latency = NULL;
     p->funcs = (halide_profiler_func_stats *)malloc(num_funcs * sizeof(halide_profiler_func_stats));
     if (!p->funcs) {
         free(p);
@@ -60,13 +90,18 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
         p->funcs[i].stack_peak = 0;
         p->funcs[i].active_threads_numerator = 0;
         p->funcs[i].active_threads_denominator = 0;
+        for (int j = 0; j < halide_profiler_counter_count; j++) {
+            p->funcs[i].counters[j] = 0;
+        }
+        p->funcs[i].latency = NULL;
     }
     s->first_free_id += num_funcs;
     s->pipelines = p;
     return p;
 }
 
-WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads) {
+WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads,
+                    const uint64_t *counters) {
     halide_profiler_pipeline_stats *p_prev = NULL;
     for (halide_profiler_pipeline_stats *p = s->pipelines; p;
          p = (halide_profiler_pipeline_stats *)(p->next)) {
@@ -85,6 +120,12 @@ WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int ac
             p->samples++;
             p->active_threads_numerator += active_threads;
             p->active_threads_denominator += 1;
+            if (counters) {
+                for (int i = 0; i < halide_profiler_counter_count; i++) {
+                    f->counters[i] += counters[i];
+                    p->counters[i] += counters[i];
+                }
+            }
             return;
         }
         p_prev = p;
@@ -98,6 +139,13 @@ WEAK void sampling_profiler_thread(void *) {
     // grab the lock
     halide_mutex_lock(&s->lock);
 
+    // The hardware event counts at the last sample, if counting
+    uint64_t counters[halide_profiler_counter_count];
+    bool counting = false;
+    // Look for new threads to count every so many samples
+    const int samples_per_scan = 10;
+    int samples_until_scan = 0;
+
     while (s->current_func != halide_profiler_please_stop) {
 
         uint64_t t1 = halide_current_time_ns(NULL);
@@ -113,12 +161,42 @@ WEAK void sampling_profiler_thread(void *) {
                 active_threads = s->active_threads;
             }
             uint64_t t_now = halide_current_time_ns(NULL);
+
+            // The counts since the last sample, if any
+            uint64_t deltas[halide_profiler_counter_count];
+            bool counted = false;
+            if (!s->get_remote_profiler_state && profiler_counters_enabled()) {
+                if (--samples_until_scan <= 0) {
+                    halide_perf_counters_scan_threads();
+                    samples_until_scan = samples_per_scan;
+                }
+                uint64_t now[halide_profiler_counter_count];
+                if (halide_perf_counters_read(now)) {
+                    if (counting) {
+                        for (int i = 0; i < halide_profiler_counter_count; i++) {
+                            // A failed read of one thread's counters
+                            // makes the totals go down.
+                            deltas[i] = now[i] > counters[i] ? now[i] - counters[i] : 0;
+                        }
+                        counted = true;
+                    }
+                    for (int i = 0; i < halide_profiler_counter_count; i++) {
+                        counters[i] = now[i];
+                    }
+                    counting = true;
+                }
+            } else if (counting) {
+                halide_perf_counters_close();
+                counting = false;
+                samples_until_scan = 0;
+            }
+
             if (func == halide_profiler_please_stop) {
                 break;
             } else if (func >= 0) {
-                // Assume all time since I was last awake is due to
-                // the currently running func.
-                bill_func(s, func, t_now - t, active_threads);
+                // Assume all time (and hardware events) since I was
+                // last awake is due to the currently running func.
+                bill_func(s, func, t_now - t, active_threads, counted ? deltas : NULL);
             }
             t = t_now;
 
@@ -130,6 +208,10 @@ WEAK void sampling_profiler_thread(void *) {
         }
     }
 
+    if (counting) {
+        halide_perf_counters_close();
+    }
+
     halide_mutex_unlock(&s->lock);
 }
 
@@ -151,6 +233,161 @@ void sync_compare_max_and_swap(T *ptr, T val) {
 
 }
 
+namespace Halide { namespace Runtime { namespace Internal {
+
+WEAK int latency_bucket(uint64_t ns) {
+    if (ns < 16) {
+        return (int)ns;
+    }
+    // Sixteen buckets per power of two, indexed by the next four bits
+    // after the leading one.
+    int msb = 63 - __builtin_clzll(ns);
+    int b = (msb - 3) * 16 + (int)((ns >> (msb - 4)) & 15);
+    return min(b, (int)halide_profiler_latency_buckets - 1);
+}
+
+// The smallest latency above those in a bucket.
+WEAK uint64_t latency_bucket_end(int b) {
+    if (b < 16) {
+        return b + 1;
+    }
+    return (uint64_t)(17 + b % 16) << (b / 16 - 1);
+}
+
+WEAK void record_latency(halide_profiler_latency_histogram **histogram, uint64_t ns) {
+    halide_profiler_latency_histogram *h = __atomic_load_n(histogram, __ATOMIC_SEQ_CST);
+    if (!h) {
+        halide_profiler_latency_histogram *fresh =
+            (halide_profiler_latency_histogram *)malloc(sizeof(halide_profiler_latency_histogram));
+        if (!fresh) {
+            return;
+        }
+        memset(fresh, 0, sizeof(halide_profiler_latency_histogram));
+        halide_profiler_latency_histogram *expected = NULL;
+        if (__atomic_compare_exchange_n(histogram, &expected, fresh, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            h = fresh;
+        } else {
+            // Someone else got there first.
+            free(fresh);
+            h = expected;
+        }
+    }
+    __sync_add_and_fetch(&h->buckets[latency_bucket(ns)], 1);
+    __sync_add_and_fetch(&h->total, ns);
+    sync_compare_max_and_swap(&h->max, ns);
+    __sync_add_and_fetch(&h->count, 1);
+}
+
+WEAK uint64_t latency_percentile(const halide_profiler_latency_histogram *h, float percentile) {
+    if (!h || !h->count) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile * (h->count / 100.0));
+    rank = min(rank, h->count - 1);
+    uint64_t seen = 0;
+    for (int b = 0; b < halide_profiler_latency_buckets; b++) {
+        seen += h->buckets[b];
+        if (seen > rank) {
+            return min(latency_bucket_end(b) - 1, h->max);
+        }
+    }
+    return h->max;
+}
+
+WEAK halide_profiler_latency_histogram *find_latency_histogram(halide_profiler_state *s,
+                                                               const char *pipeline_name,
+                                                               const char *func_name) {
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (strcmp(p->name, pipeline_name) != 0) {
+            continue;
+        }
+        if (!func_name) {
+            return p->latency;
+        }
+        for (int i = 0; i < p->num_funcs; i++) {
+            if (strcmp(p->funcs[i].name, func_name) == 0) {
+                return p->funcs[i].latency;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Appends to a buffer, truncating, but keeping track of the length the
+// whole string would have been.
+struct JsonWriter {
+    char *buf;
+    int size;
+    int length;
+
+    void append(const char *str) {
+        for (const char *c = str; *c; c++) {
+            if (length < size - 1) {
+                buf[length] = *c;
+            }
+            length++;
+        }
+    }
+
+    void append_string(const char *str) {
+        append("\"");
+        char escaped[3] = {'\\', 0, 0};
+        for (const char *c = str; *c; c++) {
+            if (*c == '"' || *c == '\\') {
+                escaped[1] = *c;
+                append(escaped);
+            } else {
+                char plain[2] = {*c, 0};
+                append(plain);
+            }
+        }
+        append("\"");
+    }
+
+    void append_uint(uint64_t value) {
+        char tmp[32];
+        halide_uint64_to_string(tmp, tmp + sizeof(tmp), value, 1);
+        append(tmp);
+    }
+
+    void append_histogram(const halide_profiler_latency_histogram *h) {
+        append("{\"count\": ");
+        append_uint(h->count);
+        append(", \"mean_ns\": ");
+        append_uint(h->count ? h->total / h->count : 0);
+        const char *names[] = {"p50_ns", "p90_ns", "p99_ns", "p999_ns"};
+        const float percentiles[] = {50, 90, 99, 99.9f};
+        for (int i = 0; i < 4; i++) {
+            append(", \"");
+            append(names[i]);
+            append("\": ");
+            append_uint(latency_percentile(h, percentiles[i]));
+        }
+        append(", \"max_ns\": ");
+        append_uint(h->max);
+        // The non-empty buckets, as pairs of the smallest latency in
+        // the bucket and the count.
+        append(", \"buckets\": [");
+        bool first = true;
+        for (int b = 0; b < halide_profiler_latency_buckets; b++) {
+            if (!h->buckets[b]) {
+                continue;
+            }
+            append(first ? "[" : ", [");
+            append_uint(b == 0 ? 0 : latency_bucket_end(b - 1));
+            append(", ");
+            append_uint(h->buckets[b]);
+            append("]");
+            first = false;
+        }
+        append("]}");
+    }
+};
+
+}}}
+
 extern "C" {
 // Returns the address of the pipeline state associated with pipeline_name.
 WEAK halide_profiler_pipeline_stats *halide_profiler_get_pipeline_state(const char *pipeline_name) {
@@ -178,8 +415,9 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
 
     ScopedMutexLock lock(&s->lock);
 
-    if (!s->sampling_thread) {
-        halide_start_clock(user_context);
+    // Needed for the latencies, even without the sampling thread.
+    halide_start_clock(user_context);
+    if (!s->sampling_thread && profiler_sampling_enabled()) {
         s->sampling_thread = halide_spawn_thread(sampling_profiler_thread, NULL);
     }
 
@@ -280,11 +518,105 @@ WEAK void halide_profiler_memory_free(void *user_context,
     __sync_sub_and_fetch(&f_stats->memory_current, decr);
 }
 
+WEAK void halide_profiler_record_latency(void *user_context,
+                                         void *pipeline_state,
+                                         int func_id,
+                                         uint64_t start_time) {
+    halide_profiler_pipeline_stats *p_stats = (halide_profiler_pipeline_stats *) pipeline_state;
+    halide_assert(user_context, p_stats != NULL);
+    halide_assert(user_context, func_id < p_stats->num_funcs);
+
+    uint64_t now = halide_current_time_ns(user_context);
+    uint64_t ns = now > start_time ? now - start_time : 0;
+
+    // Note: As for the memory stats, this is done without grabbing the
+    // state's lock.
+    if (func_id < 0) {
+        record_latency(&p_stats->latency, ns);
+    } else {
+        record_latency(&p_stats->funcs[func_id].latency, ns);
+    }
+}
+
+WEAK uint64_t halide_profiler_latency_percentile(const char *pipeline_name,
+                                                 const char *func_name,
+                                                 float percentile) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    return latency_percentile(find_latency_histogram(s, pipeline_name, func_name), percentile);
+}
+
+WEAK int halide_profiler_latency_json(char *buf, int size) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+
+    JsonWriter json = {buf, size, 0};
+    json.append("{\"pipelines\": [");
+    bool first_pipeline = true;
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (!p->latency) {
+            continue;
+        }
+        json.append(first_pipeline ? "\n  {\"name\": " : ",\n  {\"name\": ");
+        json.append_string(p->name);
+        json.append(", \"latency\": ");
+        json.append_histogram(p->latency);
+        json.append(", \"funcs\": [");
+        bool first_func = true;
+        for (int i = 0; i < p->num_funcs; i++) {
+            halide_profiler_func_stats *fs = p->funcs + i;
+            if (!fs->latency) {
+                continue;
+            }
+            json.append(first_func ? "\n    {\"name\": " : ",\n    {\"name\": ");
+            json.append_string(fs->name);
+            json.append(", \"latency\": ");
+            json.append_histogram(fs->latency);
+            json.append("}");
+            first_func = false;
+        }
+        json.append("]}");
+        first_pipeline = false;
+    }
+    json.append("]}\n");
+    if (size > 0) {
+        buf[min(json.length, size - 1)] = 0;
+    }
+    return json.length;
+}
+
+WEAK int halide_profiler_set_sampling(int enabled) {
+    int old = profiler_sampling_enabled() ? 1 : 0;
+    __atomic_store_n(&profiler_sampling_mode, enabled ? 1 : 0, __ATOMIC_SEQ_CST);
+    return old;
+}
+
 WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_state *s) {
 
     char line_buf[1024];
     Printer<StringStreamPrinter, sizeof(line_buf)> sstr(user_context, line_buf);
 
+    // Memoization cache statistics, shown next to the memoized Funcs and
+    // summarized at the end.
+    halide_memoization_cache_stats_t cache_stats;
+    halide_memoization_cache_get_stats(user_context, &cache_stats);
+    uint64_t cache_lookups = cache_stats.hits + cache_stats.disk_hits + cache_stats.misses;
+    halide_memoization_cache_func_stats_t *cache_func_stats = NULL;
+    int num_cache_funcs = 0;
+    if (cache_lookups) {
+        num_cache_funcs = halide_memoization_cache_get_func_stats(user_context, NULL, 0);
+        cache_func_stats = (halide_memoization_cache_func_stats_t *)
+            malloc(num_cache_funcs * sizeof(halide_memoization_cache_func_stats_t));
+        if (cache_func_stats) {
+            num_cache_funcs = min(num_cache_funcs,
+                                  halide_memoization_cache_get_func_stats(user_context, cache_func_stats,
+                                                                          num_cache_funcs));
+        } else {
+            num_cache_funcs = 0;
+        }
+    }
+
     for (halide_profiler_pipeline_stats *p = s->pipelines; p;
          p = (halide_profiler_pipeline_stats *)(p->next)) {
         float t = p->time / 1000000.0f;
@@ -306,13 +638,24 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
         }
         sstr << " heap allocations: " << p->num_allocs
              << "  peak heap usage: " << p->memory_peak << " bytes\n";
+        if (p->latency && p->latency->count) {
+            sstr << " latency p50: " << latency_percentile(p->latency, 50) / 1000000.0f << " ms"
+                 << "  p99: " << latency_percentile(p->latency, 99) / 1000000.0f << " ms"
+                 << "  max: " << p->latency->max / 1000000.0f << " ms\n";
+        }
+        if (p->counters[halide_profiler_cycles]) {
+            sstr << " cycles: " << p->counters[halide_profiler_cycles]
+                 << "  instructions: " << p->counters[halide_profiler_instructions]
+                 << "  cache misses: " << p->counters[halide_profiler_cache_misses]
+                 << "  branch misses: " << p->counters[halide_profiler_branch_misses] << "\n";
+        }
         halide_print(user_context, sstr.str());
 
         bool print_f_states = p->time || p->memory_total;
         if (!print_f_states) {
             for (int i = 0; i < p->num_funcs; i++) {
                 halide_profiler_func_stats *fs = p->funcs + i;
-                if (fs->stack_peak) {
+                if (fs->stack_peak || (fs->latency && fs->latency->count)) {
                     print_f_states = true;
                     break;
                 }
@@ -374,12 +717,61 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
                 if (fs->stack_peak > 0) {
                     sstr << " stack: " << fs->stack_peak;
                 }
+                if (fs->counters[halide_profiler_cycles]) {
+                    // Instructions per cycle, and misses per thousand
+                    // instructions, which say whether a stage is
+                    // compute-bound or waiting on memory.
+                    float cycles = (float)fs->counters[halide_profiler_cycles];
+                    float kinstructions = fs->counters[halide_profiler_instructions] / 1000.0f + 1e-10f;
+                    sstr << " ipc: " << fs->counters[halide_profiler_instructions] / cycles;
+                    sstr.erase(3);
+                    sstr << " cache mpki: " << fs->counters[halide_profiler_cache_misses] / kinstructions;
+                    sstr.erase(3);
+                    sstr << " branch mpki: " << fs->counters[halide_profiler_branch_misses] / kinstructions;
+                    sstr.erase(3);
+                }
+                if (fs->latency && fs->latency->count) {
+                    sstr << " p99: " << latency_percentile(fs->latency, 99) / 1000000.0f;
+                    sstr.erase(3);
+                    sstr << "ms";
+                }
+                for (int j = 0; j < num_cache_funcs; j++) {
+                    if (strcmp(cache_func_stats[j].name, fs->name) == 0) {
+                        const halide_memoization_cache_stats_t &cs = cache_func_stats[j].stats;
+                        sstr << " cache hits: " << cs.hits + cs.disk_hits
+                             << " misses: " << cs.misses;
+                        break;
+                    }
+                }
                 sstr << "\n";
 
                 halide_print(user_context, sstr.str());
             }
         }
     }
+
+    if (cache_lookups) {
+        sstr.clear();
+        sstr << "memoization cache\n"
+             << " hits: " << cache_stats.hits
+             << "  disk hits: " << cache_stats.disk_hits
+             << "  misses: " << cache_stats.misses
+             << "  evictions: " << cache_stats.evictions
+             << "  disk spills: " << cache_stats.disk_spills << "\n"
+             << " resident: " << cache_stats.bytes_resident << " bytes"
+             << " in " << cache_stats.entries_resident << " results"
+             << "  in use: " << cache_stats.in_use_pins << "\n";
+        halide_print(user_context, sstr.str());
+    }
+    if (cache_func_stats) {
+        free(cache_func_stats);
+    }
+}
+
+WEAK int halide_profiler_set_counters(int enabled) {
+    int old = profiler_counters_enabled() ? 1 : 0;
+    __atomic_store_n(&profiler_counters_mode, enabled ? 1 : 0, __ATOMIC_SEQ_CST);
+    return old;
 }
 
 WEAK void halide_profiler_report(void *user_context) {
@@ -393,6 +785,10 @@ WEAK void halide_profiler_reset_unlocked(halide_profiler_state *s) {
     while (s->pipelines) {
         halide_profiler_pipeline_stats *p = s->pipelines;
         s->pipelines = (halide_profiler_pipeline_stats *)(p->next);
+        for (int i = 0; i < p->num_funcs; i++) {
+            free(p->funcs[i].latency);
+        }
+        free(p->latency);
         free(p->funcs);
         free(p);
     }
@@ -415,14 +811,17 @@ __attribute__((destructor))
 WEAK void halide_profiler_shutdown() {
     halide_profiler_state *s = halide_profiler_get_state();
     if (!s->sampling_thread) {
-        return;
+        // Pipelines may still have run with sampling turned off.
+        if (!s->pipelines) {
+            return;
+        }
+    } else {
+        s->current_func = halide_profiler_please_stop;
+        halide_join_thread(s->sampling_thread);
+        s->sampling_thread = NULL;
+        s->current_func = halide_profiler_outside_of_halide;
     }
 
-    s->current_func = halide_profiler_please_stop;
-    halide_join_thread(s->sampling_thread);
-    s->sampling_thread = NULL;
-    s->current_func = halide_profiler_outside_of_halide;
-
     // Print results. No need to lock anything because we just shut
     // down the thread.
     halide_profiler_report_unlocked(NULL, s);
@@ -434,7 +833,7 @@ namespace {
 #ifdef WINDOWS
 WEAK void halide_windows_profiler_shutdown() {
     halide_profiler_state *s = halide_profiler_get_state();
-    if (!s->sampling_thread) {
+    if (!s->sampling_thread && !s->pipelines) {
         return;
     }
 
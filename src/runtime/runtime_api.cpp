@@ -17,6 +17,10 @@
 // cat src/runtime/runtime_internal.h src/runtime/HalideRuntime*.h | grep "^[^ ][^(]*halide_[^ ]*(" | grep -v '#define' | sed "s/[^(]*halide/halide/" | sed "s/(.*//" | sed "s/^h/    \(void *)\&h/" | sed "s/$/,/" | sort | uniq
 
 extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
+    (void *)&halide_arena_acquire,
+    (void *)&halide_arena_carve,
+    (void *)&halide_arena_release,
+    (void *)&halide_arena_uncarve,
     (void *)&halide_buffer_copy,
     (void *)&halide_buffer_to_string,
     (void *)&halide_can_use_target_features,
@@ -109,8 +113,13 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_malloc,
     (void *)&halide_matlab_call_pipeline,
     (void *)&halide_memoization_cache_cleanup,
+    (void *)&halide_memoization_cache_get_func_stats,
+    (void *)&halide_memoization_cache_get_stats,
     (void *)&halide_memoization_cache_lookup,
     (void *)&halide_memoization_cache_release,
+    (void *)&halide_memoization_cache_reset_stats,
+    (void *)&halide_memoization_cache_set_disk_tier,
+    (void *)&halide_memoization_cache_set_eviction_policy,
     (void *)&halide_memoization_cache_set_size,
     (void *)&halide_memoization_cache_store,
     (void *)&halide_metal_acquire_context,
@@ -152,19 +161,30 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_openglcompute_initialize_kernels,
     (void *)&halide_openglcompute_run,
     (void *)&halide_pointer_to_string,
+    (void *)&halide_pool_allocator_get_stats,
+    (void *)&halide_pool_allocator_set_limit,
+    (void *)&halide_pool_allocator_trim,
+    (void *)&halide_pool_free,
+    (void *)&halide_pool_malloc,
     (void *)&halide_print,
     (void *)&halide_profiler_get_pipeline_state,
     (void *)&halide_profiler_get_state,
+    (void *)&halide_profiler_latency_json,
+    (void *)&halide_profiler_latency_percentile,
     (void *)&halide_profiler_memory_allocate,
     (void *)&halide_profiler_memory_free,
     (void *)&halide_profiler_pipeline_start,
+    (void *)&halide_profiler_record_latency,
     (void *)&halide_profiler_report,
     (void *)&halide_profiler_reset,
+    (void *)&halide_profiler_set_counters,
+    (void *)&halide_profiler_set_sampling,
     (void *)&halide_profiler_stack_peak_update,
     (void *)&halide_qurt_hvx_lock,
     (void *)&halide_qurt_hvx_unlock,
     (void *)&halide_qurt_hvx_unlock_as_destructor,
     (void *)&halide_release_jit_module,
+    (void *)&halide_set_custom_arena,
     (void *)&halide_set_custom_can_use_target_features,
     (void *)&halide_set_custom_do_par_for,
     (void *)&halide_set_custom_do_task,
@@ -179,6 +199,9 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_set_gpu_device,
     (void *)&halide_set_num_threads,
     (void *)&halide_set_trace_file,
+    (void *)&halide_set_trace_ring_buffers,
+    (void *)&halide_set_work_stealing,
+    (void *)&halide_set_numa_aware,
     (void *)&halide_shutdown_thread_pool,
     (void *)&halide_shutdown_trace,
     (void *)&halide_sleep_ms,
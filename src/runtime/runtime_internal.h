@@ -78,6 +78,9 @@ int fileno(void *);
 int fclose(void *);
 int close(int);
 size_t fwrite(const void *, size_t, size_t, void *);
+size_t fread(void *, size_t, size_t, void *);
+int fseek(void *, long, int);
+long ftell(void *);
 ssize_t write(int fd, const void *buf, size_t bytes);
 int remove(const char *pathname);
 int ioctl(int fd, unsigned long request, ...);
@@ -130,6 +133,10 @@ WEAK void halide_profiler_memory_free(void *user_context,
                                       void *pipeline_state,
                                       int func_id,
                                       uint64_t decr);
+WEAK void halide_profiler_record_latency(void *user_context,
+                                         void *pipeline_state,
+                                         int func_id,
+                                         uint64_t start_time);
 WEAK int halide_profiler_pipeline_start(void *user_context,
                                         const char *pipeline_name,
                                         int num_funcs,
@@ -212,6 +219,28 @@ extern WEAK __attribute__((always_inline)) int halide_malloc_alignment();
 
 void halide_thread_yield();
 
+// NUMA support, provided by linux_numa.cpp or by fake_numa.cpp on the
+// platforms without it (which report a single node).
+bool halide_numa_enabled();
+int halide_numa_node_count();
+int halide_numa_node_of_cpu(int cpu);
+// Pin the calling thread to a cpu.
+void halide_numa_pin_thread(int cpu);
+// Map fresh pages, which get placed on the node of the thread that first
+// touches them. Returns NULL on failure.
+void *halide_numa_alloc_pages(size_t size);
+void halide_numa_free_pages(void *ptr, size_t size);
+
+// Hardware event counters for the profiler, summed over the threads of
+// the process, provided by linux_perf_counters.cpp or by
+// fake_perf_counters.cpp on the platforms without them. Start counting
+// on any threads not already counted, other than the calling one.
+// Returns false if the counters aren't available.
+bool halide_perf_counters_scan_threads();
+// Read the totals, indexed by halide_profiler_counter_t.
+bool halide_perf_counters_read(uint64_t *totals);
+void halide_perf_counters_close();
+
 }}}
 
 using namespace Halide::Runtime::Internal;
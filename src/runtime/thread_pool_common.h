@@ -182,6 +182,381 @@ WEAK void worker_thread(void *) {
 WEAK halide_do_task_t custom_do_task = halide_default_do_task;
 WEAK halide_do_par_for_t custom_do_par_for = halide_default_do_par_for;
 
+// An alternative work-stealing scheduler, selected with
+// halide_set_work_stealing or by setting HL_WORK_STEALING=1. Dispatching
+// and claiming tasks doesn't go through the work queue mutex: each
+// do_par_for publishes a job with one range of tasks per thread, a
+// thread claims tasks from the front of its own range, and when it runs
+// dry steals the back half of another thread's range with a single
+// compare-and-swap. The mutex and condition variables are only used to
+// put idle threads to sleep.
+//
+// In NUMA mode (halide_set_numa_aware or HL_NUMA=1) the scheduler is
+// always work-stealing, the worker of each slot is pinned to a cpu, and
+// slots are handed out to cpus node by node. The initial contiguous split
+// of a loop is then the same node-contiguous partition for every loop
+// of the same size, so consumers mostly read the pages their producers
+// first touched on the same node, and threads steal from their own node
+// before going to another.
+
+#define WS_MAX_JOBS 32
+#define WS_SPIN_COUNT 1024
+
+struct ws_job {
+    // Odd while the job is live. Incremented when the job is published and
+    // when it retires, so that threads holding a stale pointer to the slot
+    // can detect it.
+    uint32_t generation;
+
+    // Nonzero while the slot is owned by a do_par_for call.
+    int in_use;
+
+    // Number of threads other than the owner inside the job.
+    int active_workers;
+
+    int (*f)(void *, int, uint8_t *);
+    void *user_context;
+    uint8_t *closure;
+    int min;
+    int num_slots;
+    int exit_status;
+
+    // The task range [next, end) of each thread relative to min, packed
+    // as next | (end << 32). Slot 0 belongs to the owner, and slot i + 1
+    // to worker thread i.
+    uint64_t ranges[MAX_THREADS + 1];
+};
+
+struct ws_pool_t {
+    // Only protects sleeping and waking up
+    halide_mutex mutex;
+    halide_cond wakeup_workers;
+    halide_cond wakeup_owners;
+    int sleeping_workers;
+    int waiting_owners;
+
+    ws_job jobs[WS_MAX_JOBS];
+
+    halide_thread *threads[MAX_THREADS];
+    int threads_created;
+    // Number of threads including the owner of a job
+    int num_threads;
+    bool shutdown, initialized;
+
+    // Whether the pool was started in NUMA mode, and then the cpu each
+    // slot's thread is pinned to and its node.
+    bool numa;
+    int slot_cpu[MAX_THREADS];
+    int slot_node[MAX_THREADS];
+};
+WEAK ws_pool_t ws_pool = {};
+
+// -1 until decided from HL_WORK_STEALING on first use
+WEAK int ws_mode = -1;
+
+WEAK bool work_stealing_enabled() {
+    int mode = __atomic_load_n(&ws_mode, __ATOMIC_SEQ_CST);
+    if (mode < 0) {
+        char *ws_str = getenv("HL_WORK_STEALING");
+        mode = (ws_str && atoi(ws_str) != 0) ? 1 : 0;
+        __atomic_store_n(&ws_mode, mode, __ATOMIC_SEQ_CST);
+    }
+    return mode != 0 || halide_numa_enabled();
+}
+
+WEAK uint64_t ws_pack(uint32_t next, uint32_t end) {
+    return (uint64_t)next | ((uint64_t)end << 32);
+}
+
+// Claim the task at the front of a range. Returns false if it is empty.
+WEAK bool ws_claim(uint64_t *range, int *task) {
+    uint64_t old = __atomic_load_n(range, __ATOMIC_SEQ_CST);
+    while (true) {
+        uint32_t next = (uint32_t)old, end = (uint32_t)(old >> 32);
+        if (next >= end) {
+            return false;
+        }
+        if (__atomic_compare_exchange_n(range, &old, ws_pack(next + 1, end), false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            *task = (int)next;
+            return true;
+        }
+    }
+}
+
+// Move the back half of some other thread's range into my (empty) slot.
+// In NUMA mode, first try the threads on my node, then the others.
+WEAK bool ws_steal(ws_job *job, int mine) {
+    int passes = ws_pool.numa ? 2 : 1;
+    for (int pass = 0; pass < passes; pass++) {
+        for (int i = 1; i < job->num_slots; i++) {
+            int slot = (mine + i) % job->num_slots;
+            if (ws_pool.numa &&
+                (ws_pool.slot_node[slot] == ws_pool.slot_node[mine]) != (pass == 0)) {
+                continue;
+            }
+            uint64_t *victim = &job->ranges[slot];
+            uint64_t old = __atomic_load_n(victim, __ATOMIC_SEQ_CST);
+            while (true) {
+                uint32_t next = (uint32_t)old, end = (uint32_t)(old >> 32);
+                if (next >= end) {
+                    break;
+                }
+                uint32_t mid = next + (end - next) / 2;
+                if (__atomic_compare_exchange_n(victim, &old, ws_pack(next, mid), false,
+                                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                    // Only I refill my slot and nobody steals from an empty
+                    // one, so a plain store is enough.
+                    __atomic_store_n(&job->ranges[mine], ws_pack(mid, end), __ATOMIC_SEQ_CST);
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Run tasks of a job until every range is empty. Returns whether any
+// task was run.
+WEAK bool ws_work_on(ws_job *job, int mine) {
+    bool worked = false;
+    while (true) {
+        int task;
+        if (ws_claim(&job->ranges[mine], &task)) {
+            int result = halide_do_task(job->user_context, job->f, job->min + task,
+                                        job->closure);
+            if (result) {
+                __atomic_store_n(&job->exit_status, result, __ATOMIC_SEQ_CST);
+            }
+            worked = true;
+        } else if (!ws_steal(job, mine)) {
+            return worked;
+        }
+    }
+}
+
+WEAK void ws_leave_job(ws_job *job) {
+    if (__atomic_sub_fetch(&job->active_workers, 1, __ATOMIC_SEQ_CST) == 0 &&
+        __atomic_load_n(&ws_pool.waiting_owners, __ATOMIC_SEQ_CST) > 0) {
+        halide_mutex_lock(&ws_pool.mutex);
+        halide_cond_broadcast(&ws_pool.wakeup_owners);
+        halide_mutex_unlock(&ws_pool.mutex);
+    }
+}
+
+// Help with a job published in a slot, if it is live.
+WEAK bool ws_try_job(ws_job *job, int mine) {
+    uint32_t generation = __atomic_load_n(&job->generation, __ATOMIC_SEQ_CST);
+    if ((generation & 1) == 0) {
+        return false;
+    }
+    __atomic_add_fetch(&job->active_workers, 1, __ATOMIC_SEQ_CST);
+    bool worked = false;
+    // The owner doesn't retire the job while active_workers is nonzero, so
+    // if the generation still matches the job stays valid until we leave.
+    if (__atomic_load_n(&job->generation, __ATOMIC_SEQ_CST) == generation &&
+        mine < job->num_slots) {
+        worked = ws_work_on(job, mine);
+    }
+    ws_leave_job(job);
+    return worked;
+}
+
+WEAK bool ws_has_jobs() {
+    for (int i = 0; i < WS_MAX_JOBS; i++) {
+        if (__atomic_load_n(&ws_pool.jobs[i].generation, __ATOMIC_SEQ_CST) & 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+WEAK void ws_worker_thread(void *arg) {
+    int mine = (int)(intptr_t)arg + 1;
+    int idle = 0;
+    if (ws_pool.numa) {
+        halide_numa_pin_thread(ws_pool.slot_cpu[mine]);
+    }
+    while (!__atomic_load_n(&ws_pool.shutdown, __ATOMIC_SEQ_CST)) {
+        bool worked = false;
+        for (int i = 0; i < WS_MAX_JOBS; i++) {
+            // Start at different slots so that workers spread over the jobs
+            worked = ws_try_job(&ws_pool.jobs[(i + mine) % WS_MAX_JOBS], mine) || worked;
+        }
+        if (worked) {
+            idle = 0;
+        } else if (idle < WS_SPIN_COUNT) {
+            idle++;
+            halide_thread_yield();
+        } else {
+            halide_mutex_lock(&ws_pool.mutex);
+            __atomic_add_fetch(&ws_pool.sleeping_workers, 1, __ATOMIC_SEQ_CST);
+            if (!ws_has_jobs() && !__atomic_load_n(&ws_pool.shutdown, __ATOMIC_SEQ_CST)) {
+                halide_cond_wait(&ws_pool.wakeup_workers, &ws_pool.mutex);
+            }
+            __atomic_sub_fetch(&ws_pool.sleeping_workers, 1, __ATOMIC_SEQ_CST);
+            halide_mutex_unlock(&ws_pool.mutex);
+            idle = 0;
+        }
+    }
+}
+
+WEAK void ws_initialize() {
+    if (__atomic_load_n(&ws_pool.initialized, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    halide_mutex_lock(&ws_pool.mutex);
+    if (!ws_pool.initialized) {
+        // The size of the pool is fixed until the thread pool is shut down.
+        halide_mutex_lock(&work_queue.mutex);
+        int num_threads = work_queue.desired_num_threads;
+        halide_mutex_unlock(&work_queue.mutex);
+        if (!num_threads) {
+            num_threads = default_desired_num_threads();
+        }
+        ws_pool.num_threads = clamp_num_threads(num_threads);
+        ws_pool.numa = halide_numa_enabled();
+        if (ws_pool.numa) {
+            // Hand out the cpus node by node. The owner of a job isn't
+            // pinned, so slot 0 just takes the first cpu's node.
+            int num_cpus = halide_host_cpu_count();
+            int num_nodes = halide_numa_node_count();
+            int slot = 0;
+            while (slot < ws_pool.num_threads) {
+                int first_slot = slot;
+                for (int node = 0; node < num_nodes && slot < ws_pool.num_threads; node++) {
+                    for (int cpu = 0; cpu < num_cpus && slot < ws_pool.num_threads; cpu++) {
+                        if (halide_numa_node_of_cpu(cpu) == node) {
+                            ws_pool.slot_cpu[slot] = cpu;
+                            ws_pool.slot_node[slot] = node;
+                            slot++;
+                        }
+                    }
+                }
+                if (slot == first_slot) {
+                    // No usable topology; leave the rest unpinned on node 0.
+                    for (; slot < ws_pool.num_threads; slot++) {
+                        ws_pool.slot_cpu[slot] = -1;
+                        ws_pool.slot_node[slot] = 0;
+                    }
+                }
+            }
+        }
+        ws_pool.threads_created = 0;
+        while (ws_pool.threads_created < ws_pool.num_threads - 1) {
+            ws_pool.threads[ws_pool.threads_created] =
+                halide_spawn_thread(ws_worker_thread, (void *)(intptr_t)ws_pool.threads_created);
+            ws_pool.threads_created++;
+        }
+        __atomic_store_n(&ws_pool.initialized, true, __ATOMIC_SEQ_CST);
+    }
+    halide_mutex_unlock(&ws_pool.mutex);
+}
+
+// Wait until no other thread is inside the job.
+WEAK void ws_wait_for_workers(ws_job *job) {
+    int spins = 0;
+    while (__atomic_load_n(&job->active_workers, __ATOMIC_SEQ_CST) > 0) {
+        if (spins < WS_SPIN_COUNT) {
+            spins++;
+            halide_thread_yield();
+        } else {
+            halide_mutex_lock(&ws_pool.mutex);
+            __atomic_add_fetch(&ws_pool.waiting_owners, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&job->active_workers, __ATOMIC_SEQ_CST) > 0) {
+                halide_cond_wait(&ws_pool.wakeup_owners, &ws_pool.mutex);
+            }
+            __atomic_sub_fetch(&ws_pool.waiting_owners, 1, __ATOMIC_SEQ_CST);
+            halide_mutex_unlock(&ws_pool.mutex);
+        }
+    }
+}
+
+WEAK int ws_do_par_for(void *user_context, halide_task_t f,
+                       int min, int size, uint8_t *closure) {
+    ws_initialize();
+
+    // Grab a free job slot.
+    ws_job *job = NULL;
+    if (ws_pool.num_threads > 1) {
+        for (int i = 0; i < WS_MAX_JOBS && job == NULL; i++) {
+            int expected = 0;
+            if (__atomic_compare_exchange_n(&ws_pool.jobs[i].in_use, &expected, 1, false,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                job = &ws_pool.jobs[i];
+            }
+        }
+    }
+    if (job == NULL) {
+        // Single threaded, or too many jobs nested or in flight. Run serially.
+        int exit_status = 0;
+        for (int x = min; x < min + size; x++) {
+            int result = halide_do_task(user_context, f, x, closure);
+            if (result) {
+                exit_status = result;
+            }
+        }
+        return exit_status;
+    }
+
+    job->f = f;
+    job->user_context = user_context;
+    job->closure = closure;
+    job->min = min;
+    job->num_slots = ws_pool.num_threads;
+    job->exit_status = 0;
+    // Split the tasks evenly among the first 'parts' threads.
+    int parts = size < job->num_slots ? size : job->num_slots;
+    for (int i = 0; i < job->num_slots; i++) {
+        uint64_t range = 0;
+        if (i < parts) {
+            uint32_t begin = (uint32_t)(((int64_t)size * i) / parts);
+            uint32_t end = (uint32_t)(((int64_t)size * (i + 1)) / parts);
+            range = ws_pack(begin, end);
+        }
+        __atomic_store_n(&job->ranges[i], range, __ATOMIC_SEQ_CST);
+    }
+
+    // Publish the job and wake up sleeping workers.
+    __atomic_add_fetch(&job->generation, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ws_pool.sleeping_workers, __ATOMIC_SEQ_CST) > 0) {
+        halide_mutex_lock(&ws_pool.mutex);
+        halide_cond_broadcast(&ws_pool.wakeup_workers);
+        halide_mutex_unlock(&ws_pool.mutex);
+    }
+
+    // Do some work myself, then wait for the tasks still in flight.
+    ws_work_on(job, 0);
+    ws_wait_for_workers(job);
+
+    // Retire the job. Threads that entered it between the wait above and
+    // the generation change see nothing left to do; wait for them too
+    // before handing the slot to someone else.
+    __atomic_add_fetch(&job->generation, 1, __ATOMIC_SEQ_CST);
+    ws_wait_for_workers(job);
+    int exit_status = __atomic_load_n(&job->exit_status, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&job->in_use, 0, __ATOMIC_SEQ_CST);
+    return exit_status;
+}
+
+WEAK void ws_shutdown() {
+    if (!__atomic_load_n(&ws_pool.initialized, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    halide_mutex_lock(&ws_pool.mutex);
+    __atomic_store_n(&ws_pool.shutdown, true, __ATOMIC_SEQ_CST);
+    halide_cond_broadcast(&ws_pool.wakeup_workers);
+    halide_mutex_unlock(&ws_pool.mutex);
+
+    for (int i = 0; i < ws_pool.threads_created; i++) {
+        halide_join_thread(ws_pool.threads[i]);
+    }
+
+    ws_pool.threads_created = 0;
+    __atomic_store_n(&ws_pool.shutdown, false, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ws_pool.initialized, false, __ATOMIC_SEQ_CST);
+}
+
 }}}  // namespace Halide::Runtime::Internal
 
 using namespace Halide::Runtime::Internal;
@@ -207,6 +582,10 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
         return 0;
     }
 
+    if (work_stealing_enabled()) {
+        return ws_do_par_for(user_context, f, min, size, closure);
+    }
+
     // Grab the lock. If it hasn't been initialized yet, then the
     // field will be zero-initialized because it's a static global.
     halide_mutex_lock(&work_queue.mutex);
@@ -300,7 +679,14 @@ WEAK int halide_set_num_threads(int n) {
     return old;
 }
 
+WEAK int halide_set_work_stealing(int enabled) {
+    int old = work_stealing_enabled() ? 1 : 0;
+    __atomic_store_n(&ws_mode, enabled ? 1 : 0, __ATOMIC_SEQ_CST);
+    return old;
+}
+
 WEAK void halide_shutdown_thread_pool() {
+    ws_shutdown();
     if (work_queue.initialized) {
         // Wake everyone up and tell them the party's over and it's time
         // to go home
@@ -1,5 +1,6 @@
 #include "HalideRuntime.h"
 #include "printer.h"
+#include "scoped_mutex_lock.h"
 #include "scoped_spin_lock.h"
 
 extern "C" {
@@ -141,6 +142,347 @@ WEAK int halide_trace_file_lock = 0;
 WEAK bool halide_trace_file_initialized = false;
 WEAK void *halide_trace_file_internally_opened = NULL;
 
+// The ring buffer backend. Instead of all threads sharing one buffer
+// behind a lock that must be held exclusively to flush it, events are
+// appended to one of several rings, each written by one thread at a
+// time (the runtime has no thread-local storage, so threads pick a
+// ring by the address of their stack and move on to the next if it's
+// busy). Records are compact: the func name and tag are stored as
+// pointers rather than copied. A background thread drains the rings,
+// merging them in id order, and expands the records into the usual
+// trace packets as it writes them to the trace file. A writer that
+// finds its ring full drains the rings itself.
+//
+// A thread may use different rings for consecutive events, so a drain
+// only writes out records with ids below any id that has been taken
+// but not yet published. That way the trace file is in id order, and
+// each thread's events come out in the order they happened.
+
+const static int trace_ring_count = 16;
+const static uint32_t trace_ring_bytes = 256 * 1024;
+const static uint32_t trace_staging_bytes = 64 * 1024;
+
+struct TraceRingRecord {
+    // The number of bytes to the next record, a multiple of 8. If the
+    // low bit is set, the rest of the record is padding up to the end
+    // of the ring.
+    uint32_t size;
+    int32_t id;
+    int32_t parent_id;
+    int32_t value_index;
+    int32_t fd;
+    halide_type_t type;
+    uint16_t event;
+    uint16_t dimensions;
+    const char *func;
+    const char *trace_tag;
+    // Followed by the coordinates, then the value
+};
+
+// The value of TraceRing::claimed while its writer is taking an id
+const static int32_t trace_ring_claiming = -1;
+
+struct TraceRing {
+    // Written only by the thread holding busy
+    uint64_t head;
+    int busy;
+    // The id taken by the writer holding the ring, until it's
+    // published; 0 if there is none.
+    int32_t claimed;
+    uint8_t padding[64 - sizeof(uint64_t) - 2 * sizeof(int32_t)];
+    // Written only by the thread holding trace_ring_drain_lock
+    uint64_t tail;
+    uint8_t *buf;
+};
+
+struct TraceRings {
+    TraceRing rings[trace_ring_count];
+    // The counter the ids are taken from
+    int32_t *ids;
+    uint8_t staging[trace_staging_bytes];
+};
+
+WEAK TraceRings *trace_rings = NULL;
+WEAK halide_mutex trace_ring_drain_lock;
+WEAK halide_thread *trace_ring_flusher = NULL;
+WEAK int trace_ring_stop = 0;
+WEAK int trace_ring_init_lock = 0;
+// The number of threads inside trace_ring_write. The rings aren't
+// freed until it drops to zero.
+WEAK int trace_ring_writers = 0;
+// -1 until decided from HL_TRACE_RING on first use
+WEAK int trace_ring_mode = -1;
+
+WEAK bool trace_ring_enabled() {
+    int mode = __atomic_load_n(&trace_ring_mode, __ATOMIC_SEQ_CST);
+    if (mode < 0) {
+        char *ring_str = getenv("HL_TRACE_RING");
+        mode = (ring_str && atoi(ring_str) != 0) ? 1 : 0;
+        __atomic_store_n(&trace_ring_mode, mode, __ATOMIC_SEQ_CST);
+    }
+    return mode != 0;
+}
+
+WEAK __attribute__((always_inline)) const TraceRingRecord *trace_ring_record_at(const TraceRing *ring, uint64_t pos) {
+    return (const TraceRingRecord *)(ring->buf + (pos & (trace_ring_bytes - 1)));
+}
+
+// Expand a ring record into a trace packet of the given size.
+WEAK void trace_ring_expand(const TraceRingRecord *rec, halide_trace_packet_t *packet, uint32_t total_size) {
+    uint32_t value_bytes = (uint32_t)(rec->type.lanes * rec->type.bytes());
+    uint32_t coords_bytes = rec->dimensions * (uint32_t)sizeof(int32_t);
+    packet->size = total_size;
+    packet->id = rec->id;
+    packet->type = rec->type;
+    packet->event = (halide_trace_event_code_t)rec->event;
+    packet->parent_id = rec->parent_id;
+    packet->value_index = rec->value_index;
+    packet->dimensions = rec->dimensions;
+    const uint8_t *payload = (const uint8_t *)(rec + 1);
+    memcpy((void *)packet->coordinates(), payload, coords_bytes);
+    memcpy((void *)packet->value(), payload + coords_bytes, value_bytes);
+    const char *trace_tag = rec->trace_tag ? rec->trace_tag : "";
+    memcpy((void *)packet->func(), rec->func, strlen(rec->func) + 1);
+    memcpy((void *)packet->trace_tag(), trace_tag, strlen(trace_tag) + 1);
+}
+
+// Drain the rings to the trace file(s), merging the records by id.
+// Returns an id below which all events have been written.
+WEAK int32_t trace_ring_drain(TraceRings *r) {
+    ScopedMutexLock lock(&trace_ring_drain_lock);
+
+    // Every id below limit has been taken. Lower it to the smallest
+    // id that hasn't been published yet. The claims must be read
+    // before the heads: a writer publishes its record before it
+    // clears its claim.
+    int32_t limit = __atomic_load_n(r->ids, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < trace_ring_count; i++) {
+        int32_t claimed = __atomic_load_n(&r->rings[i].claimed, __ATOMIC_SEQ_CST);
+        while (claimed == trace_ring_claiming) {
+            halide_thread_yield();
+            claimed = __atomic_load_n(&r->rings[i].claimed, __ATOMIC_SEQ_CST);
+        }
+        if (claimed > 0 && claimed < limit) {
+            limit = claimed;
+        }
+    }
+
+    uint64_t heads[trace_ring_count];
+    for (int i = 0; i < trace_ring_count; i++) {
+        heads[i] = __atomic_load_n(&r->rings[i].head, __ATOMIC_SEQ_CST);
+    }
+
+    uint32_t staged = 0;
+    int staged_fd = -1;
+    bool success = true;
+    while (1) {
+        // Find the earliest record at the tail of any ring
+        const TraceRingRecord *next = NULL;
+        int next_ring = -1;
+        for (int i = 0; i < trace_ring_count; i++) {
+            TraceRing *ring = &r->rings[i];
+            while (ring->tail < heads[i] && (trace_ring_record_at(ring, ring->tail)->size & 1)) {
+                ring->tail += trace_ring_record_at(ring, ring->tail)->size & ~1;
+            }
+            if (ring->tail < heads[i]) {
+                const TraceRingRecord *rec = trace_ring_record_at(ring, ring->tail);
+                if (!next || rec->id < next->id) {
+                    next = rec;
+                    next_ring = i;
+                }
+            }
+        }
+        if (!next || next->id >= limit) {
+            break;
+        }
+
+        uint32_t value_bytes = (uint32_t)(next->type.lanes * next->type.bytes());
+        uint32_t coords_bytes = next->dimensions * (uint32_t)sizeof(int32_t);
+        uint32_t name_bytes = strlen(next->func) + 1;
+        uint32_t trace_tag_bytes = next->trace_tag ? (strlen(next->trace_tag) + 1) : 1;
+        uint32_t total_size = ((uint32_t)sizeof(halide_trace_packet_t) + value_bytes + coords_bytes +
+                               name_bytes + trace_tag_bytes + 3) & ~3;
+
+        if (staged && (staged_fd != next->fd || staged + total_size > trace_staging_bytes)) {
+            success = success && (staged == (uint32_t)write(staged_fd, r->staging, staged));
+            staged = 0;
+        }
+        staged_fd = next->fd;
+
+        if (total_size <= trace_staging_bytes) {
+            trace_ring_expand(next, (halide_trace_packet_t *)(r->staging + staged), total_size);
+            staged += total_size;
+        } else {
+            // Too big to stage (e.g. a long trace tag): write it on its
+            // own. Anything staged was flushed above.
+            halide_trace_packet_t *packet = (halide_trace_packet_t *)malloc(total_size);
+            if (packet) {
+                trace_ring_expand(next, packet, total_size);
+                success = success && (total_size == (uint32_t)write(next->fd, packet, total_size));
+                free(packet);
+            } else {
+                success = false;
+            }
+        }
+
+        TraceRing *ring = &r->rings[next_ring];
+        __atomic_store_n(&ring->tail, ring->tail + next->size, __ATOMIC_SEQ_CST);
+    }
+    if (staged) {
+        success = success && (staged == (uint32_t)write(staged_fd, r->staging, staged));
+    }
+    halide_assert(NULL, success && "Could not write to trace file");
+    return limit;
+}
+
+WEAK void trace_ring_flusher_thread(void *r) {
+    while (!__atomic_load_n(&trace_ring_stop, __ATOMIC_SEQ_CST)) {
+        trace_ring_drain((TraceRings *)r);
+        halide_sleep_ms(NULL, 1);
+    }
+}
+
+WEAK TraceRings *trace_ring_init(int32_t *ids) {
+    ScopedSpinLock lock(&trace_ring_init_lock);
+    if (!trace_rings) {
+        TraceRings *r = (TraceRings *)malloc(sizeof(TraceRings));
+        uint8_t *bufs = (uint8_t *)malloc(trace_ring_count * trace_ring_bytes);
+        if (!r || !bufs) {
+            free(r);
+            free(bufs);
+            return NULL;
+        }
+        memset(r, 0, sizeof(TraceRings));
+        for (int i = 0; i < trace_ring_count; i++) {
+            r->rings[i].buf = bufs + i * trace_ring_bytes;
+        }
+        r->ids = ids;
+        __atomic_store_n(&trace_ring_stop, 0, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&trace_rings, r, __ATOMIC_SEQ_CST);
+        trace_ring_flusher = halide_spawn_thread(trace_ring_flusher_thread, r);
+    }
+    return trace_rings;
+}
+
+WEAK void trace_ring_shutdown() {
+    ScopedSpinLock lock(&trace_ring_init_lock);
+    TraceRings *r = __atomic_load_n(&trace_rings, __ATOMIC_SEQ_CST);
+    if (!r) {
+        return;
+    }
+    // Unpublish the rings, then wait for any writers that already had
+    // them to finish before freeing them. Writers that arrive after this
+    // block on the init lock and set up new rings.
+    __atomic_store_n(&trace_rings, (TraceRings *)NULL, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&trace_ring_writers, __ATOMIC_SEQ_CST)) {
+        halide_thread_yield();
+    }
+    __atomic_store_n(&trace_ring_stop, 1, __ATOMIC_SEQ_CST);
+    if (trace_ring_flusher) {
+        halide_join_thread(trace_ring_flusher);
+        trace_ring_flusher = NULL;
+    }
+    trace_ring_drain(r);
+    free(r->rings[0].buf);
+    free(r);
+}
+
+// Append an event to a ring, taking its id from ids. Returns false if
+// the rings couldn't be set up, in which case the caller should use the
+// shared buffer.
+WEAK bool trace_ring_write(void *user_context, int fd, int32_t *ids, const halide_trace_event_t *e, int32_t *id) {
+    // Register as a writer before looking at the rings, so that they
+    // can't be freed under us.
+    TraceRings *r = NULL;
+    while (1) {
+        __atomic_fetch_add(&trace_ring_writers, 1, __ATOMIC_SEQ_CST);
+        r = __atomic_load_n(&trace_rings, __ATOMIC_SEQ_CST);
+        if (r) {
+            break;
+        }
+        __atomic_fetch_sub(&trace_ring_writers, 1, __ATOMIC_SEQ_CST);
+        if (!trace_ring_init(ids)) {
+            return false;
+        }
+    }
+
+    uint32_t value_bytes = (uint32_t)(e->type.lanes * e->type.bytes());
+    uint32_t coords_bytes = e->dimensions * (uint32_t)sizeof(int32_t);
+    uint32_t size = ((uint32_t)sizeof(TraceRingRecord) + coords_bytes + value_bytes + 7) & ~7;
+    halide_assert(user_context, size <= trace_ring_bytes / 2);
+
+    // Claim a ring, starting from the one for this thread's stack
+    int local;
+    int start = (int)((((uint64_t)(uintptr_t)&local >> 16) * 0x9E3779B97F4A7C15ULL) >> 60) % trace_ring_count;
+    TraceRing *ring = NULL;
+    for (int i = 0; !ring; i++) {
+        TraceRing *candidate = &r->rings[(start + i) % trace_ring_count];
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&candidate->busy, &expected, 1, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            ring = candidate;
+        } else if (i % trace_ring_count == trace_ring_count - 1) {
+            halide_thread_yield();
+        }
+    }
+
+    // Take the id only once the ring is held, so that the ids in each
+    // ring increase and the rings can be merged. Mark the ring first, so
+    // that a drain never misses an id that has been taken but not
+    // published.
+    __atomic_store_n(&ring->claimed, trace_ring_claiming, __ATOMIC_SEQ_CST);
+    *id = __sync_fetch_and_add(ids, 1);
+    __atomic_store_n(&ring->claimed, *id, __ATOMIC_SEQ_CST);
+
+    // Records don't wrap around the end of the ring; pad to the start
+    // instead if necessary.
+    uint64_t pos = ring->head;
+    uint32_t contiguous = trace_ring_bytes - (uint32_t)(pos & (trace_ring_bytes - 1));
+    uint32_t needed = size + (contiguous < size ? contiguous : 0);
+    while (pos + needed - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) > trace_ring_bytes) {
+        trace_ring_drain(r);
+    }
+    if (contiguous < size) {
+        *(uint32_t *)(ring->buf + (pos & (trace_ring_bytes - 1))) = contiguous | 1;
+        pos += contiguous;
+    }
+
+    TraceRingRecord *rec = (TraceRingRecord *)(ring->buf + (pos & (trace_ring_bytes - 1)));
+    rec->size = size;
+    rec->id = *id;
+    rec->parent_id = e->parent_id;
+    rec->value_index = e->value_index;
+    rec->fd = fd;
+    rec->type = e->type;
+    rec->event = (uint16_t)e->event;
+    rec->dimensions = (uint16_t)e->dimensions;
+    rec->func = e->func;
+    rec->trace_tag = e->trace_tag;
+    uint8_t *payload = (uint8_t *)(rec + 1);
+    if (e->coordinates) {
+        memcpy(payload, e->coordinates, coords_bytes);
+    }
+    if (e->value) {
+        memcpy(payload + coords_bytes, e->value, value_bytes);
+    }
+
+    __atomic_store_n(&ring->head, pos + size, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ring->claimed, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ring->busy, 0, __ATOMIC_SEQ_CST);
+
+    // The func names in the rings may not outlive the pipeline, so
+    // drain them before it returns. Events of other threads with
+    // smaller ids may still be in flight; wait for them.
+    if (e->event == halide_trace_end_pipeline) {
+        while (trace_ring_drain(r) <= *id) {
+            halide_thread_yield();
+        }
+    }
+
+    __atomic_fetch_sub(&trace_ring_writers, 1, __ATOMIC_SEQ_CST);
+    return true;
+}
+
 }}}
 
 extern "C" {
@@ -148,11 +490,15 @@ extern "C" {
 WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t *e) {
     static int32_t ids = 1;
 
-    int32_t my_id = __sync_fetch_and_add(&ids, 1);
-
     // If we're dumping to a file, use a binary format
     int fd = halide_get_trace_file(user_context);
-    if (fd > 0) {
+    int32_t my_id = 0;
+    bool in_ring = fd > 0 && trace_ring_enabled() && trace_ring_write(user_context, fd, &ids, e, &my_id);
+    if (!in_ring) {
+        my_id = __sync_fetch_and_add(&ids, 1);
+    }
+
+    if (!in_ring && fd > 0) {
         // Compute the total packet size
         uint32_t value_bytes = (uint32_t)(e->type.lanes * e->type.bytes());
         uint32_t header_bytes = (uint32_t)sizeof(halide_trace_packet_t);
@@ -349,7 +695,14 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event_t *e) {
     return (*halide_custom_trace)(user_context, e);
 }
 
+WEAK int halide_set_trace_ring_buffers(int enabled) {
+    int old = trace_ring_enabled() ? 1 : 0;
+    __atomic_store_n(&trace_ring_mode, enabled ? 1 : 0, __ATOMIC_SEQ_CST);
+    return old;
+}
+
 WEAK int halide_shutdown_trace() {
+    trace_ring_shutdown();
     if (halide_trace_file_internally_opened) {
         int ret = fclose(halide_trace_file_internally_opened);
         halide_trace_file = 0;
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+int mallocs = 0, frees = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    mallocs++;
+    void *orig = malloc(x + 64);
+    void *ptr = (void *)((((size_t)orig + 64) >> 6) << 6);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    frees++;
+    free(((void **)ptr)[-1]);
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+    Func f, g, h, out;
+    Param<int> offset;
+
+    // Three root stages big enough to go on the heap, with sizes that
+    // depend on the output size.
+    f(x, y) = x + y + offset;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    h(x, y) = g(x, y) * 2 - g(x, y + 1);
+    out(x, y) = h(x, y) + h(x + 2, y);
+
+    f.compute_root();
+    g.compute_root().parallel(y);
+    h.compute_root().vectorize(x, 8);
+
+    out.set_custom_allocator(my_malloc, my_free);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::ArenaAlloc);
+    out.compile_jit(t);
+
+    for (int i = 0; i < 3; i++) {
+        const int W = 200 + i * 37, H = 100 + i * 11;
+        offset.set(i);
+        mallocs = frees = 0;
+        Buffer<int> im = out.realize(W, H, t);
+
+        // All three intermediates come out of one arena.
+        if (mallocs != 1 || frees != 1) {
+            printf("%d mallocs and %d frees instead of one of each\n", mallocs, frees);
+            return -1;
+        }
+
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                // g(x, y) = 2x + 2y + 1 + 2i, h(x, y) = 2x + 2y - 1 + 2i
+                int correct = 4 * x + 4 * y + 2 + 4 * i;
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <cstring>
 
 #include "Halide.h"
 
@@ -751,6 +752,8 @@ void test_repeat_edge() {
     // loss = (i0 + i1) + (i1 + i1) + (i1 + i1) = i0 + 5 * i1
 
     Buffer<float> d_blur_buf = blur.realize(3);
+    // The clamp should be inverted into a gather instead of a scatter
+    _halide_user_assert(!has_non_pure_update(d(input))) << "Function has non pure update\n";
     Buffer<float> d_input_buf = d(input).realize(2);
     // d loss / d i0 = 1
     // d loss / d i1 = 5
@@ -773,6 +776,8 @@ void test_constant_exterior() {
     // loss = (i0 + i1) + i1 = i0 + 2 * i1
 
     Buffer<float> d_blur_buf = blur.realize(3);
+    // The clamp should be inverted into a gather instead of a scatter
+    _halide_user_assert(!has_non_pure_update(d(input))) << "Function has non pure update\n";
     Buffer<float> d_input_buf = d(input).realize(2);
     // d loss / d i0 = 1
     // d loss / d i1 = 2
@@ -1047,6 +1052,41 @@ void test_downsampling() {
     check(__LINE__, d_input_buf(9), 0.f);
 }
 
+void test_strided_conv() {
+    Var x("x");
+    Buffer<float> input(9, "input");
+    for (int i = 0; i < 9; i++) {
+        input(i) = float(i);
+    }
+    Buffer<float> w(3, "w");
+    w(0) = 1.f;
+    w(1) = 2.f;
+    w(2) = 3.f;
+    Func output("output");
+    RDom k(0, 3);
+    output(x) += input(2 * x + k) * w(k);
+    RDom r_loss(0, 4);
+    Func loss("loss");
+    loss() += output(r_loss);
+    Derivative d = propagate_adjoints(loss);
+    Func d_input = d(input);
+    // The stride should be inverted into a gather instead of a scatter
+    _halide_user_assert(!has_non_pure_update(d_input)) << "Function has non pure update\n";
+    Buffer<float> d_input_buf = d_input.realize(9);
+    // d_input(i) = \sum_{2 * x + k == i} w(k)
+    for (int i = 0; i < 9; i++) {
+        float target = 0.f;
+        for (int ox = 0; ox < 4; ox++) {
+            for (int ok = 0; ok < 3; ok++) {
+                if (2 * ox + ok == i) {
+                    target += w(ok);
+                }
+            }
+        }
+        check(__LINE__, d_input_buf(i), target);
+    }
+}
+
 void test_upsampling() {
     Var x("x");
     Buffer<float> input(4);
@@ -1236,6 +1276,162 @@ void test_reverse_forward() {
     check(__LINE__, d2_input_buf(9), d2_output_buf(8));
 }
 
+void test_parallel_scatter() {
+    Var x("x");
+    const int size = 256;
+    Buffer<int> index(size, "index");
+    Buffer<float> weight(size, "weight");
+    for (int i = 0; i < size; i++) {
+        index(i) = i % 7;
+        weight(i) = float(i % 3);
+    }
+    Buffer<float> k(7, "k");
+    for (int i = 0; i < 7; i++) {
+        k(i) = float(i);
+    }
+    Func f_k("f_k");
+    f_k(x) = k(x);
+    Func gathered("gathered");
+    gathered(x) = f_k(clamp(index(x), 0, 6)) * weight(x);
+    RDom r(0, size);
+    Func loss("loss");
+    loss() += gathered(r.x);
+    auto has_partials = [](const Func &adjoint) {
+        std::map<std::string, Function> env = find_transitive_calls(adjoint.function());
+        for (const auto &it : env) {
+            if (it.first.find("_intm") != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // The scatter is left serial unless asked for
+    Derivative d_serial = propagate_adjoints(loss);
+    _halide_user_assert(!has_partials(d_serial(f_k)))
+        << "Expected the scatter not to be rfactored by default\n";
+
+    // The scatter to f_k should be split into parallel partial reductions
+    ScatterOptions scatter;
+    scatter.parallelize = true;
+    scatter.num_partials = 4;
+    Derivative d = propagate_adjoints(loss, CheckpointOptions(), {}, scatter);
+    _halide_user_assert(has_partials(d(f_k))) << "Expected the scatter to be rfactored\n";
+
+    // d_f_k(j) = \sum_{i % 7 == j} weight(i)
+    Buffer<float> d_f_k = d(f_k).realize(7);
+    for (int j = 0; j < 7; j++) {
+        float target = 0.f;
+        for (int i = 0; i < size; i++) {
+            if (i % 7 == j) {
+                target += weight(i);
+            }
+        }
+        check(__LINE__, d_f_k(j), target);
+    }
+}
+
+void test_partial_gradients() {
+    Var x("x");
+    Buffer<float> a(4, "a"), b(4, "b");
+    for (int i = 0; i < 4; i++) {
+        a(i) = float(i);
+        b(i) = float(i + 1);
+    }
+    Func fa("fa");
+    fa(x) = a(x) * a(x);
+    Func fb("fb");
+    fb(x) = sin(b(x));
+    Func fab("fab");
+    fab(x) = fa(x) + fb(x) * floor(fa(x));
+    RDom r(0, 4);
+    Func loss("loss");
+    loss() += fab(r.x);
+    Derivative d = propagate_adjoints(loss, CheckpointOptions(), { a.name() });
+
+    // Only the adjoints leading to a are generated
+    _halide_user_assert(d.adjoints.count(FuncKey{ a.name(), -1 }) == 1)
+        << "Expected an adjoint for " << a.name() << "\n";
+    _halide_user_assert(d.adjoints.count(FuncKey{ b.name(), -1 }) == 0)
+        << "Expected no adjoint for " << b.name() << "\n";
+    _halide_user_assert(d.adjoints.count(FuncKey{ fb.name(), -1 }) == 0)
+        << "Expected no adjoint for " << fb.name() << "\n";
+
+    // d loss / d a = 2 * a (floor has zero derivative)
+    Buffer<float> d_a = d(a).realize(4);
+    for (int i = 0; i < 4; i++) {
+        check(__LINE__, d_a(i), 2.f * a(i));
+    }
+}
+
+// Counts the realizations of f1, f2, and any copies of them, whose
+// names start with theirs.
+int forward_realizations = 0;
+int count_forward_realizations(void *user_context, const halide_trace_event_t *e) {
+    if (e->event == halide_trace_begin_realization &&
+        (strncmp(e->func, "f1", 2) == 0 || strncmp(e->func, "f2", 2) == 0)) {
+        forward_realizations++;
+    }
+    return 0;
+}
+
+void test_checkpointing() {
+    Var x("x");
+    Buffer<float> input(8, "input");
+    for (int i = 0; i < 8; i++) {
+        input(i) = 0.1f * float(i);
+    }
+    Func f1("f1");
+    f1(x) = sin(input(x));
+    Func f2("f2");
+    f2(x) = f1(x) * f1(x);
+    RDom r(0, 8);
+    Func loss("loss");
+    loss() += f2(r.x) * f1(r.x);
+    f1.compute_root().trace_realizations();
+    f2.compute_root().trace_realizations();
+
+    // Recompute every forward Func in the backward pass
+    CheckpointOptions options;
+    options.memory_budget = 0;
+    Derivative d = propagate_adjoints(loss, options);
+    _halide_user_assert(d.recomputed.count(f1.name()) == 1)
+        << "Expected " << f1.name() << " to be recomputed\n";
+    _halide_user_assert(d.recomputed.count(f2.name()) == 1)
+        << "Expected " << f2.name() << " to be recomputed\n";
+    // Neither the stored forward Funcs nor a copy of them are realized,
+    // including f1 read through the recomputed f2
+    Func d_input_func = d(input);
+    d_input_func.set_custom_trace(&count_forward_realizations);
+    Buffer<float> d_input = d_input_func.realize(8);
+    _halide_user_assert(forward_realizations == 0)
+        << "Expected the recomputed forward Funcs not to be realized\n";
+    // loss = \sum sin(input)^3
+    // d_input = 3 sin(input)^2 cos(input)
+    for (int i = 0; i < 8; i++) {
+        float s = std::sin(input(i));
+        check(__LINE__, d_input(i), 3.f * s * s * std::cos(input(i)), 1e-5f);
+    }
+
+    // Explicitly stored Funcs are never recomputed
+    Func g1("g1");
+    g1(x) = sin(input(x));
+    Func g2("g2");
+    g2(x) = g1(x) * g1(x);
+    Func loss2("loss2");
+    loss2() += g2(r.x) * g1(r.x);
+    CheckpointOptions options2;
+    options2.memory_budget = 0;
+    options2.stored.insert(g1.name());
+    Derivative d2 = propagate_adjoints(loss2, options2);
+    _halide_user_assert(d2.recomputed.count(g1.name()) == 0)
+        << "Expected " << g1.name() << " to be stored\n";
+    Buffer<float> d2_input = d2(input).realize(8);
+    for (int i = 0; i < 8; i++) {
+        check(__LINE__, d2_input(i), d_input(i), 1e-5f);
+    }
+}
+
 int main(int argc, char **argv) {
     test_scalar<float>();
     test_scalar<double>();
@@ -1264,11 +1460,15 @@ int main(int argc, char **argv) {
     test_tuple();
     test_floor_ceil();
     test_downsampling();
+    test_strided_conv();
     test_upsampling();
     test_transpose();
     test_change_var();
     test_rdom_predicate();
     test_forward();
     test_reverse_forward();
+    test_parallel_scatter();
+    test_partial_gradients();
+    test_checkpointing();
     printf("Success!\n");
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// Check that im(x, y) = x + y + offset everywhere.
+bool check(Buffer<int> im, int offset) {
+    for (int y = 0; y < im.height(); y++) {
+        for (int x = 0; x < im.width(); x++) {
+            if (im(x, y) != x + y + offset) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Var x("x"), y("y");
+
+    {
+        Func f("f");
+        f(x, y) = x + y;
+        f.vectorize(x, 8).parallel(y);
+        Pipeline p(f);
+
+        std::shared_future<void *> compiled = p.compile_jit_async();
+        if (compiled.get() == nullptr) {
+            printf("compile_jit_async produced no function\n");
+            return -1;
+        }
+
+        // realize uses the module compiled in the background.
+        Buffer<int> im = p.realize(64, 64);
+        if (!check(im, 0)) {
+            printf("Wrong output from background-compiled pipeline\n");
+            return -1;
+        }
+    }
+
+    {
+        // realize waits for a compilation it starts in the middle of.
+        Func f("f");
+        f(x, y) = x + y;
+        f.vectorize(x, 8);
+        Pipeline p(f);
+        p.compile_jit_async();
+        Buffer<int> im = p.realize(64, 64);
+        if (!check(im, 0)) {
+            printf("Wrong output while waiting for the background compilation\n");
+            return -1;
+        }
+    }
+
+    {
+        // A fallback that can be told apart from the pipeline.
+        Func slow("slow");
+        slow(x, y) = x + y + 1000;
+        Pipeline fallback(slow);
+        fallback.compile_jit();
+
+        Func f("f");
+        f(x, y) = x + y;
+        f.vectorize(x, 8).parallel(y);
+        Pipeline p(f);
+        p.set_jit_fallback(fallback);
+
+        std::shared_future<void *> compiled = p.compile_jit_async();
+
+        // Until the compilation is done, either pipeline may run.
+        Buffer<int> im = p.realize(64, 64);
+        if (!check(im, 0) && !check(im, 1000)) {
+            printf("Wrong output while compiling in the background\n");
+            return -1;
+        }
+
+        compiled.wait();
+        im = p.realize(64, 64);
+        if (!check(im, 0)) {
+            printf("The fallback ran after the compilation was done\n");
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "Halide.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+using namespace Halide;
+
+#ifndef _WIN32
+std::vector<std::string> list_dir(const std::string &dir) {
+    std::vector<std::string> result;
+    DIR *d = opendir(dir.c_str());
+    if (!d) return result;
+    while (dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name != "." && name != "..") {
+            result.push_back(dir + "/" + name);
+        }
+    }
+    closedir(d);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// Identify the version of each file. Entries are written to a
+// temporary file that is renamed into place, so rewriting one changes
+// its inode.
+std::vector<std::pair<ino_t, time_t>> file_versions(const std::vector<std::string> &files) {
+    std::vector<std::pair<ino_t, time_t>> result;
+    for (const std::string &f : files) {
+        struct stat s;
+        if (stat(f.c_str(), &s) == 0) {
+            result.push_back({s.st_ino, s.st_mtime});
+        }
+    }
+    return result;
+}
+#endif
+
+// Replaces the constant 3.25f in the lowered pipeline.
+class ReplaceConstant : public Internal::IRMutator2 {
+    float value;
+
+    using IRMutator2::visit;
+
+    Expr visit(const Internal::FloatImm *op) override {
+        if (op->value == 3.25) {
+            return Internal::FloatImm::make(op->type, value);
+        }
+        return op;
+    }
+
+public:
+    ReplaceConstant(float value) : value(value) {}
+};
+
+int check(Buffer<float> im, float scale = 3.25f) {
+    for (int y = 0; y < im.height(); y++) {
+        for (int x = 0; x < im.width(); x++) {
+            float correct = (x * 0.5f + y) * scale;
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %f instead of %f\n", x, y, im(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+Buffer<float> run(int vector_width = 8, float replacement = 0) {
+    Var x("x"), y("y");
+    Func f("f"), g("g");
+    f(x, y) = x * 0.5f + y;
+    g(x, y) = f(x, y) * 3.25f;
+    f.compute_root().vectorize(x, 4);
+    g.vectorize(x, vector_width);
+    if (replacement) {
+        g.add_custom_lowering_pass(new ReplaceConstant(replacement));
+    }
+    return g.realize(64, 32);
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    printf("Skipping test on Windows\n");
+    return 0;
+#else
+    std::string dir = Internal::dir_make_temp();
+    setenv("HL_JIT_CACHE_DIR", dir.c_str(), 1);
+
+    if (check(run()) != 0) {
+        return -1;
+    }
+
+    // The object and the declarations of the pipeline.
+    std::vector<std::string> files = list_dir(dir);
+    if (files.size() != 2) {
+        printf("Expected 2 files in the JIT cache, got %d\n", (int)files.size());
+        return -1;
+    }
+
+    // Compile the same pipeline again, which should use the cached
+    // object rather than write it again.
+    auto versions = file_versions(files);
+    if (check(run()) != 0) {
+        return -1;
+    }
+    if (list_dir(dir) != files || file_versions(files) != versions) {
+        printf("The JIT cache was written to when it should have been hit\n");
+        return -1;
+    }
+
+    // A different schedule misses, and adds another entry.
+    if (check(run(4)) != 0) {
+        return -1;
+    }
+    if (list_dir(dir).size() != 4) {
+        printf("Expected 4 files in the JIT cache, got %d\n", (int)list_dir(dir).size());
+        return -1;
+    }
+
+    // Pipelines that differ only in what their custom lowering passes
+    // do must not share an entry.
+    if (check(run(8, 2.0f), 2.0f) != 0 ||
+        check(run(8, 4.0f), 4.0f) != 0) {
+        return -1;
+    }
+
+    unsetenv("HL_JIT_CACHE_DIR");
+    for (const std::string &f : list_dir(dir)) {
+        Internal::file_unlink(f);
+    }
+    Internal::dir_rmdir(dir);
+
+    printf("Success!\n");
+    return 0;
+#endif
+}
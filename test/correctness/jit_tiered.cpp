@@ -0,0 +1,133 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+using namespace Halide;
+
+// Counts the times the pipeline is lowered, noting the thread each
+// compilation ran on, and adds 100 times the number of the
+// compilation to the constant 3, so that the output shows which
+// compilation produced the code that ran.
+class CountCompiles : public Internal::IRMutator2 {
+    using IRMutator2::visit;
+
+    Expr visit(const Internal::FloatImm *op) override {
+        if (op->value == 3) {
+            return Internal::FloatImm::make(op->type, 3 + 100.0f * compile);
+        }
+        return op;
+    }
+
+    int compile = -1;
+
+public:
+    std::vector<std::thread::id> threads;
+
+    using IRMutator2::mutate;
+
+    Internal::Stmt mutate(const Internal::Stmt &s) override {
+        // The outermost call is the start of a compilation.
+        if (compile >= 0) {
+            return IRMutator2::mutate(s);
+        }
+        compile = (int)threads.size();
+        threads.push_back(std::this_thread::get_id());
+        Internal::Stmt result = IRMutator2::mutate(s);
+        compile = -1;
+        return result;
+    }
+};
+
+// Returns the compilation that produced the code that computed im, or
+// -1 if the output is wrong.
+int compilation_used(Buffer<float> im) {
+    int compile = (int)((im(0, 0) - 3) / 100 + 0.5f);
+    for (int y = 0; y < im.height(); y++) {
+        for (int x = 0; x < im.width(); x++) {
+            float correct = (x + y) * 0.5f + 3 + 100.0f * compile;
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %f instead of %f\n", x, y, im(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return compile;
+}
+
+// Realize a pipeline with the given tier threshold, and check that the fast tier
+// is compiled on this thread and runs until the optimized pipeline,
+// compiled on another thread, is ready.
+bool test_tiers(int threshold, const Target &t) {
+    Var x("x"), y("y");
+    Func f("f"), g("g");
+    f(x, y) = (x + y) * 0.5f;
+    g(x, y) = f(x, y) + 3;
+    f.compute_root().vectorize(x, 8);
+    g.vectorize(x, 8).parallel(y);
+
+    CountCompiles *counter = new CountCompiles;
+    Pipeline p(g);
+    p.add_custom_lowering_pass(counter);
+    p.set_jit_tier_threshold(threshold);
+
+    // The first realizations run the fast tier, and the last of them
+    // starts compiling the optimized pipeline. Realizations after that
+    // may switch to it as soon as it's ready.
+    bool switched = false;
+    for (int i = 0; i < threshold + 2; i++) {
+        int compile = compilation_used(p.realize(100, 50, t));
+        if (compile < 0) {
+            return false;
+        }
+        bool ok = (i < threshold) ? compile == 0 : (compile == 1 || (compile == 0 && !switched));
+        if (!ok) {
+            printf("Realization %d with threshold %d ran compilation %d\n", i, threshold, compile);
+            return false;
+        }
+        switched = (compile == 1);
+    }
+
+    // Wait for the optimized pipeline, which realize then switches to.
+    p.compile_jit_async(t).wait();
+    if (compilation_used(p.realize(100, 50, t)) != 1) {
+        printf("Realize didn't switch to the optimized pipeline with threshold %d\n", threshold);
+        return false;
+    }
+    if (counter->threads.size() != 2 ||
+        counter->threads[0] != std::this_thread::get_id() ||
+        counter->threads[1] == std::this_thread::get_id()) {
+        printf("With threshold %d, the fast tier must be compiled on the calling thread "
+               "and the optimized pipeline in the background (%d compilations)\n",
+               threshold, (int)counter->threads.size());
+        return false;
+    }
+
+    // Rescheduling goes back to the fast tier.
+    g.unroll(y, 2);
+    p.invalidate_cache();
+    int compile = compilation_used(p.realize(100, 50, t));
+    p.compile_jit_async(t).wait();
+    if (compile != 2 || counter->threads[2] != std::this_thread::get_id()) {
+        printf("Realize didn't go back to the fast tier after rescheduling\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment();
+    if (!Target(t.to_string() + "-fast_compile").has_feature(Target::FastCompile)) {
+        printf("fast_compile did not parse as a target feature\n");
+        return -1;
+    }
+
+    // With a threshold of one, the first realization compiles both
+    // tiers.
+    if (!test_tiers(1, t) || !test_tiers(3, t)) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int call_count = 0;
+
+extern "C" DLLEXPORT int count_calls_with_arg(uint8_t val, halide_buffer_t *out) {
+    if (!out->is_bounds_query()) {
+        call_count++;
+        Halide::Runtime::Buffer<uint8_t>(*out).fill(val);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    // Spill to an empty temporary directory
+    std::string dir = Internal::dir_make_temp();
+#ifdef _WIN32
+    _putenv_s("HL_MEMOIZE_CACHE_DIR", dir.c_str());
+#else
+    setenv("HL_MEMOIZE_CACHE_DIR", dir.c_str(), 1);
+#endif
+
+    Param<int> val;
+
+    Func count_calls;
+    count_calls.define_extern("count_calls_with_arg", {cast<uint8_t>(val)}, UInt(8), 2);
+
+    Var x, y;
+    Func f;
+    f(x, y) = count_calls(x, y) + cast<uint8_t>(x);
+    count_calls.compute_root().memoize();
+
+    // Keep (almost) nothing in memory, so results are evicted to disk
+    // as soon as they are no longer in use.
+    Internal::JITSharedRuntime::memoization_cache_set_size(1);
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int v = 0; v < 50; v++) {
+            val.set(v);
+            Buffer<uint8_t> out = f.realize(64, 64);
+            for (int y = 0; y < 64; y++) {
+                for (int x = 0; x < 64; x++) {
+                    if (out(x, y) != (uint8_t)(v + x)) {
+                        printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), v + x);
+                        return -1;
+                    }
+                }
+            }
+        }
+        // The second pass should find everything in memory or on disk.
+        if (call_count != 50) {
+            printf("Call count after pass %d is %d instead of 50\n", pass, call_count);
+            return -1;
+        }
+    }
+
+    // A Func with the same name but a different definition must not be
+    // given the results of the old one, from memory or from disk.
+    for (int redefined = 0; redefined < 2; redefined++) {
+        Func g("memoized_g");
+        g(x, y) = cast<uint8_t>(redefined ? x * 2 + val : x + val);
+        g.compute_root().memoize();
+        Func h;
+        h(x, y) = g(x, y);
+        val.set(7);
+        Buffer<uint8_t> out = h.realize(16, 16);
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < 16; x++) {
+                uint8_t correct = (uint8_t)((redefined ? x * 2 : x) + 7);
+                if (out(x, y) != correct) {
+                    printf("g(%d, %d) = %d instead of %d after redefining it %d times\n",
+                           x, y, out(x, y), correct, redefined);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    Internal::JITSharedRuntime::memoization_cache_set_size(0);
+
+    // Turn the tier off, so that nothing is spilled at exit, and clean up.
+    typedef int (*set_disk_tier_fn)(void *, const char *, int64_t);
+    set_disk_tier_fn set_disk_tier = (set_disk_tier_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_memoization_cache_set_disk_tier");
+    if (set_disk_tier == nullptr || set_disk_tier(nullptr, nullptr, 0) != 0) {
+        printf("Failed to turn the disk tier off\n");
+        return -1;
+    }
+    Internal::ensure_no_file_exists(dir + "/halide_memoize.0.log");
+    Internal::ensure_no_file_exists(dir + "/halide_memoize.1.log");
+    Internal::dir_rmdir(dir);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include "Halide.h"
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int call_count[256];
+
+extern "C" DLLEXPORT int count_calls_with_arg(uint8_t val, halide_buffer_t *out) {
+    if (!out->is_bounds_query()) {
+        call_count[val]++;
+        if (val == 100) {
+            // Expensive to recompute
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        Halide::Runtime::Buffer<uint8_t>(*out).fill(val);
+    }
+    return 0;
+}
+
+Param<int> val;
+Func f;
+
+// Realize the memoized Func for a value at a size of size x size bytes.
+bool run(int v, int size) {
+    val.set(v);
+    Buffer<uint8_t> out = f.realize(size, size);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            if (out(x, y) != (uint8_t)(v + x)) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), v + x);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool check_calls(int v, int expected) {
+    if (call_count[v] != expected) {
+        printf("Call count for %d is %d instead of %d\n", v, call_count[v], expected);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Func count_calls;
+    count_calls.define_extern("count_calls_with_arg", {cast<uint8_t>(val)}, UInt(8), 2);
+
+    Var x, y;
+    f(x, y) = count_calls(x, y) + cast<uint8_t>(x);
+    count_calls.compute_root().memoize();
+
+    const int small = 32 * 32, large = 128 * 128;
+
+    // The cache is sharded by key, but its size is shared: results
+    // that fit together are all kept, even when each of them is larger
+    // than an even share of the cache.
+    Internal::JITSharedRuntime::memoization_cache_set_size(14 * large);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int v = 0; v < 12; v++) {
+            if (!run(v, 128) || !check_calls(v, 1)) {
+                return -1;
+            }
+        }
+    }
+
+    typedef void (*set_policy_fn)(void *, halide_memoization_eviction_policy_t);
+    set_policy_fn set_policy = (set_policy_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_memoization_cache_set_eviction_policy");
+    if (set_policy == nullptr) {
+        printf("halide_memoization_cache_set_eviction_policy not found\n");
+        return -1;
+    }
+
+    // Room for one large and two small results
+    const int64_t cache_size = large + 2 * small + small / 2;
+
+    // Least recently used: storing a third small result evicts the
+    // large one, which was used least recently.
+    Internal::JITSharedRuntime::memoization_cache_set_size(1);
+    Internal::JITSharedRuntime::memoization_cache_set_size(cache_size);
+    set_policy(nullptr, halide_memoization_evict_lru);
+    if (!run(20, 128) || !run(21, 32) || !run(22, 32) || !run(23, 32) ||
+        !run(21, 32) || !check_calls(21, 1) ||
+        !run(20, 128) || !check_calls(20, 2)) {
+        return -1;
+    }
+
+    // Size aware: the large result is evicted first even though a small
+    // one was used less recently.
+    Internal::JITSharedRuntime::memoization_cache_set_size(1);
+    Internal::JITSharedRuntime::memoization_cache_set_size(cache_size);
+    set_policy(nullptr, halide_memoization_evict_size_aware);
+    if (!run(31, 32) || !run(30, 128) || !run(32, 32) || !run(33, 32) ||
+        !run(31, 32) || !check_calls(31, 1) ||
+        !run(30, 128) || !check_calls(30, 2)) {
+        return -1;
+    }
+
+    // Cost aware: with results of equal size, the one that took longest
+    // to compute is kept even though it was used least recently.
+    Internal::JITSharedRuntime::memoization_cache_set_size(1);
+    Internal::JITSharedRuntime::memoization_cache_set_size(3 * small + small / 2);
+    set_policy(nullptr, halide_memoization_evict_cost_aware);
+    if (!run(40, 32) || !run(100, 32) || !run(41, 32) || !run(42, 32) || !run(43, 32) ||
+        !run(100, 32) || !check_calls(100, 1)) {
+        return -1;
+    }
+
+    set_policy(nullptr, halide_memoization_evict_lru);
+    Internal::JITSharedRuntime::memoization_cache_set_size(0);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string>
+#include "Halide.h"
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+extern "C" DLLEXPORT int count_calls_with_arg(uint8_t val, halide_buffer_t *out) {
+    if (!out->is_bounds_query()) {
+        Halide::Runtime::Buffer<uint8_t>(*out).fill(val);
+    }
+    return 0;
+}
+
+typedef void (*get_stats_fn)(void *, halide_memoization_cache_stats_t *);
+typedef int (*get_func_stats_fn)(void *, halide_memoization_cache_func_stats_t *, int);
+typedef void (*reset_stats_fn)(void *);
+
+bool check(const char *what, const char *counter, int64_t actual, int64_t expected) {
+    if (actual != expected) {
+        printf("%s: %s is %lld instead of %lld\n", what, counter,
+               (long long)actual, (long long)expected);
+        return false;
+    }
+    return true;
+}
+
+bool check_counts(const char *what, const halide_memoization_cache_stats_t &stats,
+                  int hits, int misses, int stores, int evictions) {
+    return check(what, "hits", stats.hits, hits) &&
+           check(what, "misses", stats.misses, misses) &&
+           check(what, "stores", stats.stores, stores) &&
+           check(what, "evictions", stats.evictions, evictions) &&
+           check(what, "disk hits", stats.disk_hits, 0) &&
+           check(what, "disk spills", stats.disk_spills, 0);
+}
+
+// The statistics of the memoized Func with the given name, or NULL.
+const halide_memoization_cache_stats_t *find_func_stats(
+    const halide_memoization_cache_func_stats_t *stats, int num_funcs, const char *name) {
+    for (int i = 0; i < num_funcs; i++) {
+        if (std::string(stats[i].name) == name) {
+            return &stats[i].stats;
+        }
+    }
+    printf("No statistics for %s\n", name);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    Param<int> val;
+
+    Func fa("fa"), fb("fb");
+    fa.define_extern("count_calls_with_arg", {cast<uint8_t>(val)}, UInt(8), 2);
+    fb.define_extern("count_calls_with_arg", {cast<uint8_t>(7)}, UInt(8), 2);
+
+    Var x, y;
+    Func f;
+    f(x, y) = fa(x, y) + fb(x, y);
+    fa.compute_root().memoize();
+    fb.compute_root().memoize();
+
+    // Compile and run once so that the runtime exists, then start from
+    // an empty cache and zero counts.
+    val.set(0);
+    f.realize(64, 64);
+
+    get_stats_fn get_stats = (get_stats_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_memoization_cache_get_stats");
+    get_func_stats_fn get_func_stats = (get_func_stats_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_memoization_cache_get_func_stats");
+    reset_stats_fn reset_stats = (reset_stats_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_memoization_cache_reset_stats");
+    if (get_stats == nullptr || get_func_stats == nullptr || reset_stats == nullptr) {
+        printf("Memoization cache statistics not found in the runtime\n");
+        return -1;
+    }
+
+    Internal::JITSharedRuntime::memoization_cache_set_size(1);
+    Internal::JITSharedRuntime::memoization_cache_set_size(0);
+    reset_stats(nullptr);
+
+    // fa and fb miss, then both hit, then only fa misses.
+    val.set(1);
+    f.realize(64, 64);
+    f.realize(64, 64);
+    val.set(2);
+    f.realize(64, 64);
+
+    halide_memoization_cache_stats_t stats;
+    get_stats(nullptr, &stats);
+    if (!check_counts("total", stats, 3, 3, 3, 0) ||
+        !check("total", "entries resident", stats.entries_resident, 3) ||
+        !check("total", "bytes resident", stats.bytes_resident, 3 * 64 * 64) ||
+        !check("total", "in use pins", stats.in_use_pins, 0)) {
+        return -1;
+    }
+
+    halide_memoization_cache_func_stats_t func_stats[16];
+    int num_funcs = get_func_stats(nullptr, func_stats, 16);
+    const halide_memoization_cache_stats_t *fa_stats = find_func_stats(func_stats, num_funcs, "fa");
+    const halide_memoization_cache_stats_t *fb_stats = find_func_stats(func_stats, num_funcs, "fb");
+    if (!fa_stats || !fb_stats ||
+        !check_counts("fa", *fa_stats, 1, 2, 2, 0) ||
+        !check("fa", "entries resident", fa_stats->entries_resident, 2) ||
+        !check_counts("fb", *fb_stats, 2, 1, 1, 0) ||
+        !check("fb", "entries resident", fb_stats->entries_resident, 1)) {
+        return -1;
+    }
+
+    // Shrinking the cache evicts everything, none of it is in use.
+    Internal::JITSharedRuntime::memoization_cache_set_size(1);
+    get_stats(nullptr, &stats);
+    if (!check_counts("total", stats, 3, 3, 3, 3) ||
+        !check("total", "entries resident", stats.entries_resident, 0) ||
+        !check("total", "bytes resident", stats.bytes_resident, 0)) {
+        return -1;
+    }
+    num_funcs = get_func_stats(nullptr, func_stats, 16);
+    fa_stats = find_func_stats(func_stats, num_funcs, "fa");
+    fb_stats = find_func_stats(func_stats, num_funcs, "fb");
+    if (!fa_stats || !fb_stats ||
+        !check_counts("fa", *fa_stats, 1, 2, 2, 2) ||
+        !check_counts("fb", *fb_stats, 2, 1, 1, 1)) {
+        return -1;
+    }
+
+    // Resetting zeroes the counts of the total and of each Func.
+    reset_stats(nullptr);
+    get_stats(nullptr, &stats);
+    if (!check_counts("total", stats, 0, 0, 0, 0)) {
+        return -1;
+    }
+    num_funcs = get_func_stats(nullptr, func_stats, 16);
+    fa_stats = find_func_stats(func_stats, num_funcs, "fa");
+    if (!fa_stats || !check_counts("fa", *fa_stats, 0, 0, 0, 0)) {
+        return -1;
+    }
+
+    Internal::JITSharedRuntime::memoization_cache_set_size(0);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+int mallocs = 0, frees = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    mallocs++;
+    void *orig = malloc(x + 64);
+    void *ptr = (void *)((((size_t)orig + 64) >> 6) << 6);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    frees++;
+    free(((void **)ptr)[-1]);
+}
+
+// Sizes that depend on a name bound more than once can't be hoisted,
+// since it's unclear which binding they mean.
+bool check_rebound_names_not_hoisted() {
+    using namespace Internal;
+    Expr a = Variable::make(Int(32), "a");
+    Expr b = Variable::make(Int(32), "b");
+    Stmt body = Evaluate::make(a + b);
+    Stmt s = Block::make(LetStmt::make("a", 1, LetStmt::make("b", 2, body)),
+                         LetStmt::make("a", 3, body));
+    PipelineLets lets = find_pipeline_lets(s);
+    if (!hoist_expr(b * 2, {}, lets).defined()) {
+        printf("Could not hoist an expression of a name bound once\n");
+        return false;
+    }
+    if (hoist_expr(a * 2, {}, lets).defined() ||
+        hoist_expr(a * 2, {"a"}, lets).defined()) {
+        printf("Hoisted an expression of a name bound twice\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (!check_rebound_names_not_hoisted()) {
+        return -1;
+    }
+
+    Var x, y;
+
+    // A chain of root stages, each reading only the one before it, so
+    // at most two of them are live at once.
+    const int stages = 6;
+    std::vector<Func> f(stages);
+    f[0](x, y) = x + y;
+    f[0].compute_root();
+    for (int i = 1; i < stages; i++) {
+        f[i](x, y) = f[i - 1](x, y) + f[i - 1](x + 1, y);
+        if (i < stages - 1) {
+            f[i].compute_root().parallel(y);
+        }
+    }
+    Func out = f[stages - 1];
+    out.set_custom_allocator(my_malloc, my_free);
+
+    const int W = 300, H = 200;
+    Target t = get_jit_target_from_environment();
+    for (bool pack : {false, true}) {
+        mallocs = frees = 0;
+        Buffer<int> im = out.realize(W, H, pack ? t.with_feature(Target::PackAllocs) : t);
+
+        // Packing is opt-in. Without it, each of the five
+        // intermediates has its own allocation; with it, they should
+        // fit in two pieces of storage.
+        int expected = pack ? 2 : stages - 1;
+        if (mallocs != expected || frees != expected) {
+            printf("%d mallocs and %d frees instead of %d of each\n", mallocs, frees, expected);
+            return -1;
+        }
+
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                // f[n](x, y) = sum over k of C(n, k) * (x + k + y)
+                int correct = 0;
+                int binomial = 1;
+                for (int k = 0; k < stages; k++) {
+                    correct += binomial * (x + k + y);
+                    binomial = binomial * (stages - 1 - k) / (k + 1);
+                }
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Select NUMA mode before the thread pool starts
+#ifdef _WIN32
+    _putenv_s("HL_NUMA", "1");
+#else
+    setenv("HL_NUMA", "1", 1);
+#endif
+
+    Var x, y;
+    Func f, g;
+
+    // A producer big enough to get first-touch pages, consumed with a
+    // stencil by a loop partitioned the same way.
+    f(x, y) = x + y*1024;
+    g(x, y) = f(x, y) + f(x, y + 1);
+
+    f.compute_root().parallel(y);
+    g.parallel(y);
+
+    for (int i = 0; i < 10; i++) {
+        Buffer<int> im = g.realize(1024, 1023);
+
+        for (int y = 0; y < 1023; y++) {
+            for (int x = 0; x < 1024; x++) {
+                int correct = 2*x + (2*y + 1)*1024;
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
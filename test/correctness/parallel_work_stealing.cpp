@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Select the work-stealing scheduler before the thread pool starts
+#ifdef _WIN32
+    _putenv_s("HL_WORK_STEALING", "1");
+#else
+    setenv("HL_WORK_STEALING", "1", 1);
+#endif
+
+    Var x, y, z;
+    Func f, g;
+
+    Param<int> k;
+    k.set(3);
+
+    // Nested parallel loops with uneven work per task
+    f(x, y, z) = x*y+z*k+1;
+    g(x, y) = 0;
+    RDom r(0, 64);
+    g(x, y) += select(r < x, f(x, y, r), 0);
+
+    f.compute_root().parallel(x).parallel(y).parallel(z);
+    g.parallel(y).update().parallel(y).parallel(x);
+
+    for (int i = 0; i < 10; i++) {
+        Buffer<int> im = g.realize(64, 64);
+
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++) {
+                int correct = 0;
+                for (int z = 0; z < x; z++) {
+                    correct += x*y+z*3+1;
+                }
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
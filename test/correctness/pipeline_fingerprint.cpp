@@ -0,0 +1,76 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+struct Options {
+    float scale = 1.5f;
+    bool vectorize = false;
+    int param_min = 0;
+    std::string debug_file;
+};
+
+Pipeline make_pipeline(const Options &opt) {
+    ImageParam in(Float(32), 2, "in");
+    Param<int> offset("offset");
+    offset.set_range(opt.param_min, 100);
+
+    Var x("x"), y("y");
+    Func f("f"), g("g");
+    f(x, y) = in(x, y) * opt.scale + offset;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    f.compute_root();
+    if (opt.vectorize) {
+        g.vectorize(x, 8);
+    }
+    if (!opt.debug_file.empty()) {
+        f.debug_to_file(opt.debug_file);
+    }
+    return Pipeline(g);
+}
+
+int main(int argc, char **argv) {
+    Target t("host");
+    Options opt;
+    std::string base = make_pipeline(opt).fingerprint(t);
+
+    // The same pipeline, built again, has the same fingerprint.
+    if (make_pipeline(opt).fingerprint(t) != base) {
+        printf("Identical pipelines have different fingerprints\n");
+        return -1;
+    }
+
+    // Changing the definition, schedule, Param metadata, debug file or
+    // target changes it.
+    Options o1 = opt;
+    o1.scale = 1.5000001f;
+    Options o2 = opt;
+    o2.vectorize = true;
+    Options o3 = opt;
+    o3.param_min = 1;
+    Options o4 = opt;
+    o4.debug_file = "f.tiff";
+    Options o5 = opt;
+    o5.debug_file = "f.tmp";
+    std::string fingerprints[] = {
+        make_pipeline(o1).fingerprint(t),
+        make_pipeline(o2).fingerprint(t),
+        make_pipeline(o3).fingerprint(t),
+        make_pipeline(o4).fingerprint(t),
+        make_pipeline(opt).fingerprint(t.with_feature(Target::NoAsserts)),
+    };
+    for (int i = 0; i < 5; i++) {
+        if (fingerprints[i] == base) {
+            printf("Change %d did not change the fingerprint\n", i);
+            return -1;
+        }
+    }
+
+    if (make_pipeline(o4).fingerprint(t) == make_pipeline(o5).fingerprint(t)) {
+        printf("Pipelines debugging to different files have the same fingerprint\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
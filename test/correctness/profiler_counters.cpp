@@ -0,0 +1,99 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Halide;
+
+// The pipeline's hardware event counts, parsed from the profiler's
+// report, and whether any Func's instructions per cycle were reported.
+long long cycles = 0, instructions = 0;
+bool func_ipc = false;
+void my_print(void *, const char *msg) {
+    long long this_cycles, this_instructions;
+    const char *line = strstr(msg, " cycles:");
+    if (line && sscanf(line, " cycles: %lld instructions: %lld", &this_cycles, &this_instructions) == 2) {
+        cycles = this_cycles;
+        instructions = this_instructions;
+    }
+    if (strstr(msg, " ipc: ")) {
+        func_ipc = true;
+    }
+}
+
+void run(Func g, const Target &t) {
+    cycles = instructions = 0;
+    func_ipc = false;
+    g.realize(1000, 1000, t);
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    _putenv_s("HL_PROFILER_COUNTERS", "0");
+#else
+    setenv("HL_PROFILER_COUNTERS", "0", 1);
+#endif
+
+    Func f("f"), g("g");
+    Var x, y;
+    Expr e = cast<float>(x + y);
+    for (int i = 0; i < 50; i++) {
+        e = sin(e);
+    }
+    f(x, y) = e;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    f.compute_root().parallel(y);
+    g.parallel(y);
+    g.set_custom_print(&my_print);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+
+    // Counters are off.
+    run(g, t);
+    if (cycles || func_ipc) {
+        printf("Hardware event counts were reported with counters off\n");
+        return -1;
+    }
+
+    typedef int (*set_counters_fn)(int);
+    set_counters_fn set_counters = (set_counters_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_profiler_set_counters");
+    if (set_counters == nullptr) {
+        printf("halide_profiler_set_counters not found in the runtime\n");
+        return -1;
+    }
+    if (set_counters(1) != 0) {
+        printf("halide_profiler_set_counters didn't return the old setting\n");
+        return -1;
+    }
+
+    // Counters are on. Without a PMU, or if perf_event_paranoid doesn't
+    // allow counting, the counts stay zero.
+    run(g, t);
+    if (cycles == 0) {
+        printf("No hardware event counts were reported; counters may be unavailable here\n");
+        if (func_ipc) {
+            printf("A Func's instructions per cycle were reported without cycles for the pipeline\n");
+            return -1;
+        }
+    } else if (instructions <= 0 || !func_ipc) {
+        printf("Counted %lld cycles, but %lld instructions, and %s instructions per cycle for the Funcs\n",
+               cycles, instructions, func_ipc ? "some" : "no");
+        return -1;
+    } else {
+        printf("Counted %lld cycles and %lld instructions\n", cycles, instructions);
+    }
+
+    if (set_counters(0) != 1) {
+        printf("halide_profiler_set_counters didn't return the old setting\n");
+        return -1;
+    }
+    run(g, t);
+    if (cycles || func_ipc) {
+        printf("Hardware event counts were reported after turning counters off\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace Halide;
+
+typedef uint64_t (*latency_percentile_fn)(const char *, const char *, float);
+typedef int (*latency_json_fn)(char *, int);
+typedef halide_profiler_state *(*get_state_fn)();
+
+// Check that a histogram holds the given number of latencies, and that
+// its buckets add up.
+bool check_histogram(const char *what, const halide_profiler_latency_histogram *h, uint64_t runs) {
+    if (!h) {
+        printf("No latency histogram for %s\n", what);
+        return false;
+    }
+    uint64_t in_buckets = 0;
+    for (int b = 0; b < halide_profiler_latency_buckets; b++) {
+        in_buckets += h->buckets[b];
+    }
+    if (h->count != runs || in_buckets != runs) {
+        printf("The latency histogram for %s holds %d latencies in %d buckets instead of %d\n",
+               what, (int)h->count, (int)in_buckets, (int)runs);
+        return false;
+    }
+    if (h->max == 0 || h->total < h->max || h->total > h->max * runs) {
+        printf("The latency histogram for %s has a total of %llu ns and a max of %llu ns\n",
+               what, (unsigned long long)h->total, (unsigned long long)h->max);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // Latencies are recorded without the sampling thread.
+#ifdef _WIN32
+    _putenv_s("HL_PROFILER_SAMPLING", "0");
+#else
+    setenv("HL_PROFILER_SAMPLING", "0", 1);
+#endif
+
+    Func f("f"), g("g");
+    Var x, y;
+    Expr e = cast<float>(x + y);
+    for (int i = 0; i < 20; i++) {
+        e = sin(e);
+    }
+    f(x, y) = e;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    f.compute_root();
+
+    // Realizing a profiled pipeline reports and resets the profiler's
+    // statistics, so call the compiled pipeline directly instead. The
+    // handlers treat a null user context as the default one.
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    Pipeline p(g);
+    typedef int (*pipeline_fn)(void *, halide_buffer_t *);
+    pipeline_fn fn = (pipeline_fn)p.compile_jit(t);
+
+    const int runs = 20;
+    Buffer<float> out(200, 100);
+    for (int i = 0; i < runs; i++) {
+        if (fn(nullptr, out.raw_buffer()) != 0) {
+            printf("The pipeline failed\n");
+            return -1;
+        }
+    }
+
+    latency_percentile_fn latency_percentile = (latency_percentile_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_profiler_latency_percentile");
+    latency_json_fn latency_json = (latency_json_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_profiler_latency_json");
+    get_state_fn get_state = (get_state_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_profiler_get_state");
+    if (!latency_percentile || !latency_json || !get_state) {
+        printf("Profiler functions not found in the runtime\n");
+        return -1;
+    }
+
+    // The histograms of the pipeline and of f, which is computed at root
+    const halide_profiler_pipeline_stats *stats = nullptr;
+    for (const halide_profiler_pipeline_stats *s = get_state()->pipelines; s;
+         s = (const halide_profiler_pipeline_stats *)s->next) {
+        if (strcmp(s->name, "g") == 0) {
+            stats = s;
+        }
+    }
+    if (!stats) {
+        printf("No profiler statistics for the pipeline\n");
+        return -1;
+    }
+    const halide_profiler_latency_histogram *f_latency = nullptr;
+    for (int i = 0; i < stats->num_funcs; i++) {
+        if (strcmp(stats->funcs[i].name, "f") == 0) {
+            f_latency = stats->funcs[i].latency;
+        }
+    }
+    if (!check_histogram("the pipeline", stats->latency, runs) ||
+        !check_histogram("f", f_latency, runs)) {
+        return -1;
+    }
+    if (f_latency->max > stats->latency->max) {
+        printf("f took longer than the whole pipeline\n");
+        return -1;
+    }
+
+    // Percentiles are accurate to within a bucket, and never exceed the max.
+    for (const char *func : {(const char *)nullptr, "f"}) {
+        const halide_profiler_latency_histogram *h = func ? f_latency : stats->latency;
+        uint64_t p50 = latency_percentile("g", func, 50);
+        uint64_t p99 = latency_percentile("g", func, 99);
+        uint64_t p100 = latency_percentile("g", func, 100);
+        if (p50 == 0 || p50 > p99 || p99 > p100 || p100 > h->max ||
+            p100 * 1.07 < h->max) {
+            printf("Percentiles of %s out of order: p50 %llu, p99 %llu, p100 %llu, max %llu\n",
+                   func ? func : "the pipeline",
+                   (unsigned long long)p50, (unsigned long long)p99,
+                   (unsigned long long)p100, (unsigned long long)h->max);
+            return -1;
+        }
+    }
+    if (latency_percentile("g", "not_a_func", 50) != 0 ||
+        latency_percentile("not_a_pipeline", nullptr, 50) != 0) {
+        printf("Percentiles of unknown pipelines and Funcs should be zero\n");
+        return -1;
+    }
+
+    // The JSON is truncated to the buffer, but its whole length is
+    // returned.
+    char small[16];
+    int length = latency_json(small, sizeof(small));
+    if (length <= (int)sizeof(small) || strlen(small) != sizeof(small) - 1) {
+        printf("The JSON wasn't truncated properly\n");
+        return -1;
+    }
+    std::vector<char> buf(length + 1);
+    if (latency_json(buf.data(), (int)buf.size()) != length) {
+        printf("The JSON changed length\n");
+        return -1;
+    }
+    std::string json(buf.data());
+    std::string count = "\"count\": " + std::to_string(runs);
+    size_t pipeline_pos = json.find("{\"name\": \"g\", \"latency\": " + count);
+    size_t f_pos = json.find("{\"name\": \"f\", \"latency\": " + count);
+    if ((int)json.size() != length ||
+        pipeline_pos == std::string::npos ||
+        f_pos == std::string::npos || f_pos < pipeline_pos ||
+        json.find("\"buckets\": [[") == std::string::npos) {
+        printf("Unexpected JSON:\n%s\n", json.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "Halide.h"
+
+using namespace Halide;
+
+struct Event {
+    int id, parent_id, event;
+    std::string func, tag;
+    std::vector<int> coords;
+    int value;
+};
+
+// Read the trace packets in the file from the given offset on.
+std::vector<Event> read_events(const std::string &path, long offset) {
+    std::vector<Event> events;
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return events;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    std::vector<uint8_t> data(size > offset ? size - offset : 0);
+    fseek(f, offset, SEEK_SET);
+    size_t read = fread(data.data(), 1, data.size(), f);
+    fclose(f);
+    for (size_t pos = 0; pos + sizeof(halide_trace_packet_t) <= read;) {
+        const halide_trace_packet_t *p = (const halide_trace_packet_t *)(data.data() + pos);
+        Event e;
+        e.id = p->id;
+        e.parent_id = p->parent_id;
+        e.event = p->event;
+        e.func = p->func();
+        e.tag = p->trace_tag();
+        e.coords.assign(p->coordinates(), p->coordinates() + p->dimensions);
+        e.value = (p->event == halide_trace_store) ? *(const int *)p->value() : 0;
+        events.push_back(e);
+        pos += p->size;
+    }
+    return events;
+}
+
+long file_size(const std::string &path) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+// Check the order of the events of one run of the pipeline: each event
+// comes after its parent, the stores to each Func with traced
+// realizations come between its begin and end realization events, and
+// each row, which is stored by a single thread, is stored in order.
+bool check_order(const char *what, const std::vector<Event> &events) {
+    std::map<int, size_t> position;
+    std::map<std::string, size_t> begin, end;
+    std::map<std::pair<std::string, int>, int> last_x;
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event &e = events[i];
+        position[e.id] = i;
+        if (e.event == halide_trace_begin_realization) {
+            begin[e.func] = i;
+        } else if (e.event == halide_trace_end_realization) {
+            end[e.func] = i;
+        }
+    }
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event &e = events[i];
+        if (e.parent_id != 0 && (!position.count(e.parent_id) || position[e.parent_id] > i)) {
+            printf("%s: event %d of %s comes before its parent %d\n", what, e.id, e.func.c_str(), e.parent_id);
+            return false;
+        }
+        if (e.event != halide_trace_store) {
+            continue;
+        }
+        if (begin.count(e.func) && (i < begin[e.func] || !end.count(e.func) || i > end[e.func])) {
+            printf("%s: store %d to %s is outside its realization\n", what, e.id, e.func.c_str());
+            return false;
+        }
+        std::pair<std::string, int> row(e.func, e.coords[1]);
+        if (last_x.count(row) && last_x[row] >= e.coords[0]) {
+            printf("%s: store to %s(%d, %d) comes after %s(%d, %d)\n", what,
+                   e.func.c_str(), e.coords[0], e.coords[1],
+                   e.func.c_str(), last_x[row], e.coords[1]);
+            return false;
+        }
+        last_x[row] = e.coords[0];
+    }
+    return true;
+}
+
+typedef std::tuple<std::string, int, int, int> Store;
+
+// The number of events of each kind for each Func, and the stores made.
+void summarize(const std::vector<Event> &events,
+               std::map<std::pair<std::string, int>, int> *counts,
+               std::set<Store> *stores) {
+    for (const Event &e : events) {
+        (*counts)[{e.func, e.event}]++;
+        if (e.event == halide_trace_store) {
+            stores->insert(Store(e.func, e.coords[0], e.coords[1], e.value));
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    Internal::TemporaryFile trace_file("tracing_ring_buffers", "bin");
+#ifdef _WIN32
+    _putenv_s("HL_TRACE_FILE", trace_file.pathname().c_str());
+    _putenv_s("HL_TRACE_RING", "0");
+#else
+    setenv("HL_TRACE_FILE", trace_file.pathname().c_str(), 1);
+    setenv("HL_TRACE_RING", "0", 1);
+#endif
+
+    Var x("x"), y("y");
+    Func f("f"), g("g");
+    f(x, y) = x * y;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    f.compute_root().parallel(y).trace_stores().trace_realizations();
+    g.parallel(y).trace_stores();
+    // A tag too big to be staged with other packets
+    const std::string long_tag(100 * 1024, 't');
+    g.add_trace_tag(long_tag);
+
+    // Through the shared buffer
+    g.realize(64, 64);
+    long shared_end = file_size(trace_file.pathname());
+    std::vector<Event> shared = read_events(trace_file.pathname(), 0);
+
+    typedef int (*set_ring_buffers_fn)(int);
+    typedef int (*shutdown_trace_fn)();
+    set_ring_buffers_fn set_ring_buffers = (set_ring_buffers_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_set_trace_ring_buffers");
+    shutdown_trace_fn shutdown_trace = (shutdown_trace_fn)Internal::JITSharedRuntime::get_runtime_function(
+        "halide_shutdown_trace");
+    if (set_ring_buffers == nullptr || shutdown_trace == nullptr) {
+        printf("Tracing functions not found in the runtime\n");
+        return -1;
+    }
+
+    // Through the rings
+    set_ring_buffers(1);
+    g.realize(64, 64);
+    std::vector<Event> rings = read_events(trace_file.pathname(), shared_end);
+    shutdown_trace();
+
+    const int expected_stores = 65 * 64 + 64 * 64;
+    std::map<std::pair<std::string, int>, int> shared_counts, ring_counts;
+    std::set<Store> shared_stores, ring_stores;
+    summarize(shared, &shared_counts, &shared_stores);
+    summarize(rings, &ring_counts, &ring_stores);
+    if ((int)shared_stores.size() != expected_stores) {
+        printf("%d stores traced through the shared buffer instead of %d\n",
+               (int)shared_stores.size(), expected_stores);
+        return -1;
+    }
+    if (rings.size() != shared.size() || ring_counts != shared_counts) {
+        printf("%d events traced through the rings, %d through the shared buffer\n",
+               (int)rings.size(), (int)shared.size());
+        for (const auto &c : shared_counts) {
+            printf("  %s event %d: %d vs %d\n", c.first.first.c_str(), c.first.second,
+                   ring_counts[c.first], c.second);
+        }
+        return -1;
+    }
+    if (ring_stores != shared_stores) {
+        printf("The stores traced through the rings differ from the shared buffer\n");
+        return -1;
+    }
+
+    if (!check_order("shared buffer", shared) || !check_order("rings", rings)) {
+        return -1;
+    }
+
+    // The rings are merged in id order, even though a thread may move
+    // between rings.
+    for (size_t i = 1; i < rings.size(); i++) {
+        if (rings[i].id <= rings[i - 1].id) {
+            printf("rings: event %d comes after event %d\n", rings[i].id, rings[i - 1].id);
+            return -1;
+        }
+    }
+
+    bool found_tag = false;
+    for (const Event &e : rings) {
+        found_tag |= (e.event == halide_trace_tag && e.tag == long_tag);
+    }
+    if (!found_tag) {
+        printf("The long trace tag was not written through the rings\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <set>
+#include <utility>
+
+using namespace Halide;
+
+std::set<std::pair<int, int>> loads, stores;
+int store_events = 0;
+int min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+bool out_of_region = false;
+
+int my_trace(void *user_context, const halide_trace_event_t *e) {
+    if (e->event != halide_trace_load && e->event != halide_trace_store) {
+        return 0;
+    }
+    if (std::string(e->func) != "f") {
+        return 0;
+    }
+    int lanes = e->type.lanes;
+    bool any_inside = false;
+    for (int i = 0; i < lanes; i++) {
+        int x = e->coordinates[2 * i];
+        int y = e->coordinates[2 * i + 1];
+        if (x >= min_x && x <= max_x && y >= min_y && y <= max_y) {
+            any_inside = true;
+        }
+        if (e->event == halide_trace_load) {
+            loads.insert({x, y});
+        } else {
+            stores.insert({x, y});
+        }
+    }
+    if (!any_inside) {
+        out_of_region = true;
+    }
+    if (e->event == halide_trace_store) {
+        store_events++;
+    }
+    return 0;
+}
+
+void reset() {
+    loads.clear();
+    stores.clear();
+    store_events = 0;
+    out_of_region = false;
+}
+
+int main(int argc, char **argv) {
+    Var x("x"), y("y");
+
+    // Only trace a box.
+    {
+        Func f("f"), g("g");
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) + f(x + 1, y);
+        f.compute_root().trace_stores().trace_loads()
+            .trace_region(x, 10, 5).trace_region(y, 20, 3);
+        g.set_custom_trace(&my_trace);
+
+        reset();
+        min_x = 10; max_x = 14; min_y = 20; max_y = 22;
+        g.realize(100, 100);
+        if (stores.size() != 15 || loads.size() != 15 || out_of_region) {
+            printf("Expected 15 stores and loads inside the region, got %d stores and %d loads%s\n",
+                   (int)stores.size(), (int)loads.size(), out_of_region ? ", some outside it" : "");
+            return -1;
+        }
+    }
+
+    // The same, vectorized. Each vector traced must overlap the box.
+    {
+        Func f("f"), g("g");
+        f(x, y) = x + y;
+        g(x, y) = f(x, y);
+        f.compute_root().vectorize(x, 8).trace_stores()
+            .trace_region(x, 10, 5).trace_region(y, 20, 3);
+        g.set_custom_trace(&my_trace);
+
+        reset();
+        min_x = 10; max_x = 14; min_y = 20; max_y = 22;
+        g.realize(96, 100);
+        // x in [10, 15) lies in the vector [8, 16)
+        if (store_events != 3 || out_of_region) {
+            printf("Expected 3 vector stores overlapping the region, got %d%s\n",
+                   store_events, out_of_region ? ", some outside it" : "");
+            return -1;
+        }
+    }
+
+    // Trace one in 16 sites. Loads and stores should pick the same ones.
+    {
+        Func f("f"), g("g");
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) * 2;
+        f.compute_root().trace_stores().trace_loads().trace_sample(16);
+        g.set_custom_trace(&my_trace);
+
+        reset();
+        min_x = 0; max_x = 99; min_y = 0; max_y = 99;
+        g.realize(100, 100);
+        if (stores.size() < 10000 / 32 || stores.size() > 10000 / 8) {
+            printf("Expected about %d sites to be traced, got %d\n",
+                   10000 / 16, (int)stores.size());
+            return -1;
+        }
+        if (loads != stores) {
+            printf("Loads and stores of different sites were traced\n");
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,14 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    ImageParam input(Int(32), 2, "input");
+
+    input.trace_loads();
+    input.trace_sample(0);
+
+    printf("Should have rejected a sample rate of zero!\n");
+    return 0;
+}
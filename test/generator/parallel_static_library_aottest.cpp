@@ -0,0 +1,48 @@
+#include <stdio.h>
+
+#include "HalideBuffer.h"
+#include "HalideRuntime.h"
+#include "parallel_static_library.h"
+
+using namespace Halide::Runtime;
+
+int main(int argc, char **argv) {
+    int lut[16];
+    for (int i = 0; i < 16; i++) {
+        lut[i] = (i * 7) % 16;
+    }
+
+    Buffer<int> input(64);
+    for (int x = 0; x < 64; x++) {
+        input(x) = x - 20;
+    }
+    Buffer<int> out_add_one(64), out_lookup(64), out_lookup_twice(64);
+
+    // The functions were compiled to separate objects; all of them
+    // must link and run.
+    if (add_one(input, out_add_one) != 0 ||
+        lookup(input, out_lookup) != 0 ||
+        lookup_twice(input, out_lookup_twice) != 0) {
+        printf("A function of the library failed\n");
+        return -1;
+    }
+
+    for (int x = 0; x < 64; x++) {
+        int i = input(x) < 0 ? 0 : input(x) > 15 ? 15 : input(x);
+        if (out_add_one(x) != input(x) + 1) {
+            printf("add_one(%d) = %d instead of %d\n", x, out_add_one(x), input(x) + 1);
+            return -1;
+        }
+        if (out_lookup(x) != lut[i]) {
+            printf("lookup(%d) = %d instead of %d\n", x, out_lookup(x), lut[i]);
+            return -1;
+        }
+        if (out_lookup_twice(x) != lut[lut[i]]) {
+            printf("lookup_twice(%d) = %d instead of %d\n", x, out_lookup_twice(x), lut[lut[i]]);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
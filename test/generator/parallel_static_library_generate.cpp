@@ -0,0 +1,55 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// This isn't a Generator: it builds a Module with several functions by
+// hand. add_one is independent of the others, while lookup and
+// lookup_twice share an embedded buffer, so compiling the Module to a
+// static library compiles two groups of functions in parallel.
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <output prefix> <target>\n", argv[0]);
+        return 1;
+    }
+    const std::string prefix = argv[1];
+    const Target target(argv[2]);
+
+    Buffer<int> lut(16, "lut");
+    for (int i = 0; i < 16; i++) {
+        lut(i) = (i * 7) % 16;
+    }
+
+    ImageParam input(Int(32), 1, "input");
+    Var x("x");
+
+    Func add_one("add_one");
+    add_one(x) = input(x) + 1;
+
+    Func lookup("lookup");
+    lookup(x) = lut(clamp(input(x), 0, 15));
+
+    Func lookup_twice("lookup_twice");
+    lookup_twice(x) = lut(clamp(lut(clamp(input(x), 0, 15)), 0, 15));
+
+    Module m("parallel_static_library", target);
+    for (Func f : {add_one, lookup, lookup_twice}) {
+        Module fm = f.compile_to_module({input}, f.name(), target);
+        for (const Buffer<> &b : fm.buffers()) {
+            bool seen = false;
+            for (const Buffer<> &existing : m.buffers()) {
+                seen |= (existing.name() == b.name());
+            }
+            if (!seen) {
+                m.append(b);
+            }
+        }
+        for (const Internal::LoweredFunc &lf : fm.functions()) {
+            m.append(lf);
+        }
+    }
+
+    const std::string lib_suffix = target.os == Target::Windows ? ".lib" : ".a";
+    m.compile(Outputs().static_library(prefix + lib_suffix).c_header(prefix + ".h"));
+    return 0;
+}
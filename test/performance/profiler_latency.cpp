@@ -0,0 +1,50 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Halide;
+
+float p50 = -1, p99 = -1, max_ms = -1;
+void my_print(void *, const char *msg) {
+    float this_p50, this_p99, this_max;
+    const char *line = strstr(msg, " latency p50:");
+    if (line && sscanf(line, " latency p50: %f ms p99: %f ms max: %f ms", &this_p50, &this_p99, &this_max) == 3) {
+        p50 = this_p50;
+        p99 = this_p99;
+        max_ms = this_max;
+    }
+}
+
+int main(int argc, char **argv) {
+    // Latencies are recorded without the sampling thread.
+#ifdef _WIN32
+    _putenv_s("HL_PROFILER_SAMPLING", "0");
+#else
+    setenv("HL_PROFILER_SAMPLING", "0", 1);
+#endif
+
+    Func f("f"), g("g");
+    Var x, y;
+    Expr e = cast<float>(x + y);
+    for (int i = 0; i < 50; i++) {
+        e = sin(e);
+    }
+    f(x, y) = e;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    f.compute_root();
+    g.set_custom_print(&my_print);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    g.realize(1000, 100, t);
+
+    printf("latency p50: %fms p99: %fms max: %fms\n", p50, p99, max_ms);
+
+    if (p50 <= 0 || p50 > p99 || p99 > max_ms * 1.07f || max_ms > 10000) {
+        printf("Latency percentiles are missing or out of order\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}